@@ -0,0 +1,73 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aintext.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+#include "system4/utfsjis.h"
+}
+
+/*
+ * libsys4 frees its buffer of the file once it is parsed, and the ain owns
+ * (and frees) what the conversion returns, so this copy is the only one.
+ */
+static char *conv_none(const char *sjis)
+{
+	return strdup(sjis);
+}
+
+struct ain *ain_open_lazy(const QString &path, int *error)
+{
+	return ain_open_conv(path.toUtf8(), conv_none, error);
+}
+
+static bool is_ascii(const char *s)
+{
+	for (; *s; s++) {
+		if (*s & 0x80)
+			return false;
+	}
+	return true;
+}
+
+QString sjis_decode(const char *sjis)
+{
+	// most identifiers are plain ASCII, which is the same in both
+	if (is_ascii(sjis))
+		return QString::fromLatin1(sjis);
+	char *utf = sjis2utf(sjis, 0);
+	QString out = QString::fromUtf8(utf);
+	free(utf);
+	return out;
+}
+
+QByteArray sjis_encode(const QString &s)
+{
+	QByteArray utf = s.toUtf8();
+	if (is_ascii(utf.constData()))
+		return utf;
+	char *sjis = utf2sjis(utf.constData(), utf.size());
+	QByteArray out(sjis);
+	free(sjis);
+	// unmappable characters are replaced rather than reported
+	if (sjis_decode(out.constData()) != s)
+		return QByteArray();
+	return out;
+}
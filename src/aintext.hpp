@@ -14,29 +14,25 @@
  * along with this program; if not, see <http://gnu.org/licenses/>.
  */
 
-#ifndef XSYS4DBG_SYNTAX_HIGHLIGHTER_HPP
-#define XSYS4DBG_SYNTAX_HIGHLIGHTER_HPP
+#ifndef XSYS4DBG_AIN_TEXT_HPP
+#define XSYS4DBG_AIN_TEXT_HPP
 
-#include <QRegularExpression>
-#include <QSyntaxHighlighter>
-#include <QTextCharFormat>
-#include <QTextDocument>
+#include <QByteArray>
+#include <QString>
 
-class SyntaxHighlighter : public QSyntaxHighlighter {
-	Q_OBJECT
-public:
-	SyntaxHighlighter(QTextDocument *parent = nullptr);
-	void addRule(const QRegularExpression &pattern, const QTextCharFormat &format);
+struct ain;
 
-protected:
-	void highlightBlock(const QString &text) override;
+/*
+ * Open an .ain file without converting its text. Identifiers, strings and
+ * messages are left in SJIS as stored in the file, and are decoded where
+ * they are displayed (most strings and messages never are).
+ */
+struct ain *ain_open_lazy(const QString &path, int *error);
 
-private:
-	struct HighlightingRule {
-		QRegularExpression pattern;
-		QTextCharFormat format;
-	};
-	QVector<HighlightingRule> rules;
-};
+// Decode SJIS text from an .ain opened with ain_open_lazy().
+QString sjis_decode(const char *sjis);
+// Encode text as SJIS, to compare with the text in the .ain. Returns an
+// empty array if `s` has characters that SJIS can't represent.
+QByteArray sjis_encode(const QString &s);
 
 #endif
@@ -0,0 +1,165 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+#include "cachefile.hpp"
+
+// version of the container format (not of the contents)
+#define CACHE_FORMAT_VERSION 1
+#define BYTE_ORDER_MARK 0x01020304u
+#define ALIGNMENT 8
+
+namespace {
+
+struct Header {
+	quint32 magic;
+	quint32 byteOrder;
+	quint32 formatVersion;
+	quint32 version;
+};
+
+}
+
+QString cache_path(const char *kind, const QByteArray &ainHash)
+{
+	QDir dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+	return dir.filePath(QString::fromLatin1(kind) + "/" + QString::fromLatin1(ainHash) + ".bin");
+}
+
+QByteArray file_hash(const QString &path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return QByteArray();
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	if (!hash.addData(&file))
+		return QByteArray();
+	return hash.result().toHex();
+}
+
+static qint64 align(qint64 pos)
+{
+	return (pos + ALIGNMENT - 1) & ~(qint64)(ALIGNMENT - 1);
+}
+
+CacheWriter::CacheWriter(const QString &path, quint32 magic, quint32 version)
+	: file(path)
+{
+	QDir().mkpath(QFileInfo(path).path());
+	ok = file.open(QIODevice::WriteOnly);
+	write(Header { magic, BYTE_ORDER_MARK, CACHE_FORMAT_VERSION, version });
+}
+
+void CacheWriter::writeRaw(const void *data, qint64 size)
+{
+	if (!ok)
+		return;
+	if (file.write((const char*)data, size) != size)
+		ok = false;
+	pos += size;
+}
+
+void CacheWriter::writeArrayRaw(const void *data, qint64 count, qint64 elemSize)
+{
+	static const char padding[ALIGNMENT] = {};
+	write(count);
+	writeRaw(padding, align(pos) - pos);
+	writeRaw(data, count * elemSize);
+}
+
+void CacheWriter::writeStrings(const QVector<QString> &strings)
+{
+	QVector<int> offsets;
+	QVector<ushort> text;
+	offsets.reserve(strings.size() + 1);
+	offsets.append(0);
+	for (const QString &s : strings) {
+		int start = text.size();
+		text.resize(start + s.size());
+		memcpy(text.data() + start, s.utf16(), s.size() * sizeof(ushort));
+		offsets.append(text.size());
+	}
+	writeArray(offsets);
+	writeArray(text);
+}
+
+bool CacheWriter::commit()
+{
+	if (!ok) {
+		file.cancelWriting();
+		return false;
+	}
+	return file.commit();
+}
+
+CacheReader::CacheReader(const QString &path, quint32 magic, quint32 version)
+	: file(path)
+{
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+	size = file.size();
+	data = file.map(0, size);
+	if (!data)
+		return;
+
+	valid = true;
+	Header header;
+	if (!read(&header) || header.magic != magic || header.byteOrder != BYTE_ORDER_MARK
+			|| header.formatVersion != CACHE_FORMAT_VERSION || header.version != version)
+		valid = false;
+}
+
+bool CacheReader::readRaw(void *out, qint64 n)
+{
+	if (!valid || n > size - pos)
+		return valid = false;
+	memcpy(out, data + pos, n);
+	pos += n;
+	return true;
+}
+
+bool CacheReader::readArrayHeader(qint64 *count, qint64 elemSize)
+{
+	if (!read(count))
+		return false;
+	pos = align(pos);
+	if (*count < 0 || *count > INT_MAX || pos > size || *count > (size - pos) / elemSize)
+		return valid = false;
+	return true;
+}
+
+bool CacheReader::readStrings(QVector<QString> *strings)
+{
+	QVector<int> offsets;
+	QVector<ushort> text;
+	if (!readArray(&offsets) || !readArray(&text))
+		return false;
+	if (offsets.isEmpty() || offsets.first() != 0 || offsets.last() != text.size())
+		return valid = false;
+	strings->resize(offsets.size() - 1);
+	for (int i = 0; i < strings->size(); i++) {
+		if (offsets[i] > offsets[i+1])
+			return valid = false;
+		(*strings)[i] = QString((const QChar*)text.constData() + offsets[i],
+				offsets[i+1] - offsets[i]);
+	}
+	return true;
+}
@@ -0,0 +1,136 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_CACHE_FILE_HPP
+#define XSYS4DBG_CACHE_FILE_HPP
+
+#include <string.h>
+#include <type_traits>
+#include <QByteArray>
+#include <QFile>
+#include <QSaveFile>
+#include <QString>
+#include <QVector>
+
+/*
+ * Binary cache files for data derived from an .ain (symbols, code index,
+ * call graph), stored under the user cache directory and keyed by the hash of
+ * the .ain file.
+ *
+ * A file is a header (magic, byte order, format and content versions)
+ * followed by plain arrays, each preceded by its length and aligned to 8
+ * bytes. Readers map the file and copy the arrays out in one memcpy each;
+ * nothing is parsed. Anything that doesn't match (truncated file, other
+ * version or byte order) makes the reader fail, and the data is rebuilt.
+ */
+
+// cache file for `kind` ("index", ...) of the .ain with hash `ainHash`
+QString cache_path(const char *kind, const QByteArray &ainHash);
+// Hash of a file's contents (hex), or an empty array on error.
+QByteArray file_hash(const QString &path);
+
+class CacheWriter
+{
+public:
+	CacheWriter(const QString &path, quint32 magic, quint32 version);
+
+	template<typename T>
+	void write(const T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not a plain type");
+		writeRaw(&value, sizeof(T));
+	}
+
+	template<typename T>
+	void writeArray(const QVector<T> &array)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not a plain type");
+		writeArrayRaw(array.constData(), array.size(), sizeof(T));
+	}
+
+	void writeArray(const QByteArray &array)
+	{
+		writeArrayRaw(array.constData(), array.size(), 1);
+	}
+
+	// strings as UTF-16 text, concatenated, and offsets
+	void writeStrings(const QVector<QString> &strings);
+
+	// Write the file to disk. Returns false if any write failed.
+	bool commit();
+
+private:
+	void writeRaw(const void *data, qint64 size);
+	void writeArrayRaw(const void *data, qint64 count, qint64 elemSize);
+
+	QSaveFile file;
+	qint64 pos = 0;
+	bool ok = false;
+};
+
+class CacheReader
+{
+public:
+	CacheReader(const QString &path, quint32 magic, quint32 version);
+
+	// false if the header didn't match or a read failed
+	bool isValid() const { return valid; }
+	bool atEnd() const { return pos == size; }
+
+	template<typename T>
+	bool read(T *value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not a plain type");
+		return readRaw(value, sizeof(T));
+	}
+
+	template<typename T>
+	bool readArray(QVector<T> *array)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "not a plain type");
+		qint64 count;
+		if (!readArrayHeader(&count, sizeof(T)))
+			return false;
+		array->resize(count);
+		memcpy(array->data(), data + pos, count * sizeof(T));
+		pos += count * sizeof(T);
+		return true;
+	}
+
+	bool readArray(QByteArray *array)
+	{
+		qint64 count;
+		if (!readArrayHeader(&count, 1))
+			return false;
+		*array = QByteArray((const char*)data + pos, count);
+		pos += count;
+		return true;
+	}
+
+	bool readStrings(QVector<QString> *strings);
+
+private:
+	bool readRaw(void *out, qint64 n);
+	bool readArrayHeader(qint64 *count, qint64 elemSize);
+
+	QFile file;
+	const uchar *data = nullptr;
+	qint64 size = 0;
+	qint64 pos = 0;
+	bool valid = false;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "cachefile.hpp"
+#include "callgraph.hpp"
+#include "codeindex.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+#include "system4/instructions.h"
+}
+
+// check for cancellation every this many functions
+#define CANCEL_CHECK_INTERVAL 1024
+
+// cache file header; bump the version whenever the layout changes
+#define CACHE_MAGIC 0x58434752 // "XCGR"
+#define CACHE_VERSION 2
+
+namespace {
+
+struct Edge {
+	int caller;
+	int callee;
+};
+
+}
+
+// Delegate instructions taking a function number from the stack.
+static bool binds_function(int opcode)
+{
+	switch (opcode) {
+	case DG_SET:
+	case DG_ADD:
+	case DG_NEW_FROM_METHOD:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Group sorted edges into runs per caller (or callee), counting duplicates.
+static void compress(const QVector<Edge> &edges, int nrFunctions, bool byCallee,
+		QVector<int> &offsets, QVector<CallGraph::Call> &list)
+{
+	offsets.fill(0, nrFunctions + 1);
+	list.clear();
+	for (int i = 0; i < edges.size(); i++) {
+		int from = byCallee ? edges[i].callee : edges[i].caller;
+		int to = byCallee ? edges[i].caller : edges[i].callee;
+		if (offsets[from + 1] > 0 && list.last().fno == to) {
+			list.last().count++;
+			continue;
+		}
+		list.append({ to, 1 });
+		offsets[from + 1]++;
+	}
+	for (int i = 0; i < nrFunctions; i++) {
+		offsets[i+1] += offsets[i];
+	}
+}
+
+CallGraph *CallGraph::build(struct ain *ain, const CodeIndex &index,
+		const std::atomic<bool> *cancel)
+{
+	const QVector<CodeIndex::Instruction> &instrs = index.instructions();
+	int nrFunctions = ain->nr_functions;
+
+	QVector<Edge> edges;
+	for (int fno = 0; fno < index.nrFunctions(); fno++) {
+		if (cancel && fno % CANCEL_CHECK_INTERVAL == 0 && *cancel)
+			return nullptr;
+		CodeIndex::Range range = index.functionRange(fno);
+		for (int i = range.first; i < range.first + range.count; i++) {
+			const struct instruction *info = instrs[i].instr;
+			// FUNC/ENDFUNC name the function itself
+			if (info->opcode == FUNC || info->opcode == ENDFUNC)
+				continue;
+			for (int a = 0; a < info->nr_args; a++) {
+				int32_t callee = instrs[i].args[a];
+				if (info->args[a] == T_FUNC && callee >= 0 && callee < nrFunctions)
+					edges.append({ fno, callee });
+			}
+			if (binds_function(info->opcode) && i > range.first
+					&& instrs[i-1].instr->opcode == PUSH) {
+				int32_t callee = instrs[i-1].args[0];
+				if (callee >= 0 && callee < nrFunctions)
+					edges.append({ fno, callee });
+			}
+		}
+	}
+
+	CallGraph *g = new CallGraph;
+	std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+		return a.caller < b.caller || (a.caller == b.caller && a.callee < b.callee);
+	});
+	compress(edges, nrFunctions, false, g->calleeOffsets, g->calleeList);
+	std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+		return a.callee < b.callee || (a.callee == b.callee && a.caller < b.caller);
+	});
+	compress(edges, nrFunctions, true, g->callerOffsets, g->callerList);
+	return g;
+}
+
+CallGraph::Calls CallGraph::calls(const QVector<int> &offsets, const QVector<Call> &list,
+		int fno)
+{
+	if (fno < 0 || fno + 1 >= offsets.size())
+		return { nullptr, nullptr };
+	const Call *base = list.constData();
+	return { base + offsets[fno], base + offsets[fno + 1] };
+}
+
+static void write_calls(CacheWriter &out, const QVector<int> &offsets,
+		const QVector<CallGraph::Call> &list)
+{
+	out.writeArray(offsets);
+	out.writeArray(list);
+}
+
+static bool read_calls(CacheReader &in, int nrFunctions, QVector<int> &offsets,
+		QVector<CallGraph::Call> &list)
+{
+	if (!in.readArray(&offsets) || !in.readArray(&list))
+		return false;
+	if (offsets.size() != nrFunctions + 1 || offsets.first() != 0
+			|| offsets.last() != list.size())
+		return false;
+	for (int i = 0; i < nrFunctions; i++) {
+		if (offsets[i] > offsets[i+1])
+			return false;
+	}
+	for (const CallGraph::Call &c : list) {
+		if (c.fno < 0 || c.fno >= nrFunctions)
+			return false;
+	}
+	return true;
+}
+
+CallGraph *CallGraph::load(const QString &path, int nrFunctions)
+{
+	CacheReader in(path, CACHE_MAGIC, CACHE_VERSION);
+	CallGraph *g = new CallGraph;
+	if (!read_calls(in, nrFunctions, g->calleeOffsets, g->calleeList)
+			|| !read_calls(in, nrFunctions, g->callerOffsets, g->callerList)
+			|| !in.atEnd()) {
+		delete g;
+		return nullptr;
+	}
+	return g;
+}
+
+bool CallGraph::save(const QString &path) const
+{
+	CacheWriter out(path, CACHE_MAGIC, CACHE_VERSION);
+	write_calls(out, calleeOffsets, calleeList);
+	write_calls(out, callerOffsets, callerList);
+	return out.commit();
+}
@@ -0,0 +1,77 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_CALL_GRAPH_HPP
+#define XSYS4DBG_CALL_GRAPH_HPP
+
+#include <atomic>
+#include <QString>
+#include <QVector>
+
+struct ain;
+class CodeIndex;
+
+/*
+ * Whole-program call graph. Edges come from T_FUNC operands (direct calls,
+ * method calls and function references) and from delegates bound to a
+ * function number pushed just before the delegate instruction. Callees and
+ * callers of each function are stored as sorted runs of one array (CSR),
+ * with the number of call sites per edge.
+ *
+ * The graph only depends on the .ain, so it is cached on disk keyed by the
+ * hash of the .ain file.
+ */
+class CallGraph
+{
+public:
+	struct Call {
+		int fno;
+		int count; // number of call sites
+	};
+
+	struct Calls {
+		const Call *begin;
+		const Call *end;
+		int size() const { return end - begin; }
+	};
+
+	// Build the call graph from a code index. Returns nullptr if cancelled.
+	static CallGraph *build(struct ain *ain, const CodeIndex &index,
+			const std::atomic<bool> *cancel = nullptr);
+	// Load a cached graph. Returns nullptr if the file doesn't exist or
+	// doesn't match an .ain with `nrFunctions` functions.
+	static CallGraph *load(const QString &path, int nrFunctions);
+	bool save(const QString &path) const;
+
+	int nrFunctions() const { return calleeOffsets.size() - 1; }
+	// functions called by `fno`, in function number order
+	Calls callees(int fno) const { return calls(calleeOffsets, calleeList, fno); }
+	// functions calling `fno`, in function number order
+	Calls callers(int fno) const { return calls(callerOffsets, callerList, fno); }
+	int nrEdges() const { return calleeList.size(); }
+
+private:
+	CallGraph() = default;
+
+	static Calls calls(const QVector<int> &offsets, const QVector<Call> &list, int fno);
+
+	QVector<int> calleeOffsets;
+	QVector<Call> calleeList;
+	QVector<int> callerOffsets;
+	QVector<Call> callerList;
+};
+
+#endif
@@ -0,0 +1,233 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <QtWidgets>
+#include "callgraphview.hpp"
+#include "instructionprinter.hpp"
+#include "symboltable.hpp"
+
+enum {
+	COLUMN_FUNCTION,
+	COLUMN_SITES,
+	COLUMN_FANOUT,
+	NR_COLUMNS
+};
+
+CallGraphModel::CallGraphModel(QSharedPointer<const CallGraph> graph,
+		QSharedPointer<const InstructionPrinter> printer,
+		int root, Direction direction, QObject *parent)
+	: TreeModel(parent)
+	, graph(graph)
+	, printer(printer)
+	, direction(direction)
+{
+	CallGraphNode n;
+	n.fno = root;
+	addNode(ROOT, n);
+}
+
+CallGraph::Calls CallGraphModel::calls(int fno) const
+{
+	return direction == CALLERS ? graph->callers(fno) : graph->callees(fno);
+}
+
+int CallGraphModel::function(const QModelIndex &index) const
+{
+	return index.isValid() ? node(nodeId(index)).fno : -1;
+}
+
+int CallGraphModel::columnCount(const QModelIndex &parent) const
+{
+	return NR_COLUMNS;
+}
+
+QVariant CallGraphModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid())
+		return QVariant();
+
+	const CallGraphNode &n = node(nodeId(index));
+	if (role == Qt::ForegroundRole && n.recursive)
+		return QColor(Qt::gray);
+	if (role != Qt::DisplayRole)
+		return QVariant();
+
+	switch (index.column()) {
+	case COLUMN_FUNCTION: {
+		const QString *name = printer->symbolTable().function(n.fno);
+		QString text = name ? *name : QString::number(n.fno);
+		return n.recursive ? tr("%1 (recursive)").arg(text) : text;
+	}
+	case COLUMN_SITES:
+		// the root has no edge to a parent
+		return n.count ? QVariant(n.count) : QVariant();
+	case COLUMN_FANOUT:
+		return calls(n.fno).size();
+	}
+	return QVariant();
+}
+
+QVariant CallGraphModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QVariant();
+
+	switch (section) {
+	case COLUMN_FUNCTION: return tr("Function");
+	case COLUMN_SITES:    return tr("Call Sites");
+	case COLUMN_FANOUT:   return direction == CALLERS ? tr("Callers") : tr("Callees");
+	}
+	return QVariant();
+}
+
+bool CallGraphModel::hasChildren(const QModelIndex &parent) const
+{
+	if (parent.column() > 0)
+		return false;
+	int id = nodeId(parent);
+	if (childCount(id) > 0)
+		return true;
+	if (id == ROOT)
+		return false;
+	const CallGraphNode &n = node(id);
+	return !n.fetched && !n.recursive && calls(n.fno).size() > 0;
+}
+
+bool CallGraphModel::canFetchMore(const QModelIndex &parent) const
+{
+	if (!parent.isValid())
+		return false;
+	const CallGraphNode &n = node(nodeId(parent));
+	return !n.fetched && !n.recursive && calls(n.fno).size() > 0;
+}
+
+/*
+ * Children are created when a node is expanded, most frequent calls first.
+ */
+void CallGraphModel::fetchMore(const QModelIndex &parent)
+{
+	if (!canFetchMore(parent))
+		return;
+
+	int id = nodeId(parent);
+	node(id).fetched = true;
+	CallGraph::Calls c = calls(node(id).fno);
+	QVector<CallGraph::Call> sorted;
+	sorted.reserve(c.size());
+	for (const CallGraph::Call *call = c.begin; call != c.end; call++) {
+		sorted.append(*call);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(),
+			[](const CallGraph::Call &a, const CallGraph::Call &b) {
+		return a.count > b.count;
+	});
+
+	beginInsertRows(parent, 0, sorted.size() - 1);
+	reserveNodes(nodeCount() + sorted.size());
+	for (const CallGraph::Call &call : sorted) {
+		CallGraphNode n;
+		n.fno = call.fno;
+		n.count = call.count;
+		for (int a = id; a != ROOT; a = parentNode(a)) {
+			if (node(a).fno == call.fno) {
+				n.recursive = true;
+				break;
+			}
+		}
+		addNode(id, n);
+	}
+	endInsertRows();
+}
+
+CallGraphView::CallGraphView(QWidget *parent)
+	: QDockWidget(tr("Call Graph"), parent)
+{
+	QWidget *widget = new QWidget;
+	QVBoxLayout *layout = new QVBoxLayout(widget);
+	layout->setContentsMargins(0, 0, 0, 0);
+
+	QHBoxLayout *top = new QHBoxLayout;
+	label = new QLabel;
+	direction = new QComboBox;
+	direction->addItem(tr("Callers"), CallGraphModel::CALLERS);
+	direction->addItem(tr("Callees"), CallGraphModel::CALLEES);
+	top->addWidget(label, 1);
+	top->addWidget(direction);
+	layout->addLayout(top);
+
+	view = new QTreeView;
+	view->setUniformRowHeights(true);
+	QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+	font.setFixedPitch(true);
+	font.setPointSize(10);
+	view->setFont(font);
+	layout->addWidget(view);
+	setWidget(widget);
+
+	connect(direction, QOverload<int>::of(&QComboBox::activated), this, &CallGraphView::rebuild);
+	connect(view, &QTreeView::activated, this, [this](const QModelIndex &index) {
+		if (model && index.isValid())
+			emit functionActivated(model->function(index));
+	});
+	rebuild();
+}
+
+void CallGraphView::setPrinter(QSharedPointer<const InstructionPrinter> p)
+{
+	printer = p;
+	graph.reset();
+	root = -1;
+	rebuild();
+}
+
+void CallGraphView::setCallGraph(QSharedPointer<const CallGraph> g)
+{
+	graph = g;
+	rebuild();
+}
+
+void CallGraphView::showFunction(int fno)
+{
+	root = fno;
+	rebuild();
+}
+
+void CallGraphView::rebuild()
+{
+	CallGraphModel *old = model;
+	model = nullptr;
+	if (root < 0 || !printer) {
+		label->setText(tr("Use View > Call Graph to explore the current function."));
+	} else if (!graph) {
+		label->setText(tr("Waiting for the call graph..."));
+	} else {
+		auto dir = (CallGraphModel::Direction)direction->currentData().toInt();
+		model = new CallGraphModel(graph, printer, root, dir, this);
+		const QString *name = printer->symbolTable().function(root);
+		label->setText(tr("%1: %2 caller(s), %3 callee(s)")
+				.arg(name ? *name : QString::number(root))
+				.arg(graph->callers(root).size())
+				.arg(graph->callees(root).size()));
+	}
+	view->setModel(model);
+	delete old;
+
+	if (model) {
+		view->expand(model->index(0, 0));
+		view->resizeColumnToContents(COLUMN_FUNCTION);
+	}
+}
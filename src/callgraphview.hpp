@@ -0,0 +1,103 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_CALL_GRAPH_VIEW_HPP
+#define XSYS4DBG_CALL_GRAPH_VIEW_HPP
+
+#include <QDockWidget>
+#include <QSharedPointer>
+#include "callgraph.hpp"
+#include "treemodel.hpp"
+
+class InstructionPrinter;
+class QComboBox;
+class QLabel;
+class QTreeView;
+
+struct CallGraphNode
+{
+	int fno = -1;
+	int count = 0;          // call sites between this node and its parent
+	bool fetched = false;
+	bool recursive = false; // the function is already an ancestor
+};
+
+/*
+ * Callers (or callees) of one function, as a tree. A node's children are
+ * only created when it is expanded, so arbitrarily deep (and recursive)
+ * call chains can be explored.
+ */
+class CallGraphModel : public TreeModel<CallGraphNode>
+{
+	Q_OBJECT
+public:
+	enum Direction {
+		CALLERS,
+		CALLEES,
+	};
+
+	CallGraphModel(QSharedPointer<const CallGraph> graph,
+			QSharedPointer<const InstructionPrinter> printer,
+			int root, Direction direction, QObject *parent = nullptr);
+
+	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation,
+			int role = Qt::DisplayRole) const override;
+	bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+	bool canFetchMore(const QModelIndex &parent) const override;
+	void fetchMore(const QModelIndex &parent) override;
+
+	int function(const QModelIndex &index) const;
+
+private:
+	CallGraph::Calls calls(int fno) const;
+
+	QSharedPointer<const CallGraph> graph;
+	QSharedPointer<const InstructionPrinter> printer;
+	Direction direction;
+};
+
+class CallGraphView : public QDockWidget
+{
+	Q_OBJECT
+public:
+	CallGraphView(QWidget *parent = nullptr);
+
+	// Set the printer for a newly opened .ain (clears the graph).
+	void setPrinter(QSharedPointer<const InstructionPrinter> printer);
+	void setCallGraph(QSharedPointer<const CallGraph> graph);
+
+public slots:
+	void showFunction(int fno);
+
+signals:
+	void functionActivated(int fno);
+
+private:
+	void rebuild();
+
+	QSharedPointer<const CallGraph> graph;
+	QSharedPointer<const InstructionPrinter> printer;
+	int root = -1;
+
+	QLabel *label;
+	QComboBox *direction;
+	QTreeView *view;
+	CallGraphModel *model = nullptr;
+};
+
+#endif
@@ -0,0 +1,473 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QThread>
+#include <QThreadPool>
+
+#include "cachefile.hpp"
+#include "callgraph.hpp"
+#include "codeindex.hpp"
+
+extern "C" {
+#include <string.h>
+#include "system4/ain.h"
+#include "system4/dasm.h"
+}
+
+// size of the FUNC instruction preceding a function's code
+#define FUNC_INSTR_SIZE 6
+
+// number of decode jobs per thread, to even out functions of varying size
+#define JOBS_PER_THREAD 4
+
+// cache file header; bump the version whenever the index layout changes
+#define INDEX_CACHE_MAGIC 0x58494458 // "XIDX"
+#define INDEX_CACHE_VERSION 2
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+namespace {
+
+// one function (or several aliases of the same code)
+struct FunctionStart {
+	uint32_t address;
+	int fno;
+};
+
+// Decodes a contiguous run of functions into a job-local table.
+class DecodeJob : public QRunnable
+{
+public:
+	DecodeJob(struct ain *ain, const QVector<FunctionStart> &starts, int begin, int end,
+			const std::atomic<bool> *cancel)
+		: ain(ain), starts(starts), begin(begin), end(end), cancel(cancel)
+	{
+		setAutoDelete(false);
+	}
+
+	void run() override;
+
+	QVector<CodeIndex::Instruction> instructions;
+	QVector<CodeIndex::Range> ranges; // per entry in [begin, end), job-local
+
+private:
+	void push(struct dasm *dasm);
+
+	struct ain *ain;
+	const QVector<FunctionStart> &starts;
+	int begin;
+	int end;
+	const std::atomic<bool> *cancel;
+};
+
+}
+
+static bool dasm_finished(struct dasm *dasm)
+{
+	return dasm_eof(dasm) || dasm_opcode(dasm) == ENDFUNC || dasm_opcode(dasm) == FUNC;
+}
+
+void DecodeJob::push(struct dasm *dasm)
+{
+	CodeIndex::Instruction instr = {
+		.address = dasm_addr(dasm),
+		.instr = dasm_instruction(dasm)
+	};
+	for (int i = 0; i < instr.instr->nr_args; i++) {
+		instr.args[i] = dasm_arg(dasm, i);
+	}
+	instructions.push_back(instr);
+}
+
+void DecodeJob::run()
+{
+	struct dasm dasm;
+	dasm_init(&dasm, ain);
+
+	for (int i = begin; i < end; i++) {
+		if (cancel && *cancel)
+			return;
+
+		int first = instructions.size();
+		dasm_jump(&dasm, starts[i].address);
+		do {
+			push(&dasm);
+			dasm_next(&dasm);
+		} while (!dasm_finished(&dasm));
+
+		if (dasm_opcode(&dasm) == ENDFUNC) {
+			push(&dasm);
+		}
+		ranges.push_back({ first, instructions.size() - first });
+	}
+}
+
+CodeIndex *CodeIndex::build(struct ain *ain, const std::atomic<bool> *cancel)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	// functions in address order; aliases (functions sharing code) are
+	// decoded once
+	QVector<FunctionStart> starts;
+	for (int i = 0; i < ain->nr_functions; i++) {
+		uint32_t addr = ain->functions[i].address;
+		if (addr < FUNC_INSTR_SIZE || addr >= (uint32_t)ain->code_size)
+			continue;
+		starts.push_back({ addr - FUNC_INSTR_SIZE, i });
+	}
+	std::stable_sort(starts.begin(), starts.end(),
+			[](const FunctionStart &a, const FunctionStart &b) {
+		return a.address < b.address;
+	});
+	QVector<FunctionStart> unique;
+	QVector<int> uniqueIndex(starts.size());
+	for (int i = 0; i < starts.size(); i++) {
+		if (unique.isEmpty() || unique.last().address != starts[i].address)
+			unique.push_back(starts[i]);
+		uniqueIndex[i] = unique.size() - 1;
+	}
+
+	// decode in parallel
+	QThreadPool pool;
+	int nrJobs = qMax(1, qMin(unique.size(), QThread::idealThreadCount() * JOBS_PER_THREAD));
+	QVector<DecodeJob*> jobs;
+	for (int i = 0; i < nrJobs; i++) {
+		int begin = (int)((qint64)unique.size() * i / nrJobs);
+		int end = (int)((qint64)unique.size() * (i + 1) / nrJobs);
+		jobs.push_back(new DecodeJob(ain, unique, begin, end, cancel));
+		pool.start(jobs.last());
+	}
+	pool.waitForDone();
+
+	if (cancel && *cancel) {
+		qDeleteAll(jobs);
+		return nullptr;
+	}
+
+	// merge job-local tables
+	CodeIndex *index = new CodeIndex;
+	int total = 0;
+	for (DecodeJob *job : jobs) {
+		total += job->instructions.size();
+	}
+	index->instrs.reserve(total);
+
+	QVector<Range> uniqueRanges;
+	uniqueRanges.reserve(unique.size());
+	for (DecodeJob *job : jobs) {
+		int offset = index->instrs.size();
+		index->instrs.append(job->instructions);
+		for (const Range &r : job->ranges) {
+			uniqueRanges.push_back({ offset + r.first, r.count });
+		}
+	}
+	qDeleteAll(jobs);
+
+	index->intervals.resize(unique.size());
+	for (int i = 0; i < unique.size(); i++) {
+		uint32_t end = i + 1 < unique.size() ? unique[i+1].address : ain->code_size;
+		index->intervals[i] = { unique[i].address, end, unique[i].fno };
+	}
+
+	index->functions.fill({ 0, 0 }, ain->nr_functions);
+	for (int i = 0; i < starts.size(); i++) {
+		index->functions[starts[i].fno] = uniqueRanges[uniqueIndex[i]];
+	}
+
+	index->indexOpcodes();
+	if (!index->xrefIndex.build(ain, *index, cancel)
+			|| !index->searchIndex.build(ain, cancel)) {
+		delete index;
+		return nullptr;
+	}
+
+	index->elapsed = timer.elapsed();
+	return index;
+}
+
+namespace {
+
+// an Instruction as stored in the cache (opcode instead of a pointer)
+struct InstructionRecord {
+	uint32_t address;
+	int32_t opcode;
+	int32_t args[INSTRUCTION_MAX_ARGS];
+};
+
+}
+
+static quint32 fnv_add(quint32 hash, const void *data, size_t size)
+{
+	const uchar *p = (const uchar*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ p[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+static quint32 fnv_add(quint32 hash, const char *str)
+{
+	return str ? fnv_add(hash, str, strlen(str) + 1) : fnv_add(hash, "", 1);
+}
+
+/*
+ * The cache stores opcode and syscall numbers and operands decoded with
+ * libsys4's tables, so a libsys4 that renumbers opcodes or changes their
+ * arguments must not load it. The version written to the header covers the
+ * tables as well as the layout.
+ */
+static quint32 index_cache_version()
+{
+	static const quint32 version = [] {
+		quint32 hash = FNV_OFFSET;
+		quint32 layout = INDEX_CACHE_VERSION;
+		int nrOpcodes = NR_OPCODES, nrSyscalls = NR_SYSCALLS;
+		hash = fnv_add(hash, &layout, sizeof(layout));
+		hash = fnv_add(hash, &nrOpcodes, sizeof(nrOpcodes));
+		for (int op = 0; op < NR_OPCODES; op++) {
+			const struct instruction *info = &instructions[op];
+			hash = fnv_add(hash, info->name);
+			hash = fnv_add(hash, &info->opcode, sizeof(info->opcode));
+			hash = fnv_add(hash, &info->nr_args, sizeof(info->nr_args));
+			for (int a = 0; a < info->nr_args; a++) {
+				int type = info->args[a];
+				hash = fnv_add(hash, &type, sizeof(type));
+			}
+		}
+		hash = fnv_add(hash, &nrSyscalls, sizeof(nrSyscalls));
+		for (int i = 0; i < NR_SYSCALLS; i++) {
+			hash = fnv_add(hash, syscalls[i].name);
+		}
+		return hash;
+	}();
+	return version;
+}
+
+CodeIndex *CodeIndex::load(const QString &path, struct ain *ain)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	CacheReader in(path, INDEX_CACHE_MAGIC, index_cache_version());
+	QVector<InstructionRecord> records;
+	QScopedPointer<CodeIndex> index(new CodeIndex);
+	if (!in.readArray(&records) || !in.readArray(&index->intervals)
+			|| !in.readArray(&index->functions))
+		return nullptr;
+	if (index->functions.size() != ain->nr_functions)
+		return nullptr;
+	// functionAt() binary searches the intervals
+	for (int i = 0; i < index->intervals.size(); i++) {
+		const Interval &iv = index->intervals[i];
+		if (iv.start >= iv.end || iv.end > (uint32_t)ain->code_size
+				|| iv.fno < 0 || iv.fno >= ain->nr_functions)
+			return nullptr;
+		if (i > 0 && index->intervals[i-1].end > iv.start)
+			return nullptr;
+	}
+	for (const Range &r : index->functions) {
+		if (r.first < 0 || r.count < 0 || r.first > records.size() - r.count)
+			return nullptr;
+	}
+
+	index->instrs.resize(records.size());
+	for (int i = 0; i < records.size(); i++) {
+		const InstructionRecord &r = records[i];
+		if (r.opcode < 0 || r.opcode >= NR_OPCODES)
+			return nullptr;
+		// instructions are binary searched by address
+		if (r.address >= (uint32_t)ain->code_size
+				|| (i > 0 && r.address <= records[i-1].address))
+			return nullptr;
+		Instruction &instr = index->instrs[i];
+		instr.address = r.address;
+		instr.instr = &instructions[r.opcode];
+		memcpy(instr.args, r.args, sizeof(instr.args));
+	}
+
+	// cheap enough to rebuild rather than store
+	index->indexOpcodes();
+	if (!index->xrefIndex.load(in, ain, index->instrs.size())
+			|| !index->searchIndex.load(in, ain) || !in.atEnd())
+		return nullptr;
+
+	index->elapsed = timer.elapsed();
+	index->cached = true;
+	return index.take();
+}
+
+bool CodeIndex::save(const QString &path) const
+{
+	QVector<InstructionRecord> records(instrs.size());
+	for (int i = 0; i < instrs.size(); i++) {
+		InstructionRecord &r = records[i];
+		r.address = instrs[i].address;
+		r.opcode = instrs[i].instr->opcode;
+		memcpy(r.args, instrs[i].args, sizeof(r.args));
+	}
+
+	CacheWriter out(path, INDEX_CACHE_MAGIC, index_cache_version());
+	out.writeArray(records);
+	out.writeArray(intervals);
+	out.writeArray(functions);
+	xrefIndex.save(out);
+	searchIndex.save(out);
+	return out.commit();
+}
+
+void CodeIndex::indexOpcodes()
+{
+	// counting sort by opcode
+	opcodeOffsets.fill(0, NR_OPCODES + 1);
+	for (const Instruction &instr : instrs) {
+		opcodeOffsets[instr.instr->opcode + 1]++;
+	}
+	for (int op = 0; op < NR_OPCODES; op++) {
+		opcodeOffsets[op+1] += opcodeOffsets[op];
+	}
+	QVector<int> next = opcodeOffsets;
+	opcodeInstrs.resize(instrs.size());
+	for (int i = 0; i < instrs.size(); i++) {
+		opcodeInstrs[next[instrs[i].instr->opcode]++] = i;
+	}
+}
+
+XrefIndex::Refs CodeIndex::withOpcode(int opcode) const
+{
+	if (opcode < 0 || opcode >= NR_OPCODES)
+		return { nullptr, nullptr };
+	const int *base = opcodeInstrs.constData();
+	return { base + opcodeOffsets[opcode], base + opcodeOffsets[opcode+1] };
+}
+
+qint64 CodeIndex::memoryUsage() const
+{
+	return (qint64)instrs.size() * sizeof(Instruction)
+		+ (qint64)intervals.size() * sizeof(Interval)
+		+ (qint64)functions.size() * sizeof(Range)
+		+ (qint64)(opcodeOffsets.size() + opcodeInstrs.size()) * sizeof(int)
+		+ xrefIndex.memoryUsage() + searchIndex.memoryUsage();
+}
+
+int CodeIndex::instructionAt(uint32_t address) const
+{
+	auto it = std::lower_bound(instrs.begin(), instrs.end(), address,
+			[](const Instruction &instr, uint32_t addr) {
+		return instr.address < addr;
+	});
+	if (it == instrs.end() || it->address != address)
+		return -1;
+	return it - instrs.begin();
+}
+
+int CodeIndex::functionAt(uint32_t address) const
+{
+	// first interval starting after address
+	auto it = std::upper_bound(intervals.begin(), intervals.end(), address,
+			[](uint32_t addr, const Interval &iv) {
+		return addr < iv.start;
+	});
+	if (it == intervals.begin())
+		return -1;
+	--it;
+	if (address >= it->end)
+		return -1;
+	return it->fno;
+}
+
+CodeIndex::Range CodeIndex::functionRange(int fno) const
+{
+	if (fno < 0 || fno >= functions.size())
+		return { 0, 0 };
+	return functions[fno];
+}
+
+CodeIndexer::CodeIndexer(QObject *parent)
+	: QObject(parent)
+{
+}
+
+CodeIndexer::~CodeIndexer()
+{
+	cancel();
+}
+
+void CodeIndexer::start(struct ain *ain, const QString &path, const QByteArray &hash)
+{
+	cancel();
+	cancelled = false;
+
+	int gen = ++generation;
+	thread = QThread::create([this, ain, path, hash, gen] {
+		// results are delivered on the indexer's thread; a newer build may
+		// have been started in the meantime
+		auto deliver = [this, gen](auto fn) {
+			QMetaObject::invokeMethod(this, [this, gen, fn] {
+				if (gen == generation)
+					fn();
+			}, Qt::QueuedConnection);
+		};
+
+		QSharedPointer<const CallGraph> calls;
+		if (!hash.isEmpty())
+			calls.reset(CallGraph::load(cache_path("callgraph", hash), ain->nr_functions));
+		if (calls)
+			deliver([this, calls] { emit callGraphFinished(calls); });
+
+		// a missing, stale or corrupt cache is rebuilt (and replaced)
+		CodeIndex *index = nullptr;
+		if (!hash.isEmpty())
+			index = CodeIndex::load(cache_path("index", hash), ain);
+		if (!index) {
+			index = CodeIndex::build(ain, &cancelled);
+			if (!index)
+				return;
+			if (!hash.isEmpty() && !index->save(cache_path("index", hash)))
+				qDebug() << "Failed to write index cache for" << path;
+		}
+		QSharedPointer<const CodeIndex> ptr(index);
+		deliver([this, ptr] { emit finished(ptr); });
+
+		if (calls)
+			return;
+		CallGraph *graph = CallGraph::build(ain, *index, &cancelled);
+		if (!graph)
+			return;
+		calls.reset(graph);
+		if (!hash.isEmpty() && !graph->save(cache_path("callgraph", hash)))
+			qDebug() << "Failed to write call graph cache for" << path;
+		deliver([this, calls] { emit callGraphFinished(calls); });
+	});
+	thread->start(QThread::LowPriority);
+}
+
+void CodeIndexer::cancel()
+{
+	if (!thread)
+		return;
+	cancelled = true;
+	thread->wait();
+	delete thread;
+	thread = nullptr;
+	generation++;
+}
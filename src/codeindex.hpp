@@ -0,0 +1,137 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_CODE_INDEX_HPP
+#define XSYS4DBG_CODE_INDEX_HPP
+
+#include <atomic>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+#include "searchindex.hpp"
+#include "xrefindex.hpp"
+
+extern "C" {
+#include "system4/instructions.h"
+}
+
+struct ain;
+class CallGraph;
+class QThread;
+
+/*
+ * Whole-program instruction table. All functions are decoded once (in
+ * parallel) into a single address-ordered array; lookups by address or
+ * function number are then binary searches/array accesses rather than
+ * re-running dasm. Cross references are built from the same table, along
+ * with the instructions of each opcode and a text search index over the
+ * names and strings that operands refer to.
+ */
+class CodeIndex
+{
+public:
+	struct Instruction {
+		uint32_t address;
+		const struct instruction *instr;
+		int32_t args[INSTRUCTION_MAX_ARGS];
+	};
+
+	// instructions [first, first + count) of the global table
+	struct Range {
+		int first;
+		int count;
+	};
+
+	// Build an index for `ain`. Returns nullptr if cancelled.
+	static CodeIndex *build(struct ain *ain, const std::atomic<bool> *cancel = nullptr);
+	// Load an index saved for `ain` (see cachefile.hpp). Returns nullptr if
+	// the file is missing, from another version or corrupt.
+	static CodeIndex *load(const QString &path, struct ain *ain);
+	bool save(const QString &path) const;
+
+	const QVector<Instruction> &instructions() const { return instrs; }
+	// index of the instruction at `address`, or -1
+	int instructionAt(uint32_t address) const;
+	// number of the function containing `address`, or -1
+	int functionAt(uint32_t address) const;
+	// instructions of function `fno` (count is 0 if the function has no code)
+	Range functionRange(int fno) const;
+	// indices of the instructions with `opcode`, in address order
+	XrefIndex::Refs withOpcode(int opcode) const;
+
+	const XrefIndex &xrefs() const { return xrefIndex; }
+	const SearchIndex &search() const { return searchIndex; }
+
+	int nrFunctions() const { return functions.size(); }
+	// time taken to build (or load) the index, in milliseconds
+	qint64 buildTime() const { return elapsed; }
+	bool fromCache() const { return cached; }
+	// approximate size in bytes, including xrefs and the search index
+	qint64 memoryUsage() const;
+
+private:
+	CodeIndex() = default;
+	void indexOpcodes();
+
+	// code range [start, end) belonging to a function
+	struct Interval {
+		uint32_t start;
+		uint32_t end;
+		int fno;
+	};
+
+	QVector<Instruction> instrs;
+	QVector<Interval> intervals;
+	QVector<Range> functions;
+	// instructions by opcode, in CSR form (as in XrefIndex)
+	QVector<int> opcodeOffsets;
+	QVector<int> opcodeInstrs;
+	XrefIndex xrefIndex;
+	SearchIndex searchIndex;
+	qint64 elapsed = 0;
+	bool cached = false;
+};
+
+/*
+ * Builds a CodeIndex on a background thread, followed by the call graph
+ * (which is loaded from the on-disk cache instead, if present).
+ */
+class CodeIndexer : public QObject
+{
+	Q_OBJECT
+public:
+	CodeIndexer(QObject *parent = nullptr);
+	~CodeIndexer();
+
+	// Start indexing `ain` (loaded from `path`, whose contents hash to
+	// `hash`; the results aren't cached if it is empty), cancelling any
+	// previous build. The ain must stay alive until callGraphFinished() is
+	// emitted or cancel() returns.
+	void start(struct ain *ain, const QString &path, const QByteArray &hash);
+	// Stop the current build (blocks until the worker thread has exited).
+	void cancel();
+
+signals:
+	void finished(QSharedPointer<const CodeIndex> index);
+	void callGraphFinished(QSharedPointer<const CallGraph> graph);
+
+private:
+	QThread *thread = nullptr;
+	std::atomic<bool> cancelled { false };
+	int generation = 0;
+};
+
+#endif
@@ -15,11 +15,13 @@
  */
 
 
+#include <algorithm>
 #include <QDebug>
 #include <QtWidgets>
 
 #include "codeviewer.hpp"
-#include "syntaxhighlighter.hpp"
+#include "controlflowview.hpp"
+#include "symboltable.hpp"
 #include "variablesmodel.hpp"
 
 extern "C" {
@@ -30,7 +32,7 @@ extern "C" {
 #include "system4/string.h"
 }
 
-CodeArea::CodeArea(QWidget *parent) : QPlainTextEdit(parent)
+CodeArea::CodeArea(QWidget *parent) : QAbstractScrollArea(parent)
 {
 	breakpointImage.load(":/icons/debug-breakpoint-stackframe-dot.svg");
 
@@ -39,43 +41,25 @@ CodeArea::CodeArea(QWidget *parent) : QPlainTextEdit(parent)
 	font.setPointSize(10);
 	setFont(font);
 
-	highlighter = new SyntaxHighlighter(document());
-
-	QTextCharFormat fmt;
-
-	fmt.setForeground(Qt::blue);
-	fmt.setFontWeight(QFont::Bold);
-	highlighter->addRule(QRegularExpression(QStringLiteral("\\bFUNC\\b")), fmt);
-	highlighter->addRule(QRegularExpression(QStringLiteral("\\bENDFUNC\\b")), fmt);
-	fmt.setFontWeight(QFont::Normal);
-
-	fmt.setForeground(Qt::darkCyan);
-	highlighter->addRule(QRegularExpression(QStringLiteral("\\b0x[a-fA-F0-9]+\\b")), fmt);
-	highlighter->addRule(QRegularExpression(QStringLiteral("\\b[1-9][0-9]*\\b")), fmt);
-	highlighter->addRule(QRegularExpression(QStringLiteral("\\b0[0-7]*\\b")), fmt);
-	highlighter->addRule(QRegularExpression(QStringLiteral("\\b[0-9]+\\.[0-9]+\\b")), fmt);
-
-	fmt.setForeground(Qt::darkGray);
-	highlighter->addRule(QRegularExpression(QStringLiteral("^\\S+:")), fmt);
-	highlighter->addRule(QRegularExpression(QStringLiteral("^\\.CASE\\b")), fmt);
-
-	fmt.setForeground(Qt::red);
-	highlighter->addRule(QRegularExpression(QStringLiteral("\"(\\\\.|[^\"\\\\])*\"")), fmt);
-
-	fmt.setForeground(Qt::darkGreen);
-	highlighter->addRule(QRegularExpression(QStringLiteral(";[^\n]*")), fmt);
-
 	addressArea = new AddressArea(this);
+	setViewportMargins(addressAreaWidth(), 0, 0, 0);
+
+	viewport()->setCursor(Qt::IBeamCursor);
+	// for the pointing hand cursor over jump targets
+	viewport()->setMouseTracking(true);
+	setFocusPolicy(Qt::StrongFocus);
 
-	connect(this, &CodeArea::updateRequest, this, &CodeArea::updateAddressArea);
 	connect(&Debugger::getInstance(), &Debugger::breakpointsReceived,
 			this, &CodeArea::updateBreakpoints);
-
-	setReadOnly(true);
 }
 
 #define H_PAD 2
 
+// number of functions whose rendered rows are kept in memory
+#define CODE_CACHE_SIZE 16
+// number of rendered rows kept per function
+#define ROW_CACHE_SIZE 4096
+
 int CodeArea::addressAreaWidth()
 {
 	int charWidth = fontMetrics().horizontalAdvance(QLatin1Char('9'));
@@ -83,90 +67,140 @@ int CodeArea::addressAreaWidth()
 	return iconHeight + H_PAD + (charWidth * 8);
 }
 
-void CodeArea::updateAddressAreaWidth(int newBlockCount)
+int CodeArea::lineHeight() const
 {
-	setViewportMargins(addressAreaWidth(), 0, 0, 0);
+	return fontMetrics().lineSpacing();
 }
 
-void CodeArea::updateAddressArea(const QRect &rect, int dy)
+// number of (possibly partially) visible rows
+int CodeArea::visibleRows() const
 {
-	if (dy)
-		addressArea->scroll(0, dy);
-	else
-		addressArea->update(0, rect.y(), addressArea->width(), rect.height());
+	return viewport()->height() / lineHeight() + 1;
+}
 
-	if (rect.contains(viewport()->rect()))
-		updateAddressAreaWidth(0);
+// row at viewport y-coordinate `y`, or -1
+int CodeArea::rowAt(int y) const
+{
+	int i = verticalScrollBar()->value() + y / lineHeight();
+	if (y < 0 || i >= nrRows)
+		return -1;
+	return i;
+}
 
+void CodeArea::updateScrollBars()
+{
+	int fullRows = viewport()->height() / lineHeight();
+	verticalScrollBar()->setRange(0, qMax(0, nrRows - fullRows));
+	verticalScrollBar()->setPageStep(fullRows);
+	verticalScrollBar()->setSingleStep(1);
+	horizontalScrollBar()->setRange(0, qMax(0, maxRowWidth - viewport()->width()));
+	horizontalScrollBar()->setPageStep(viewport()->width());
+	horizontalScrollBar()->setSingleStep(fontMetrics().horizontalAdvance(QLatin1Char('9')));
 }
 
 void CodeArea::resizeEvent(QResizeEvent *e)
 {
-	QPlainTextEdit::resizeEvent(e);
+	QAbstractScrollArea::resizeEvent(e);
 
 	QRect cr = contentsRect();
 	addressArea->setGeometry(QRect(cr.left(), cr.top(), addressAreaWidth(), cr.height()));
+	updateScrollBars();
 }
 
-void CodeArea::addressAreaPaintEvent(QPaintEvent *event)
+void CodeArea::scrollContentsBy(int dx, int dy)
 {
-	QPainter painter(addressArea);
-	painter.fillRect(event->rect(), Qt::lightGray);
+	viewport()->update();
+	if (dy)
+		addressArea->update();
+}
 
-	QTextBlock block = firstVisibleBlock();
-	int blockNumber = block.blockNumber();
-	int top = qRound(blockBoundingGeometry(block).translated(contentOffset()).top());
-	int bottom = top + qRound(blockBoundingRect(block).height());
-
-	while (block.isValid() && top <= event->rect().bottom()) {
-		if (block.isVisible() && bottom >= event->rect().top()) {
-			QString number;
-			if (blockNumber < instructions.size()) {
-				number = QString("%1").arg(
-						(long)instructions[blockNumber].address,
-						8, 16, (QChar)'0');
-			} else {
-				number = "";
-			}
-			painter.setPen(Qt::darkGray);
-			painter.drawText(0, top, addressArea->width() - H_PAD,
-					fontMetrics().height(), Qt::AlignRight, number);
-			if (blockNumber < instructions.size() && instructions[blockNumber].isBreakpoint) {
-				int size = bottom - top;
-				painter.drawPixmap(0, top, size, size, breakpointImage);
-			}
+// Get row `i`, rendering it if it isn't cached.
+const CodeArea::Row *CodeArea::row(int i)
+{
+	Row *r = rowCache->object(i);
+	if (r)
+		return r;
+
+	r = new Row(printer->print(fno, rows[i]));
+	rowCache->insert(i, r);
+	return r;
+}
+
+void CodeArea::paintEvent(QPaintEvent *event)
+{
+	QPainter painter(viewport());
+	painter.fillRect(event->rect(), palette().base());
+	if (!nrRows)
+		return;
+
+	int first = verticalScrollBar()->value();
+	int last = qMin(nrRows, first + visibleRows());
+	int height = lineHeight();
+	int x = -horizontalScrollBar()->value();
+	int width = viewport()->width();
+	int selFirst = qMin(selectionAnchor, selectionEnd);
+	int selLast = qMax(selectionAnchor, selectionEnd);
+	int maxWidth = maxRowWidth;
+
+	for (int i = first; i < last; i++) {
+		int y = (i - first) * height;
+		if (y > event->rect().bottom())
+			break;
+		if (y + height < event->rect().top())
+			continue;
+
+		if (selFirst >= 0 && i >= selFirst && i <= selLast) {
+			painter.fillRect(0, y, width, height, palette().highlight());
+		} else if (i == currentRow) {
+			painter.fillRect(0, y, width, height, QColor(Qt::yellow).lighter(160));
 		}
 
-		block = block.next();
-		top = bottom;
-		bottom = top + qRound(blockBoundingRect(block).height());
-		++blockNumber;
+		const Row *r = row(i);
+		QTextLayout layout(r->text, font());
+		layout.beginLayout();
+		QTextLine line = layout.createLine();
+		layout.endLayout();
+		line.setPosition(QPointF(0, 0));
+		layout.draw(&painter, QPointF(x, y), r->formats);
+		maxWidth = qMax(maxWidth, (int)line.naturalTextWidth() + H_PAD);
+	}
+
+	// the widest row is only known once it has been rendered, so the
+	// horizontal scroll range grows as rows come into view
+	if (maxWidth > maxRowWidth) {
+		maxRowWidth = maxWidth;
+		QMetaObject::invokeMethod(this, &CodeArea::updateScrollBars, Qt::QueuedConnection);
 	}
 }
 
-void CodeArea::addressAreaContextMenuEvent(QContextMenuEvent *event)
+void CodeArea::addressAreaPaintEvent(QPaintEvent *event)
 {
-	QTextBlock block = firstVisibleBlock();
-	int blockNumber = block.blockNumber();
-	int top = qRound(blockBoundingGeometry(block).translated(contentOffset()).top());
-	int bottom = top + qRound(blockBoundingRect(block).height());
-	int y = event->y();
+	QPainter painter(addressArea);
+	painter.fillRect(event->rect(), Qt::lightGray);
 
-	uint32_t addr = 0xFFFFFFFF;
-	while (block.isValid()) {
-		if (y >= top && y <= bottom) {
-			addr = instructions[blockNumber].address;
-			break;
+	int first = verticalScrollBar()->value();
+	int last = qMin(nrRows, first + visibleRows());
+	int height = lineHeight();
+	painter.setPen(Qt::darkGray);
+	for (int i = first; i < last; i++) {
+		int top = (i - first) * height;
+		QString number = QString("%1").arg((long)rows[i].address, 8, 16, (QChar)'0');
+		painter.drawText(0, top, addressArea->width() - H_PAD,
+				fontMetrics().height(), Qt::AlignRight, number);
+		if (Debugger::getInstance().isBreakpoint(rows[i].address)) {
+			painter.drawPixmap(0, top, height, height, breakpointImage);
 		}
-		block = block.next();
-		top = bottom;
-		bottom = top + qRound(blockBoundingRect(block).height());
-		++blockNumber;
 	}
+}
 
-	if (addr == 0xFFFFFFFF)
+void CodeArea::addressAreaContextMenuEvent(QContextMenuEvent *event)
+{
+	int i = rowAt(event->y());
+	if (i < 0)
 		return;
 
+	uint32_t addr = rows[i].address;
+
 	QMenu menu(addressArea);
 
 	QAction toggleBPAct(tr("&Toggle Breakpoint"));
@@ -177,204 +211,146 @@ void CodeArea::addressAreaContextMenuEvent(QContextMenuEvent *event)
 	menu.exec(event->globalPos());
 }
 
-void CodeArea::updateBreakpoints(QSet<uint32_t> &breakpoints)
+// Get the operand under viewport position `pos` (if any).
+bool CodeArea::operandAt(const QPoint &pos, InstructionPrinter::Operand *out)
 {
-	for (Instruction &instr : instructions) {
-		instr.isBreakpoint = breakpoints.contains(instr.address);
-	}
-	update();
-}
+	int i = rowAt(pos.y());
+	if (i < 0)
+		return false;
+	const Row *r = row(i);
+	if (r->operands.isEmpty())
+		return false;
 
-void CodeArea::toggleBreakpoint(uint32_t addr)
-{
-	Debugger::getInstance().toggleInstructionBreakpoint(addr);
-}
+	QTextLayout layout(r->text, font());
+	layout.beginLayout();
+	QTextLine line = layout.createLine();
+	layout.endLayout();
+	int x = pos.x() + horizontalScrollBar()->value();
+	if (x < 0 || x >= line.naturalTextWidth())
+		return false;
 
-static char escape_char(char c)
-{
-	switch (c) {
-	case '\\': return '\\';
-	case '\"': return '\"';
-	case '\n': return 'n';
-	case '\r': return 'r';
-	default:   return 0;
+	int col = line.xToCursor(x, QTextLine::CursorOnCharacter);
+	for (const InstructionPrinter::Operand &op : r->operands) {
+		if (col >= op.start && col < op.start + op.length) {
+			*out = op;
+			return true;
+		}
 	}
+	return false;
 }
 
-static QString escape_string(const char *str)
+void CodeArea::mousePressEvent(QMouseEvent *event)
 {
-	unsigned escapes = 0;
-
-	// count number of required escapes
-	for (int i = 0; str[i]; i++) {
-		if (str[i] & 0x80)
-			continue;
-		if (escape_char(str[i])) {
-			escapes++;
-			break;
-		}
-	}
+	if (event->button() != Qt::LeftButton)
+		return;
 
-	if (!escapes)
-		return strdup(str);
-
-	// add backslash escapes
-	int dst = 0;
-	char *out = (char*)xmalloc(strlen(str) + escapes + 1);
-	for (int i = 0; str[i]; i++) {
-		char c = escape_char(str[i]);
-		if (c) {
-			out[dst++] = '\\';
-			out[dst++] = c;
-		} else {
-			out[dst++] = str[i];
-		}
+	// follow jump targets
+	InstructionPrinter::Operand op;
+	if (!(event->modifiers() & Qt::ShiftModifier) && operandAt(event->pos(), &op)
+			&& op.type == T_ADDR) {
+		goToAddress(ain, op.value);
+		return;
 	}
-	out[dst] = '\0';
 
-	QString r = QString::fromUtf8(out);
-	free(out);
-	return r;
+	int i = rowAt(event->y());
+	if (i < 0)
+		return;
+	if (!(event->modifiers() & Qt::ShiftModifier) || selectionAnchor < 0)
+		selectionAnchor = i;
+	selectionEnd = i;
+	viewport()->update();
 }
 
-static QString string_literal(const char *str)
+void CodeArea::mouseMoveEvent(QMouseEvent *event)
 {
-	QString out = escape_string(str);
-	out.prepend("\"");
-	out.append("\"");
-	return out;
-}
+	if (!(event->buttons() & Qt::LeftButton)) {
+		InstructionPrinter::Operand op;
+		bool link = operandAt(event->pos(), &op) && op.type == T_ADDR;
+		viewport()->setCursor(link ? Qt::PointingHandCursor : Qt::IBeamCursor);
+		return;
+	}
+	if (selectionAnchor < 0)
+		return;
 
-static QString identifier(const char *str)
-{
-	if (strchr(str, ' '))
-		return escape_string(str);
-	return str;
+	// scroll when dragging past the edge of the viewport
+	if (event->y() < 0)
+		verticalScrollBar()->triggerAction(QAbstractSlider::SliderSingleStepSub);
+	else if (event->y() >= viewport()->height())
+		verticalScrollBar()->triggerAction(QAbstractSlider::SliderSingleStepAdd);
+
+	int i = rowAt(qBound(0, event->y(), viewport()->height() - 1));
+	selectionEnd = i < 0 ? nrRows - 1 : i;
+	viewport()->update();
 }
 
-static QString local_variable(struct ain *ain, struct ain_function *f, int32_t varno)
+void CodeArea::contextMenuEvent(QContextMenuEvent *event)
 {
-	int dup_no = 0; // nr of duplicate-named variables preceding varno
-	for (int i = 0; i < varno; i++) {
-		if (!strcmp(f->vars[i].name, f->vars[varno].name))
-			dup_no++;
-	}
+	if (!nrRows)
+		return;
 
-	// if variable name is ambiguous, add #n suffix
-	if (dup_no)
-		return QString("%1#%2").arg(f->vars[varno].name, dup_no);
-	return f->vars[varno].name;
-}
+	QMenu menu(this);
+
+	InstructionPrinter::Operand op;
+	XrefIndex::Target target;
+	if (operandAt(event->pos(), &op)
+			&& XrefIndex::targetOf(op.type, op.value, op.prev, &target)) {
+		const Row *r = row(rowAt(event->pos().y()));
+		QString name = r->text.mid(op.start, op.length);
+		if (name.size() > 40)
+			name = name.left(40) + "...";
+		menu.addAction(tr("Find References to %1").arg(name), this, [this, target] {
+			emit findReferences(target);
+		});
+	}
 
-static QString function_name(struct ain *ain, struct ain_function *func)
-{
-	int i = ain_get_function_index(ain, func);
-	if (!i)
-		return func->name;
+	XrefIndex::Target function = { XrefIndex::FUNCTION, fno, -1 };
+	menu.addAction(tr("Find Callers of This Function"), this, [this, function] {
+		emit findReferences(function);
+	});
 
-	QString out = QString::fromUtf8(func->name);
-	out.append(QString("#%1").arg(i));
-	return out;
+	menu.exec(event->globalPos());
 }
 
-static QString arg_to_string(struct ain *ain, int fno, int32_t arg, int argtype)
+void CodeArea::keyPressEvent(QKeyEvent *event)
 {
-	switch (argtype) {
-	case T_INT:
-	case T_SWITCH:
-		return QString::number((int)arg);
-	case T_FLOAT: {
-		union { int32_t i; float f; } cast = { .i = arg };
-		return QString::number(cast.f);
+	if (event == QKeySequence::Copy) {
+		copySelection();
+		return;
 	}
-	case T_ADDR:
-		return QString("0x%1").arg((long)arg, 8, 16, (QChar)'0');
-	case T_FUNC:
-		if (arg < 0 || arg >= ain->nr_functions)
-			return QString("<invalid function: %1>").arg(arg);
-		return function_name(ain, &ain->functions[arg]);
-	case T_DLG:
-		if (arg < 0 || arg >= ain->nr_delegates)
-			return QString("<invalid delegate: %1>").arg(arg);
-		return identifier(ain->delegates[arg].name);
-	case T_STRING:
-		if (arg < 0 || arg >= ain->nr_strings)
-			return QString("<invalid string: %1>").arg(arg);
-		return string_literal(ain->strings[arg]->text);
-	case T_MSG:
-		if (arg < 0 || arg >= ain->nr_messages)
-			return QString("<invalid message: %1>").arg(arg);
-		return string_literal(ain->messages[arg]->text);
-	case T_LOCAL:
-		if (arg < 0 || arg >= ain->functions[fno].nr_vars)
-			return QString("<invalid local: %1>").arg(arg);
-		return local_variable(ain, &ain->functions[fno], arg);
-	case T_GLOBAL:
-		if (arg < 0 || arg >= ain->nr_globals)
-			return QString("<invalid global: %1>").arg(arg);
-		return identifier(ain->globals[arg].name);
-	case T_STRUCT:
-		if (arg < 0 || arg >= ain->nr_structures)
-			return QString("<invalid struct: %1>").arg(arg);
-		return identifier(ain->structures[arg].name);
-	case T_SYSCALL:
-		if (arg < 0 || arg >= NR_SYSCALLS || !syscalls[arg].name)
-			return QString("<invalid/unknown syscall: %1>").arg(arg);
-		return syscalls[arg].name;
-	case T_HLL:
-		if (arg < 0 || arg >= ain->nr_libraries)
-			return QString("<invalid library: %1>").arg(arg);
-		return identifier(ain->libraries[arg].name);
-	case T_HLLFUNC:
-		return QString::number(arg);
-	case T_FILE:
-		if (!ain->nr_filenames)
-			return QString::number(arg);
-		if (arg < 0 || arg >= ain->nr_filenames)
-			return QString("<invalid file: %1>").arg(arg);
-		return string_literal(ain->filenames[arg]);
-	default:
-		return QString("<unknown arg type (%1): %2>").arg(argtype, arg);
+	if (event == QKeySequence::SelectAll) {
+		selectionAnchor = 0;
+		selectionEnd = nrRows - 1;
+		viewport()->update();
+		return;
 	}
+	QAbstractScrollArea::keyPressEvent(event);
 }
 
-static QString hll_function_name(struct ain *ain, int lib_no, int func_no)
+void CodeArea::copySelection()
 {
-	if (lib_no < 0 || lib_no >= ain->nr_libraries)
-		return QString::number(func_no);
-	if (func_no < 0 || func_no >= ain->libraries[lib_no].nr_functions)
-		return QString("<invalid library function: %1>").arg(func_no);
-
-	struct ain_library *lib = &ain->libraries[lib_no];
+	if (selectionAnchor < 0 || !nrRows)
+		return;
 
-	int dup_no = 0;
-	for (int i = 0;i < lib->nr_functions; i++) {
-		if (i == func_no)
-			break;
-		if (!strcmp(lib->functions[i].name, lib->functions[func_no].name))
-			dup_no++;
+	int first = qMin(selectionAnchor, selectionEnd);
+	int last = qMax(selectionAnchor, selectionEnd);
+	QString text;
+	for (int i = first; i <= last; i++) {
+		// bypass the row cache: a large selection would evict the visible rows
+		text += printer->toString(fno, rows[i]);
+		text += '\n';
 	}
+	QGuiApplication::clipboard()->setText(text);
+}
 
-	if (!dup_no)
-		return lib->functions[func_no].name;
-
-	QString out = QString::fromUtf8(lib->functions[func_no].name);
-	out.append(QString("#%1").arg(dup_no));
-	return out;
+void CodeArea::updateBreakpoints(QSet<uint32_t> &breakpoints)
+{
+	// breakpoints are looked up when painting
+	addressArea->update();
 }
 
-QString CodeArea::Instruction::toString(struct ain *ain, int fno)
+void CodeArea::toggleBreakpoint(uint32_t addr)
 {
-	QString str = instr->name;
-	for (int i = 0; i < instr->nr_args; i++) {
-		// XXX: special case: T_HLLFUNC is context-dependent
-		if (instr->args[i] == T_HLLFUNC && i > 0 && instr->args[i-1] == T_HLL) {
-			str += QString(".%1").arg(hll_function_name(ain, args[i-1], args[i]));
-			continue;
-		}
-		str += QString(" %1").arg(arg_to_string(ain, fno, args[i], instr->args[i]));
-	}
-	return str + "\n";
+	Debugger::getInstance().toggleInstructionBreakpoint(addr);
 }
 
 static bool dasm_finished(struct dasm *dasm)
@@ -382,91 +358,213 @@ static bool dasm_finished(struct dasm *dasm)
 	return dasm_eof(dasm) || dasm_opcode(dasm) == ENDFUNC || dasm_opcode(dasm) == FUNC;
 }
 
-void CodeArea::pushInstruction(struct dasm *dasm)
+void CodeArea::pushInstruction(QVector<Instruction> &out, struct dasm *dasm)
 {
-	uint32_t addr = dasm_addr(dasm);
 	Instruction instr = {
-		.address = addr,
-		.isBreakpoint = Debugger::getInstance().isBreakpoint(addr),
+		.address = dasm_addr(dasm),
 		.instr = dasm_instruction(dasm)
 	};
 	for (int i = 0; i < instr.instr->nr_args; i++) {
 		instr.args[i] = dasm_arg(dasm, i);
 	}
-	instructions.push_back(instr);
+	out.push_back(instr);
 }
 
-bool CodeArea::setFunction(struct ain *ain, int fno, int address)
+void CodeArea::clearCache()
 {
-	if (fno < 0 || fno >= ain->nr_functions)
-		return false;
+	cache.clear();
+	cacheAin = nullptr;
+}
 
-	struct ain_function *f = &ain->functions[fno];
+/*
+ * Create a cache entry for a function. Functions in the code index are
+ * displayed directly from the index; others are disassembled here.
+ */
+CodeArea::CachedFunction CodeArea::loadFunction(struct ain *ain, int fno)
+{
+	CachedFunction f = { fno, {}, QSharedPointer<QCache<int, Row>>::create(ROW_CACHE_SIZE) };
+	if (codeIndex && codeIndex->functionRange(fno).count > 0)
+		return f;
 
 	struct dasm dasm;
 	dasm_init(&dasm, ain);
-	dasm_jump(&dasm, f->address - 6);
+	dasm_jump(&dasm, ain->functions[fno].address - 6);
 
-	instructions.clear();
 	do {
-		pushInstruction(&dasm);
+		pushInstruction(f.decoded, &dasm);
 		dasm_next(&dasm);
 	} while (!dasm_finished(&dasm));
 
 	if (dasm_opcode(&dasm) == ENDFUNC) {
-		pushInstruction(&dasm);
+		pushInstruction(f.decoded, &dasm);
 	}
+	return f;
+}
 
-	int line = -1;
-	QString contents = "";
-	for (int i = 0; i < instructions.size(); i++) {
-		contents += instructions[i].toString(ain, fno);
-		if (instructions[i].address == (uint32_t)address) {
-			line = i;
-		}
-	}
+/*
+ * Display function `fno`. Returns false if there is no such function. The
+ * current instruction (currentAddress) is highlighted if it is in the
+ * function.
+ */
+bool CodeArea::showFunction(struct ain *ain, int fno)
+{
+	if (fno < 0 || fno >= ain->nr_functions)
+		return false;
 
-	setPlainText(contents);
+	if (ain != cacheAin) {
+		clearCache();
+		cacheAin = ain;
+	}
 
-	if (line >= 0) {
-		QTextEdit::ExtraSelection selection;
-		QColor lineColor = QColor(Qt::yellow).lighter(160);
-		selection.format.setBackground(lineColor);
-		selection.format.setProperty(QTextFormat::FullWidthSelection, true);
-		QTextCursor cursor(document()->findBlockByLineNumber(line));
-		selection.cursor = cursor;
-		selection.cursor.clearSelection();
+	// find function in cache, or load it
+	int i;
+	for (i = 0; i < cache.size(); i++) {
+		if (cache[i].fno == fno)
+			break;
+	}
+	if (i < cache.size())
+		cache.move(i, 0);
+	else
+		cache.prepend(loadFunction(ain, fno));
 
-		QList<QTextEdit::ExtraSelection> extraSelections { selection };
-		setExtraSelections(extraSelections);
+	// evict least recently used functions
+	while (cache.size() > CODE_CACHE_SIZE) {
+		cache.removeLast();
+	}
 
-		// scroll to instruction
-		setTextCursor(cursor);
+	const CachedFunction &f = cache[0];
+	bool changed = this->ain != ain || this->fno != fno;
+	this->ain = ain;
+	this->fno = fno;
+	rowCache = f.rows;
+	if (f.decoded.isEmpty()) {
+		CodeIndex::Range range = codeIndex->functionRange(fno);
+		rowsIndex = codeIndex;
+		rowsDecoded.clear();
+		rows = codeIndex->instructions().constData() + range.first;
+		nrRows = range.count;
 	} else {
-		QList<QTextEdit::ExtraSelection> extraSelections;
-		setExtraSelections(extraSelections);
+		rowsIndex.reset();
+		rowsDecoded = f.decoded;
+		rows = rowsDecoded.constData();
+		nrRows = rowsDecoded.size();
+	}
+
+	if (changed) {
+		selectionAnchor = -1;
+		selectionEnd = -1;
+		maxRowWidth = 0;
+		updateScrollBars();
+		verticalScrollBar()->setValue(0);
+		horizontalScrollBar()->setValue(0);
 	}
+	currentRow = rowForAddress(currentAddress);
+
+	viewport()->update();
+	addressArea->update();
 
 	emit functionChanged(fno);
 	return true;
 }
 
-bool CodeArea::setFunction(struct ain *ain, const char *name, int address)
+// Row of the instruction at `address` in the current function, or -1.
+int CodeArea::rowForAddress(uint32_t address) const
+{
+	// rows are in address order
+	const Instruction *end = rows + nrRows;
+	const Instruction *it = std::lower_bound(rows, end, address,
+			[](const Instruction &instr, uint32_t addr) {
+		return instr.address < addr;
+	});
+	if (it == end || it->address != address)
+		return -1;
+	return it - rows;
+}
+
+// Scroll row `i` to the middle of the view, unless it is already visible.
+void CodeArea::scrollToRow(int i)
+{
+	int first = verticalScrollBar()->value();
+	int fullRows = viewport()->height() / lineHeight();
+	if (i < first || i >= first + fullRows)
+		verticalScrollBar()->setValue(i - fullRows / 2);
+}
+
+bool CodeArea::setFunction(struct ain *ain, int fno, int address)
+{
+	currentAddress = address;
+	if (!showFunction(ain, fno))
+		return false;
+	if (currentRow >= 0)
+		scrollToRow(currentRow);
+	return true;
+}
+
+/*
+ * Open the function containing `address` and select the instruction there.
+ * Returns false if `address` isn't the address of an instruction.
+ */
+bool CodeArea::goToAddress(struct ain *ain, uint32_t address)
+{
+	int fno = -1;
+	if (codeIndex) {
+		fno = codeIndex->functionAt(address);
+	} else {
+		// not indexed yet: the closest function start at or before address
+		uint32_t best = 0;
+		for (int i = 0; i < ain->nr_functions; i++) {
+			uint32_t start = ain->functions[i].address;
+			if (start <= address && (fno < 0 || start > best)) {
+				fno = i;
+				best = start;
+			}
+		}
+	}
+	if (fno < 0 || !showFunction(ain, fno))
+		return false;
+
+	int i = rowForAddress(address);
+	if (i < 0)
+		return false;
+	selectionAnchor = i;
+	selectionEnd = i;
+	scrollToRow(i);
+	viewport()->update();
+	return true;
+}
+
+void CodeArea::setPrinter(QSharedPointer<const InstructionPrinter> p)
+{
+	printer = p;
+	clearCache();
+}
+
+void CodeArea::setCodeIndex(QSharedPointer<const CodeIndex> index)
+{
+	codeIndex = index;
+	// cached functions may refer to the old index (the displayed function
+	// keeps it alive through rowsIndex)
+	cache.clear();
+}
+
+bool CodeArea::setFunction(struct ain *ain, const QString &name, int address)
 {
-	char *tmp = strdup(name);
-	int fno = ain_get_function(ain, tmp);
-	free(tmp);
-	return setFunction(ain, fno, address);
+	// names in the ain are still SJIS; look the name up among decoded ones
+	return setFunction(ain, printer->symbolTable().functionNumber(name), address);
 }
 
 CodeViewer::CodeViewer(QWidget *parent)
 	: QSplitter(parent)
 {
 	codeArea = new CodeArea;
+	graphView = new ControlFlowView;
+	codeStack = new QStackedWidget;
 	frameSelector = new QComboBox;
 	stack = new QStackedWidget;
 
-	addWidget(codeArea);
+	codeStack->addWidget(codeArea);
+	codeStack->addWidget(graphView);
+	addWidget(codeStack);
 
 	QWidget *rightPane = new QWidget;
 	QVBoxLayout *layout = new QVBoxLayout(rightPane);
@@ -476,72 +574,197 @@ CodeViewer::CodeViewer(QWidget *parent)
 	addWidget(rightPane);
 
 	connect(codeArea, &CodeArea::functionChanged, this, &CodeViewer::functionChanged);
+	connect(codeArea, &CodeArea::findReferences, this, &CodeViewer::findReferences);
+	// the graph follows the listing (it is only built while visible)
+	connect(codeArea, &CodeArea::functionChanged, this, [this](int fno) {
+		graphView->showFunction(code, fno);
+	});
+	connect(graphView, &ControlFlowView::addressActivated, this, [this](uint32_t address) {
+		setGraphVisible(false);
+		codeArea->goToAddress(code, address);
+	});
 	connect(&Debugger::getInstance(), &Debugger::stackTraceReceived,
 			this, &CodeViewer::stackTraceReceived);
+	connect(&Debugger::getInstance(), &Debugger::stackFrameReceived,
+			this, &CodeViewer::stackFrameReceived);
 	connect(frameSelector, QOverload<int>::of(&QComboBox::activated),
 			this, &CodeViewer::stackFrameChanged);
 }
 
 CodeViewer::~CodeViewer()
 {
-	for (int i = 0; i < varModels.size(); i++) {
-		delete varModels[i];
+	for (FrameView &frame : frameViews) {
+		delete frame.model;
 	}
 }
 
-void CodeViewer::setAin(struct ain *a)
+void CodeViewer::setAin(struct ain *a, QSharedPointer<const InstructionPrinter> p)
 {
+	// drop the old index first, so nothing is built from a mix of the old
+	// and the new game
+	setCodeIndex(QSharedPointer<const CodeIndex>());
 	code = a;
+	printer = p;
+	codeArea->setPrinter(printer);
+	graphView->setPrinter(printer);
 
 	// create a dummy stack trace for initial state
 	QVector<Debugger::StackFrame> dummy(1);
 	dummy[0].name = "main";
 	dummy[0].id = 0;
 	dummy[0].address = a->functions[a->main].address;
+	dummy[0].loaded = true;
 	stackTraceReceived(dummy);
 }
 
-void CodeViewer::setFunction(const QString &name)
+void CodeViewer::setCodeIndex(QSharedPointer<const CodeIndex> index)
+{
+	codeIndex = index;
+	codeArea->setCodeIndex(index);
+	graphView->setCodeIndex(index);
+}
+
+bool CodeViewer::goToAddress(uint32_t address)
+{
+	if (!code || !codeArea->goToAddress(code, address))
+		return false;
+	graphView->scrollToAddress(address);
+	return true;
+}
+
+void CodeViewer::setGraphVisible(bool visible)
+{
+	if (visible == graphVisible())
+		return;
+	QWidget *w = visible ? (QWidget*)graphView : (QWidget*)codeArea;
+	codeStack->setCurrentWidget(w);
+	w->setFocus();
+	emit graphVisibleChanged(visible);
+}
+
+bool CodeViewer::graphVisible() const
+{
+	return codeStack->currentWidget() == graphView;
+}
+
+void CodeViewer::cancelGraph()
+{
+	graphView->cancelBuild();
+}
+
+void CodeViewer::showFunction(int fno)
 {
 	if (!code)
 		return;
-	codeArea->setFunction(code, name.toUtf8().constData(), 0);
+	codeArea->showFunction(code, fno);
+}
+
+// Frames are identified by their depth from the bottom of the stack and
+// function name, so a frame keeps its view while it stays on the stack.
+static QString frameKey(const QVector<Debugger::StackFrame> &frames, int i)
+{
+	return QString::number(frames.size() - i) + ":" + frames[i].name;
 }
 
 void CodeViewer::stackTraceReceived(QVector<Debugger::StackFrame> &frames)
 {
 	stackTrace = frames;
 
-	// delete widgets/models for old stack trace
-	frameSelector->clear();
-	while (stack->count() > 0) {
-		stack->removeWidget(stack->widget(0));
+	QHash<QString, int> oldFrames;
+	for (int i = 0; i < frameViews.size(); i++) {
+		oldFrames[frameViews[i].key] = i;
+	}
+
+	// reuse views of frames that are still on the stack; models are updated
+	// in place so that expansion and scroll state are preserved
+	QVector<FrameView> views(stackTrace.size());
+	for (int i = 0; i < stackTrace.size(); i++) {
+		const Debugger::StackFrame &frame = stackTrace[i];
+		FrameView &fv = views[i];
+		fv.key = frameKey(stackTrace, i);
+		if (oldFrames.contains(fv.key)) {
+			fv = frameViews[oldFrames.take(fv.key)];
+			if (frame.loaded)
+				fv.model->update(frame.scopes);
+		} else {
+			fv.view = new QTreeView;
+			fv.model = new VariablesModel(frame.scopes);
+			fv.view->setModel(fv.model);
+			watchPaging(fv.view, fv.model);
+		}
+		// frames other than the top frame are loaded on demand
+		fv.view->setEnabled(frame.loaded);
 	}
-	for (int i = 0; i < varModels.size(); i++) {
-		delete varModels[i];
+
+	// delete views for frames that were popped
+	for (int i : oldFrames) {
+		stack->removeWidget(frameViews[i].view);
+		delete frameViews[i].view;
+		delete frameViews[i].model;
 	}
-	varModels.clear();
 
-	// create widgets for new stack trace
-	for (Debugger::StackFrame &frame : stackTrace) {
+	while (stack->count() > 0) {
+		stack->removeWidget(stack->widget(0));
+	}
+	frameSelector->clear();
+	for (int i = 0; i < stackTrace.size(); i++) {
+		const Debugger::StackFrame &frame = stackTrace[i];
 		QString label = QString::number(frame.id) + ": " + frame.name
 			+ " @ " + QString::number(frame.address, 16);
 		frameSelector->addItem(label);
-
-		QTreeView *treeView = new QTreeView;
-		VariablesModel *model = new VariablesModel(frame.scopes);
-		varModels.push_back(model);
-		treeView->setModel(model);
-		stack->addWidget(treeView);
+		stack->addWidget(views[i].view);
 	}
+	frameViews = views;
 
 	// activate current function
 	frameSelector->setCurrentIndex(0);
 	stackFrameChanged(0);
 }
 
+// Page in array elements when the last loaded one comes into view.
+void CodeViewer::watchPaging(QTreeView *view, VariablesModel *model)
+{
+	auto check = [view, model] {
+		QModelIndex last = view->indexAt(QPoint(0, view->viewport()->height() - 1));
+		if (!last.isValid()) {
+			// the rows end above the bottom of the view
+			for (QModelIndex i = view->indexAt(QPoint(0, 0)); i.isValid();
+					i = view->indexBelow(i)) {
+				last = i;
+			}
+		}
+		model->fetchNextPage(last);
+	};
+	connect(view->verticalScrollBar(), &QScrollBar::valueChanged, view, check);
+	connect(view, &QTreeView::expanded, view, check, Qt::QueuedConnection);
+	// after the view has laid out the new rows
+	connect(model, &QAbstractItemModel::rowsInserted, view, check, Qt::QueuedConnection);
+}
+
 void CodeViewer::stackFrameChanged(int i)
 {
-	codeArea->setFunction(code, stackTrace[i].name.toUtf8().constData(), stackTrace[i].address);
+	// look up the function by address if possible (names may be ambiguous)
+	int fno = codeIndex ? codeIndex->functionAt(stackTrace[i].address) : -1;
+	graphView->setCurrentAddress(stackTrace[i].address);
+	if (fno >= 0)
+		codeArea->setFunction(code, fno, stackTrace[i].address);
+	else
+		codeArea->setFunction(code, stackTrace[i].name, stackTrace[i].address);
 	stack->setCurrentIndex(i);
+	// variables for frames other than the top frame are fetched on demand;
+	// the debugger is told about every switch, so that fetches for the
+	// frame being left are cancelled even if this one is already loaded
+	Debugger::getInstance().loadStackFrame(i);
+}
+
+void CodeViewer::stackFrameReceived(int i, const Debugger::StackFrame &frame)
+{
+	if (i >= stackTrace.size() || stackTrace[i].id != frame.id)
+		return;
+	// already shown (re-sent when switching back to a loaded frame)
+	if (stackTrace[i].loaded)
+		return;
+	stackTrace[i] = frame;
+	frameViews[i].model->update(frame.scopes);
+	frameViews[i].view->setEnabled(true);
 }
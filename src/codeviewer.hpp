@@ -17,30 +17,42 @@
 #ifndef XSYS4DBG_CODEVIEWER_HPP
 #define XSYS4DBG_CODEVIEWER_HPP
 
-#include <QPlainTextEdit>
+#include <QAbstractScrollArea>
+#include <QCache>
 #include <QSet>
+#include <QSharedPointer>
 #include <QSplitter>
 #include <QVector>
+#include "codeindex.hpp"
 #include "debugger.hpp"
+#include "instructionprinter.hpp"
 
 class QComboBox;
 class QContextMenuEvent;
+class QKeyEvent;
+class QMouseEvent;
 class QPaintEvent;
 class QResizeEvent;
 class QSize;
 class QStackedWidget;
+class QTreeView;
 class QWidget;
 
 struct ain;
 struct dasm;
-class SyntaxHighlighter;
+class ControlFlowView;
 class VariablesModel;
 
 extern "C" {
 #include "system4/instructions.h"
 }
 
-class CodeArea : public QPlainTextEdit
+/*
+ * Bytecode view. Only the visible rows are rendered: each row is
+ * stringified and highlighted when it first becomes visible (and cached),
+ * so showing a function takes the same time regardless of its length.
+ */
+class CodeArea : public QAbstractScrollArea
 {
 	Q_OBJECT
 public:
@@ -51,37 +63,81 @@ public:
 	int addressAreaWidth();
 
 	bool setFunction(struct ain *ain, int fno, int address);
-	bool setFunction(struct ain *ain, const char *name, int address);
+	bool setFunction(struct ain *ain, const QString &name, int address);
+	bool goToAddress(struct ain *ain, uint32_t address);
+	bool showFunction(struct ain *ain, int fno);
+	void setPrinter(QSharedPointer<const InstructionPrinter> printer);
+	void setCodeIndex(QSharedPointer<const CodeIndex> index);
 
 signals:
 	void functionChanged(int fno);
+	void findReferences(const XrefIndex::Target &target);
 
 protected:
-
+	void paintEvent(QPaintEvent *event) override;
 	void resizeEvent(QResizeEvent *event) override;
+	void scrollContentsBy(int dx, int dy) override;
+	void keyPressEvent(QKeyEvent *event) override;
+	void mousePressEvent(QMouseEvent *event) override;
+	void mouseMoveEvent(QMouseEvent *event) override;
+	void contextMenuEvent(QContextMenuEvent *event) override;
 
 private slots:
-	void updateAddressAreaWidth(int newBlockCount);
-	void updateAddressArea(const QRect &rect, int dy);
 	void updateBreakpoints(QSet<uint32_t> &breakpoints);
 	void toggleBreakpoint(uint32_t addr);
 
 private:
+	typedef CodeIndex::Instruction Instruction;
 
-	struct Instruction {
-		uint32_t address;
-		bool isBreakpoint;
-		const struct instruction *instr;
-		int32_t args[INSTRUCTION_MAX_ARGS];
-		QString toString(struct ain *ain, int fno);
-	};
+	typedef InstructionPrinter::Line Row;
 
-	void pushInstruction(struct dasm *dasm);
+	// rows of recently viewed functions are kept in an LRU cache so that
+	// switching back to a function doesn't re-render them
+	struct CachedFunction {
+		int fno;
+		// only used if the function isn't in the code index
+		QVector<Instruction> decoded;
+		QSharedPointer<QCache<int, Row>> rows;
+	};
 
-	QVector<Instruction> instructions;
+	void pushInstruction(QVector<Instruction> &out, struct dasm *dasm);
+	CachedFunction loadFunction(struct ain *ain, int fno);
+	int rowForAddress(uint32_t address) const;
+	void scrollToRow(int i);
+	bool operandAt(const QPoint &pos, InstructionPrinter::Operand *out);
+	void clearCache();
+	const Row *row(int i);
+	int lineHeight() const;
+	int visibleRows() const;
+	int rowAt(int y) const;
+	void updateScrollBars();
+	void copySelection();
+
+	QSharedPointer<const CodeIndex> codeIndex;
+	// renders rows for the current ain
+	QSharedPointer<const InstructionPrinter> printer;
+
+	// current function: instructions [rows, rows + nrRows) either point into
+	// the code index or into `decoded` of the current cache entry
+	struct ain *ain = nullptr;
+	int fno = -1;
+	const Instruction *rows = nullptr;
+	int nrRows = 0;
+	QSharedPointer<const CodeIndex> rowsIndex;
+	QVector<Instruction> rowsDecoded;
+	QSharedPointer<QCache<int, Row>> rowCache;
+	// current instruction of the selected stack frame
+	uint32_t currentAddress = 0;
+	int currentRow = -1;
+	int selectionAnchor = -1;
+	int selectionEnd = -1;
+	int maxRowWidth = 0;
+
+	// most recently used first
+	QList<CachedFunction> cache;
+	struct ain *cacheAin = nullptr;
 
 	QWidget *addressArea;
-	SyntaxHighlighter *highlighter;
 
 	QPixmap breakpointImage;
 };
@@ -119,21 +175,47 @@ public:
 	CodeViewer(QWidget *parent = nullptr);
 	~CodeViewer();
 
-	void setAin(struct ain *a);
-	void setFunction(const QString &name);
+	// `printer` must have been created for `a`
+	void setAin(struct ain *a, QSharedPointer<const InstructionPrinter> printer);
+	void setCodeIndex(QSharedPointer<const CodeIndex> index);
+	void showFunction(int fno);
+	bool goToAddress(uint32_t address);
+	// show the current function as a basic-block graph instead of a listing
+	void setGraphVisible(bool visible);
+	bool graphVisible() const;
+	// stop the graph worker (before the ain is freed)
+	void cancelGraph();
+	QSharedPointer<const InstructionPrinter> instructionPrinter() const { return printer; }
 
 signals:
 	void functionChanged(int fno);
+	void findReferences(const XrefIndex::Target &target);
+	void graphVisibleChanged(bool visible);
 
 private slots:
 	void stackTraceReceived(QVector<Debugger::StackFrame> &frames);
 	void stackFrameChanged(int index);
+	void stackFrameReceived(int index, const Debugger::StackFrame &frame);
 
 private:
+	// variables view for a stack frame; kept across stops while the frame
+	// is still on the stack
+	struct FrameView {
+		QString key;
+		QTreeView *view;
+		VariablesModel *model;
+	};
+
+	static void watchPaging(QTreeView *view, VariablesModel *model);
+
 	struct ain *code = NULL;
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
 	QVector<Debugger::StackFrame> stackTrace;
-	QVector<VariablesModel*> varModels;
+	QVector<FrameView> frameViews;
 	CodeArea *codeArea;
+	ControlFlowView *graphView;
+	QStackedWidget *codeStack;
 	QComboBox *frameSelector;
 	QStackedWidget *stack;
 };
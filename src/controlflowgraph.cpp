@@ -0,0 +1,499 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <QScopedPointer>
+#include <QtMath>
+
+#include "controlflowgraph.hpp"
+#include "instructionprinter.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+#include "system4/instructions.h"
+}
+
+// check for cancellation every this many steps
+#define CANCEL_CHECK_INTERVAL 4096
+
+// block padding, in characters/lines (a block is its header line plus one
+// line per instruction, padded on each side)
+#define BLOCK_H_PAD 1.0
+#define BLOCK_V_PAD 0.25
+// space between blocks in a layer, in characters
+#define BLOCK_GAP 4.0
+// space between layers, in lines (edges are routed through it)
+#define LAYER_GAP 3.0
+// number of lanes to the right of the graph used by back edges
+#define BACK_EDGE_LANES 8
+
+typedef CodeIndex::Instruction Instruction;
+
+namespace {
+
+struct Jump {
+	int32_t address;
+	ControlFlowGraph::EdgeKind kind;
+};
+
+}
+
+// Index of the instruction at `address`, or -1 if it isn't in the function.
+static int instruction_index(const Instruction *instrs, int count, int32_t address)
+{
+	const Instruction *end = instrs + count;
+	const Instruction *it = std::lower_bound(instrs, end, (uint32_t)address,
+			[](const Instruction &instr, uint32_t addr) {
+		return instr.address < addr;
+	});
+	if (it == end || it->address != (uint32_t)address)
+		return -1;
+	return it - instrs;
+}
+
+// Instructions that never continue with the next instruction.
+static bool is_terminator(int opcode)
+{
+	switch (opcode) {
+	case JUMP:
+	case RETURN:
+	case SJUMP:
+	case ENDFUNC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Jump targets of `instr`. Returns true if the instruction can also fall
+ * through to the next instruction.
+ */
+static bool jump_targets(struct ain *ain, const Instruction &instr, QVector<Jump> &out)
+{
+	const struct instruction *info = instr.instr;
+	bool fallthrough = !is_terminator(info->opcode);
+	for (int a = 0; a < info->nr_args; a++) {
+		if (info->args[a] == T_ADDR) {
+			ControlFlowGraph::EdgeKind kind = info->opcode == JUMP
+				? ControlFlowGraph::JUMP : ControlFlowGraph::BRANCH;
+			out.append({ instr.args[a], kind });
+		} else if (info->args[a] == T_SWITCH) {
+			int no = instr.args[a];
+			if (no < 0 || no >= ain->nr_switches)
+				continue;
+			const struct ain_switch *sw = &ain->switches[no];
+			for (int c = 0; c < sw->nr_cases; c++) {
+				out.append({ sw->cases[c].address, ControlFlowGraph::SWITCH_CASE });
+			}
+			// without a default case, the switch falls through
+			if (sw->default_address >= 0) {
+				out.append({ sw->default_address, ControlFlowGraph::JUMP });
+				fallthrough = false;
+			}
+		}
+	}
+	return fallthrough;
+}
+
+bool ControlFlowGraph::findBlocks(struct ain *ain, const Instruction *instrs, int count,
+		const std::atomic<bool> *cancel)
+{
+	if (count == 0)
+		return true;
+
+	// a block starts at the first instruction, at every jump target and
+	// after every jump
+	QVector<bool> leader(count + 1, false);
+	QVector<Jump> jumps;
+	leader[0] = true;
+	for (int i = 0; i < count; i++) {
+		jumps.clear();
+		bool fallthrough = jump_targets(ain, instrs[i], jumps);
+		if (!jumps.isEmpty() || !fallthrough)
+			leader[i+1] = true;
+		for (const Jump &j : jumps) {
+			int target = instruction_index(instrs, count, j.address);
+			if (target >= 0)
+				leader[target] = true;
+		}
+		if (cancel && i % CANCEL_CHECK_INTERVAL == 0 && *cancel)
+			return false;
+	}
+
+	QVector<int> blockOf(count);
+	for (int i = 0; i < count; i++) {
+		if (leader[i])
+			blockList.append({ i, 0, 0, QRectF() });
+		blockList.last().count++;
+		blockOf[i] = blockList.size() - 1;
+	}
+
+	// edges, from the last instruction of each block
+	for (int b = 0; b < blockList.size(); b++) {
+		const Block &block = blockList[b];
+		int last = block.first + block.count - 1;
+		jumps.clear();
+		bool fallthrough = jump_targets(ain, instrs[last], jumps);
+		int nrEdges = edgeList.size();
+		for (const Jump &j : jumps) {
+			int target = instruction_index(instrs, count, j.address);
+			if (target < 0)
+				continue;
+			// several cases may share a target; keep the first edge
+			bool duplicate = false;
+			for (int e = nrEdges; e < edgeList.size(); e++) {
+				if (edgeList[e].to == blockOf[target])
+					duplicate = true;
+			}
+			if (!duplicate)
+				edgeList.append({ b, blockOf[target], j.kind, false, {}, QRectF() });
+		}
+		if (fallthrough && last + 1 < count)
+			edgeList.append({ b, b + 1, FALLTHROUGH, false, {}, QRectF() });
+	}
+	return true;
+}
+
+/*
+ * Mark back edges and assign each block to a layer: the length of the
+ * longest path to it over the remaining (acyclic) edges.
+ */
+bool ControlFlowGraph::assignLayers(const std::atomic<bool> *cancel)
+{
+	int nrBlocks = blockList.size();
+
+	// outgoing edges of each block: [outOffsets[b], outOffsets[b+1]) of outEdges
+	QVector<int> outOffsets(nrBlocks + 1, 0);
+	QVector<int> outEdges(edgeList.size());
+	for (const Edge &e : edgeList) {
+		outOffsets[e.from + 1]++;
+	}
+	for (int b = 0; b < nrBlocks; b++) {
+		outOffsets[b+1] += outOffsets[b];
+	}
+	QVector<int> fill = outOffsets;
+	for (int e = 0; e < edgeList.size(); e++) {
+		outEdges[fill[edgeList[e].from]++] = e;
+	}
+
+	// iterative DFS; an edge to a block on the stack is a back edge
+	enum { WHITE, GRAY, BLACK };
+	QVector<char> color(nrBlocks, WHITE);
+	QVector<QPair<int,int>> stack; // (block, next outgoing edge)
+	int steps = 0;
+	for (int root = 0; root < nrBlocks; root++) {
+		if (color[root] != WHITE)
+			continue;
+		color[root] = GRAY;
+		stack.append({ root, outOffsets[root] });
+		while (!stack.isEmpty()) {
+			if (cancel && ++steps % CANCEL_CHECK_INTERVAL == 0 && *cancel)
+				return false;
+			int b = stack.last().first;
+			int &next = stack.last().second;
+			if (next == outOffsets[b+1]) {
+				color[b] = BLACK;
+				stack.removeLast();
+				continue;
+			}
+			Edge &e = edgeList[outEdges[next++]];
+			if (color[e.to] == GRAY) {
+				e.back = true;
+			} else if (color[e.to] == WHITE) {
+				color[e.to] = GRAY;
+				stack.append({ e.to, outOffsets[e.to] });
+			}
+		}
+	}
+
+	// longest path layering in topological order (Kahn)
+	QVector<int> inDegree(nrBlocks, 0);
+	for (const Edge &e : edgeList) {
+		if (!e.back)
+			inDegree[e.to]++;
+	}
+	QVector<int> queue;
+	queue.reserve(nrBlocks);
+	for (int b = 0; b < nrBlocks; b++) {
+		if (inDegree[b] == 0)
+			queue.append(b);
+	}
+	for (int q = 0; q < queue.size(); q++) {
+		int b = queue[q];
+		for (int i = outOffsets[b]; i < outOffsets[b+1]; i++) {
+			const Edge &e = edgeList[outEdges[i]];
+			if (e.back)
+				continue;
+			blockList[e.to].layer = qMax(blockList[e.to].layer, blockList[b].layer + 1);
+			if (--inDegree[e.to] == 0)
+				queue.append(e.to);
+		}
+	}
+	return true;
+}
+
+/*
+ * Order the blocks within each layer and assign coordinates. Blocks are
+ * ordered by the barycenter of their predecessors (one downward sweep) and
+ * then placed under their predecessors where there is room, so that chains
+ * of blocks form straight columns.
+ */
+void ControlFlowGraph::place(const QVector<int> &widths)
+{
+	int nrBlocks = blockList.size();
+	int nrLayers = 0;
+	for (const Block &b : blockList) {
+		nrLayers = qMax(nrLayers, b.layer + 1);
+	}
+
+	// blocks of each layer, initially in address order
+	layerOffsets.fill(0, nrLayers + 1);
+	for (const Block &b : blockList) {
+		layerOffsets[b.layer + 1]++;
+	}
+	for (int l = 0; l < nrLayers; l++) {
+		layerOffsets[l+1] += layerOffsets[l];
+	}
+	layerBlocks.resize(nrBlocks);
+	QVector<int> fill = layerOffsets;
+	for (int b = 0; b < nrBlocks; b++) {
+		layerBlocks[fill[blockList[b].layer]++] = b;
+	}
+
+	// forward predecessors of each block
+	QVector<int> inOffsets(nrBlocks + 1, 0);
+	for (const Edge &e : edgeList) {
+		if (!e.back)
+			inOffsets[e.to + 1]++;
+	}
+	for (int b = 0; b < nrBlocks; b++) {
+		inOffsets[b+1] += inOffsets[b];
+	}
+	QVector<int> preds(inOffsets[nrBlocks]);
+	fill = inOffsets;
+	for (const Edge &e : edgeList) {
+		if (!e.back)
+			preds[fill[e.to]++] = e.from;
+	}
+
+	QVector<qreal> key(nrBlocks);
+	QVector<int> position(nrBlocks);
+	qreal y = 0;
+	layerTop.resize(nrLayers);
+	layerBottom.resize(nrLayers);
+	for (int l = 0; l < nrLayers; l++) {
+		int *begin = layerBlocks.data() + layerOffsets[l];
+		int *end = layerBlocks.data() + layerOffsets[l+1];
+
+		// order by barycenter of the predecessors' positions
+		for (int *b = begin; b != end; b++) {
+			int n = inOffsets[*b+1] - inOffsets[*b];
+			if (n == 0) {
+				key[*b] = b - begin;
+				continue;
+			}
+			qreal sum = 0;
+			for (int i = inOffsets[*b]; i < inOffsets[*b+1]; i++) {
+				sum += position[preds[i]];
+			}
+			key[*b] = sum / n;
+		}
+		std::stable_sort(begin, end, [&key](int a, int b) {
+			return key[a] < key[b];
+		});
+
+		// place left to right, under the predecessors if possible
+		qreal cursor = -1e9;
+		qreal height = 0;
+		for (int *b = begin; b != end; b++) {
+			Block &block = blockList[*b];
+			qreal w = widths[*b] + 2 * BLOCK_H_PAD;
+			qreal h = block.count + 1 + 2 * BLOCK_V_PAD;
+			qreal x = cursor;
+			int n = inOffsets[*b+1] - inOffsets[*b];
+			if (n > 0) {
+				qreal sum = 0;
+				for (int i = inOffsets[*b]; i < inOffsets[*b+1]; i++) {
+					sum += blockList[preds[i]].rect.center().x();
+				}
+				x = qMax(cursor, sum / n - w / 2);
+			} else if (b == begin) {
+				x = 0;
+			}
+			block.rect = QRectF(x, y, w, h);
+			position[*b] = b - begin;
+			cursor = x + w + BLOCK_GAP;
+			height = qMax(height, h);
+		}
+		layerTop[l] = y;
+		layerBottom[l] = y + height;
+		y += height + LAYER_GAP;
+	}
+
+	// move the leftmost block to x = 0
+	qreal minX = 0;
+	for (const Block &b : blockList) {
+		minX = qMin(minX, b.rect.left());
+	}
+	for (Block &b : blockList) {
+		b.rect.translate(-minX, 0);
+	}
+}
+
+/*
+ * Route edges as orthogonal polylines. Forward edges leave the bottom of
+ * their source and turn in the gap below its layer; back edges run up a
+ * lane to the right of the blocks they span.
+ */
+void ControlFlowGraph::route()
+{
+	int nrBlocks = blockList.size();
+
+	// spread the ends of the edges of each block along its bottom/top
+	QVector<int> nrOut(nrBlocks, 0), nrIn(nrBlocks, 0);
+	QVector<int> outIndex(edgeList.size()), inIndex(edgeList.size());
+	for (int e = 0; e < edgeList.size(); e++) {
+		outIndex[e] = nrOut[edgeList[e].from]++;
+		inIndex[e] = nrIn[edgeList[e].to]++;
+	}
+
+	// right edge of each layer
+	QVector<qreal> layerRight(layerTop.size(), 0);
+	qreal right = 0;
+	for (const Block &b : blockList) {
+		layerRight[b.layer] = qMax(layerRight[b.layer], b.rect.right());
+		right = qMax(right, b.rect.right());
+	}
+
+	int nrBack = 0;
+	for (int i = 0; i < edgeList.size(); i++) {
+		Edge &e = edgeList[i];
+		const Block &from = blockList[e.from];
+		const Block &to = blockList[e.to];
+		qreal outFrac = (outIndex[i] + 1.0) / (nrOut[e.from] + 1);
+		qreal inFrac = (inIndex[i] + 1.0) / (nrIn[e.to] + 1);
+		QPointF start(from.rect.left() + from.rect.width() * outFrac, from.rect.bottom());
+		QPointF end(to.rect.left() + to.rect.width() * inFrac, to.rect.top());
+		qreal outY = layerBottom[from.layer] + LAYER_GAP * outFrac;
+
+		e.points.clear();
+		e.points.append(start);
+		e.points.append(QPointF(start.x(), outY));
+		if (!e.back) {
+			e.points.append(QPointF(end.x(), outY));
+		} else {
+			qreal lane = 0;
+			for (int l = to.layer; l <= from.layer; l++) {
+				lane = qMax(lane, layerRight[l]);
+			}
+			lane += BLOCK_GAP / 2 + (nrBack++ % BACK_EDGE_LANES);
+			qreal inY = layerTop[to.layer] - LAYER_GAP * inFrac;
+			e.points.append(QPointF(lane, outY));
+			e.points.append(QPointF(lane, inY));
+			e.points.append(QPointF(end.x(), inY));
+			right = qMax(right, lane);
+		}
+		e.points.append(end);
+
+		qreal x0 = e.points[0].x(), x1 = x0, y0 = e.points[0].y(), y1 = y0;
+		for (const QPointF &p : e.points) {
+			x0 = qMin(x0, p.x());
+			x1 = qMax(x1, p.x());
+			y0 = qMin(y0, p.y());
+			y1 = qMax(y1, p.y());
+		}
+		e.bounds = QRectF(QPointF(x0, y0), QPointF(x1, y1));
+	}
+
+	qreal bottom = layerBottom.isEmpty() ? 0 : layerBottom.last();
+	sceneSize = QSizeF(right + BLOCK_GAP, bottom + LAYER_GAP);
+}
+
+ControlFlowGraph *ControlFlowGraph::build(struct ain *ain, const CodeIndex &index, int fno,
+		const InstructionPrinter &printer, const std::atomic<bool> *cancel)
+{
+	CodeIndex::Range range = index.functionRange(fno);
+	const Instruction *instrs = index.instructions().constData() + range.first;
+
+	QScopedPointer<ControlFlowGraph> g(new ControlFlowGraph);
+	if (!g->findBlocks(ain, instrs, range.count, cancel))
+		return nullptr;
+	if (!g->assignLayers(cancel))
+		return nullptr;
+
+	// block widths in characters: the widest instruction, or the header
+	QVector<int> widths(g->blockList.size());
+	for (int b = 0; b < g->blockList.size(); b++) {
+		const Block &block = g->blockList[b];
+		int width = 8;
+		for (int i = block.first; i < block.first + block.count; i++) {
+			width = qMax(width, printer.toString(fno, instrs[i]).size());
+		}
+		widths[b] = width;
+		if (cancel && *cancel)
+			return nullptr;
+	}
+
+	g->place(widths);
+	g->route();
+	return g.take();
+}
+
+QPointF ControlFlowGraph::linePosition(const Block &block, int line)
+{
+	return QPointF(block.rect.left() + BLOCK_H_PAD, block.rect.top() + BLOCK_V_PAD + line);
+}
+
+int ControlFlowGraph::lineAt(const Block &block, qreal y)
+{
+	return qFloor(y - block.rect.top() - BLOCK_V_PAD);
+}
+
+int ControlFlowGraph::blockAt(int i) const
+{
+	auto it = std::upper_bound(blockList.begin(), blockList.end(), i,
+			[](int i, const Block &b) {
+		return i < b.first;
+	});
+	if (it == blockList.begin())
+		return -1;
+	--it;
+	if (i >= it->first + it->count)
+		return -1;
+	return it - blockList.begin();
+}
+
+QVector<int> ControlFlowGraph::blocksIn(const QRectF &rect) const
+{
+	QVector<int> result;
+	// layers are ordered by y, and the blocks of a layer by x
+	int l = std::upper_bound(layerBottom.begin(), layerBottom.end(), rect.top())
+		- layerBottom.begin();
+	for (; l < layerTop.size() && layerTop[l] < rect.bottom(); l++) {
+		const int *begin = layerBlocks.constData() + layerOffsets[l];
+		const int *end = layerBlocks.constData() + layerOffsets[l+1];
+		const int *b = std::upper_bound(begin, end, rect.left(),
+				[this](qreal x, int b) {
+			return x < blockList[b].rect.right();
+		});
+		for (; b != end && blockList[*b].rect.left() < rect.right(); b++) {
+			if (blockList[*b].rect.intersects(rect))
+				result.append(*b);
+		}
+	}
+	return result;
+}
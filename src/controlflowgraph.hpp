@@ -0,0 +1,107 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_CONTROL_FLOW_GRAPH_HPP
+#define XSYS4DBG_CONTROL_FLOW_GRAPH_HPP
+
+#include <atomic>
+#include <QPointF>
+#include <QRectF>
+#include <QSizeF>
+#include <QVector>
+#include "codeindex.hpp"
+
+struct ain;
+class InstructionPrinter;
+
+/*
+ * Basic-block graph of a single function, with a layered layout. Blocks are
+ * split at jump targets and switch cases; back edges (loops) are found by
+ * DFS and ignored when assigning layers, so the rest of the graph flows top
+ * to bottom.
+ *
+ * Geometry is in text cells: x in characters, y in lines. The view scales it
+ * by the font metrics, so building the graph doesn't need a font and can run
+ * off the GUI thread.
+ */
+class ControlFlowGraph
+{
+public:
+	enum EdgeKind {
+		FALLTHROUGH,
+		JUMP,        // unconditional jump
+		BRANCH,      // conditional jump, taken
+		SWITCH_CASE,
+	};
+
+	struct Block {
+		// instructions [first, first + count) of the function
+		int first;
+		int count;
+		int layer;
+		QRectF rect;
+	};
+
+	struct Edge {
+		int from;
+		int to;
+		EdgeKind kind;
+		bool back;
+		QVector<QPointF> points;
+		QRectF bounds;
+	};
+
+	// Build the graph of function `fno`. Returns nullptr if cancelled.
+	static ControlFlowGraph *build(struct ain *ain, const CodeIndex &index, int fno,
+			const InstructionPrinter &printer, const std::atomic<bool> *cancel = nullptr);
+
+	// top left of line `line` of a block: line 0 is the header (the block's
+	// address), line k + 1 is instruction first + k
+	static QPointF linePosition(const Block &block, int line);
+	// line of a block at y-coordinate `y`
+	static int lineAt(const Block &block, qreal y);
+
+	// blocks are in address order
+	const QVector<Block> &blocks() const { return blockList; }
+	const QVector<Edge> &edges() const { return edgeList; }
+	QSizeF size() const { return sceneSize; }
+	// the block containing instruction `i` of the function, or -1
+	int blockAt(int i) const;
+	// blocks intersecting `rect`
+	QVector<int> blocksIn(const QRectF &rect) const;
+
+private:
+	ControlFlowGraph() = default;
+
+	bool findBlocks(struct ain *ain, const CodeIndex::Instruction *instrs, int count,
+			const std::atomic<bool> *cancel);
+	bool assignLayers(const std::atomic<bool> *cancel);
+	void place(const QVector<int> &widths);
+	void route();
+
+	QVector<Block> blockList;
+	QVector<Edge> edgeList;
+	QSizeF sceneSize;
+
+	// blocks of each layer, ordered by x: [layerOffsets[l], layerOffsets[l+1])
+	// of layerBlocks
+	QVector<int> layerOffsets;
+	QVector<int> layerBlocks;
+	QVector<qreal> layerTop;
+	QVector<qreal> layerBottom;
+};
+
+#endif
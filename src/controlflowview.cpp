@@ -0,0 +1,436 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <QtWidgets>
+
+#include "controlflowview.hpp"
+
+// margin around the graph, in pixels
+#define MARGIN 20
+// number of functions whose graphs are kept in memory
+#define GRAPH_CACHE_SIZE 16
+// number of rendered rows kept for the current function
+#define ROW_CACHE_SIZE 4096
+// size of arrow heads, in pixels
+#define ARROW_SIZE 4
+
+ControlFlowView::ControlFlowView(QWidget *parent)
+	: QAbstractScrollArea(parent), graphCache(GRAPH_CACHE_SIZE), rowCache(ROW_CACHE_SIZE)
+{
+	QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+	font.setFixedPitch(true);
+	font.setPointSize(10);
+	setFont(font);
+
+	viewport()->setCursor(Qt::OpenHandCursor);
+	setFocusPolicy(Qt::StrongFocus);
+}
+
+ControlFlowView::~ControlFlowView()
+{
+	cancelBuild();
+}
+
+qreal ControlFlowView::charWidth() const
+{
+	return fontMetrics().horizontalAdvance(QLatin1Char('9'));
+}
+
+int ControlFlowView::lineHeight() const
+{
+	return fontMetrics().lineSpacing();
+}
+
+// Viewport position to graph coordinates (characters/lines).
+QPointF ControlFlowView::toScene(const QPoint &pos) const
+{
+	qreal x = pos.x() + horizontalScrollBar()->value() - MARGIN;
+	qreal y = pos.y() + verticalScrollBar()->value() - MARGIN;
+	return QPointF(x / charWidth(), y / lineHeight());
+}
+
+void ControlFlowView::updateScrollBars()
+{
+	QSize size(0, 0);
+	if (graph) {
+		size.setWidth(qCeil(graph->size().width() * charWidth()) + 2 * MARGIN);
+		size.setHeight(qCeil(graph->size().height() * lineHeight()) + 2 * MARGIN);
+	}
+	QSize view = viewport()->size();
+	horizontalScrollBar()->setRange(0, qMax(0, size.width() - view.width()));
+	horizontalScrollBar()->setPageStep(view.width());
+	horizontalScrollBar()->setSingleStep(qCeil(charWidth()) * 4);
+	verticalScrollBar()->setRange(0, qMax(0, size.height() - view.height()));
+	verticalScrollBar()->setPageStep(view.height());
+	verticalScrollBar()->setSingleStep(lineHeight() * 3);
+}
+
+void ControlFlowView::resizeEvent(QResizeEvent *e)
+{
+	QAbstractScrollArea::resizeEvent(e);
+	updateScrollBars();
+}
+
+void ControlFlowView::showEvent(QShowEvent *e)
+{
+	QAbstractScrollArea::showEvent(e);
+	requestGraph();
+}
+
+// Get row `i` of the current function, rendering it if it isn't cached.
+const ControlFlowView::Row *ControlFlowView::row(int i)
+{
+	Row *r = rowCache.object(i);
+	if (r)
+		return r;
+
+	r = new Row(printer->print(graphFno, instrs[i]));
+	rowCache.insert(i, r);
+	return r;
+}
+
+static QColor edge_color(const ControlFlowGraph::Edge &e)
+{
+	switch (e.kind) {
+	case ControlFlowGraph::BRANCH:      return QColor(0, 140, 0);
+	case ControlFlowGraph::SWITCH_CASE: return QColor(140, 0, 140);
+	case ControlFlowGraph::JUMP:        return QColor(0, 0, 200);
+	case ControlFlowGraph::FALLTHROUGH: break;
+	}
+	return QColor(200, 0, 0);
+}
+
+void ControlFlowView::paintEvent(QPaintEvent *event)
+{
+	QPainter painter(viewport());
+	painter.fillRect(event->rect(), palette().window());
+
+	if (!graph) {
+		QString message;
+		if (fno >= 0 && !codeIndex)
+			message = tr("Waiting for the code index...");
+		else if (building >= 0)
+			message = tr("Building graph...");
+		painter.drawText(viewport()->rect(), Qt::AlignCenter, message);
+		return;
+	}
+
+	qreal cw = charWidth();
+	int lh = lineHeight();
+	auto scale = [cw, lh](const QPointF &p) {
+		return QPointF(p.x() * cw, p.y() * lh);
+	};
+	QRectF visible(toScene(event->rect().topLeft()),
+			toScene(event->rect().bottomRight() + QPoint(1, 1)));
+	painter.translate(MARGIN - horizontalScrollBar()->value(),
+			MARGIN - verticalScrollBar()->value());
+
+	// edges
+	for (const ControlFlowGraph::Edge &e : graph->edges()) {
+		if (!e.bounds.adjusted(-1, -1, 1, 1).intersects(visible))
+			continue;
+		QPolygonF line;
+		for (const QPointF &p : e.points) {
+			line << scale(p);
+		}
+		QPen pen(edge_color(e));
+		if (e.back)
+			pen.setStyle(Qt::DashLine);
+		painter.setPen(pen);
+		painter.drawPolyline(line);
+
+		QPointF tip = line.last();
+		QPolygonF arrow;
+		arrow << tip << tip + QPointF(-ARROW_SIZE, -ARROW_SIZE * 2)
+			<< tip + QPointF(ARROW_SIZE, -ARROW_SIZE * 2);
+		painter.setPen(Qt::NoPen);
+		painter.setBrush(edge_color(e));
+		painter.drawPolygon(arrow);
+		painter.setBrush(Qt::NoBrush);
+	}
+
+	// blocks
+	for (int b : graph->blocksIn(visible)) {
+		const ControlFlowGraph::Block &block = graph->blocks()[b];
+		QRectF rect(scale(block.rect.topLeft()), scale(block.rect.bottomRight()));
+		painter.setPen(palette().color(QPalette::Mid));
+		painter.setBrush(b == currentBlock ? QBrush(QColor(Qt::yellow).lighter(160))
+				: palette().base());
+		painter.drawRect(rect);
+		painter.setBrush(Qt::NoBrush);
+
+		QPointF header = scale(ControlFlowGraph::linePosition(block, 0));
+		painter.setPen(Qt::darkGray);
+		painter.drawText(QRectF(header, QSizeF(rect.width(), lh)), Qt::AlignLeft,
+				QString("%1").arg((long)instrs[block.first].address, 8, 16, (QChar)'0'));
+
+		// only the rows in view
+		int first = qMax(0, ControlFlowGraph::lineAt(block, visible.top()) - 1);
+		int last = qMin(block.count, ControlFlowGraph::lineAt(block, visible.bottom()));
+		for (int k = first; k < last; k++) {
+			const Row *r = row(block.first + k);
+			QTextLayout layout(r->text, font());
+			layout.beginLayout();
+			QTextLine line = layout.createLine();
+			layout.endLayout();
+			line.setPosition(QPointF(0, 0));
+			layout.draw(&painter, scale(ControlFlowGraph::linePosition(block, k + 1)),
+					r->formats);
+		}
+	}
+}
+
+void ControlFlowView::mousePressEvent(QMouseEvent *event)
+{
+	if (event->button() != Qt::LeftButton)
+		return;
+	dragging = true;
+	dragStart = event->pos();
+	dragScroll = QPoint(horizontalScrollBar()->value(), verticalScrollBar()->value());
+	viewport()->setCursor(Qt::ClosedHandCursor);
+}
+
+void ControlFlowView::mouseMoveEvent(QMouseEvent *event)
+{
+	if (!dragging)
+		return;
+	QPoint delta = event->pos() - dragStart;
+	horizontalScrollBar()->setValue(dragScroll.x() - delta.x());
+	verticalScrollBar()->setValue(dragScroll.y() - delta.y());
+}
+
+void ControlFlowView::mouseReleaseEvent(QMouseEvent *event)
+{
+	if (event->button() != Qt::LeftButton)
+		return;
+	dragging = false;
+	viewport()->setCursor(Qt::OpenHandCursor);
+}
+
+void ControlFlowView::mouseDoubleClickEvent(QMouseEvent *event)
+{
+	int i;
+	if (event->button() == Qt::LeftButton && instructionAt(event->pos(), &i))
+		emit addressActivated(instrs[i].address);
+}
+
+// Index of the instruction at `address` in the current function, or -1.
+int ControlFlowView::instructionIndex(uint32_t address) const
+{
+	const CodeIndex::Instruction *end = instrs + nrInstrs;
+	const CodeIndex::Instruction *it = std::lower_bound(instrs, end, address,
+			[](const CodeIndex::Instruction &instr, uint32_t addr) {
+		return instr.address < addr;
+	});
+	if (it == end || it->address != address)
+		return -1;
+	return it - instrs;
+}
+
+// Instruction at viewport position `pos`.
+bool ControlFlowView::instructionAt(const QPoint &pos, int *out) const
+{
+	if (!graph)
+		return false;
+	QPointF p = toScene(pos);
+	for (int b : graph->blocksIn(QRectF(p, QSizeF(0.01, 0.01)))) {
+		const ControlFlowGraph::Block &block = graph->blocks()[b];
+		int line = ControlFlowGraph::lineAt(block, p.y());
+		if (line < 1 || line > block.count)
+			continue;
+		*out = block.first + line - 1;
+		return true;
+	}
+	return false;
+}
+
+// Scroll instruction `instr` to the center of the view.
+void ControlFlowView::centerOn(int instr)
+{
+	int b = graph->blockAt(instr);
+	if (b < 0)
+		return;
+	const ControlFlowGraph::Block &block = graph->blocks()[b];
+	QPointF p = ControlFlowGraph::linePosition(block, instr - block.first + 1);
+	qreal x = block.rect.center().x() * charWidth() + MARGIN;
+	qreal y = p.y() * lineHeight() + MARGIN;
+	horizontalScrollBar()->setValue(x - viewport()->width() / 2);
+	verticalScrollBar()->setValue(y - viewport()->height() / 2);
+}
+
+// Scroll to the top of the graph, centered on the entry block.
+void ControlFlowView::showEntry()
+{
+	if (graph->blocks().isEmpty())
+		return;
+	qreal x = graph->blocks()[0].rect.center().x() * charWidth() + MARGIN;
+	horizontalScrollBar()->setValue(x - viewport()->width() / 2);
+	verticalScrollBar()->setValue(0);
+}
+
+void ControlFlowView::setGraph(QSharedPointer<const ControlFlowGraph> g)
+{
+	bool changed = graphFno != fno || graphIndex != codeIndex;
+	graph = g;
+	graphFno = g ? fno : -1;
+	graphIndex = g ? codeIndex : QSharedPointer<const CodeIndex>();
+	if (g) {
+		CodeIndex::Range range = graphIndex->functionRange(fno);
+		instrs = graphIndex->instructions().constData() + range.first;
+		nrInstrs = range.count;
+	} else {
+		instrs = nullptr;
+		nrInstrs = 0;
+	}
+	if (changed)
+		rowCache.clear();
+	updateScrollBars();
+
+	int current = instructionIndex(currentAddress);
+	currentBlock = g && current >= 0 ? g->blockAt(current) : -1;
+	if (g && changed) {
+		int pending = pendingAddress >= 0 ? instructionIndex(pendingAddress) : -1;
+		if (pending >= 0)
+			centerOn(pending);
+		else if (current >= 0)
+			centerOn(current);
+		else
+			showEntry();
+		pendingAddress = -1;
+	}
+	viewport()->update();
+}
+
+void ControlFlowView::cancelBuild()
+{
+	if (!thread)
+		return;
+	cancelled = true;
+	thread->wait();
+	delete thread;
+	thread = nullptr;
+	generation++;
+	building = -1;
+}
+
+// Show the graph of the current function, building it if necessary.
+void ControlFlowView::requestGraph()
+{
+	if (!isVisible() || !ain || fno < 0 || !printer)
+		return;
+	if (graph && graphFno == fno && graphIndex == codeIndex)
+		return;
+	if (!codeIndex) {
+		setGraph(QSharedPointer<const ControlFlowGraph>());
+		return;
+	}
+	QSharedPointer<const ControlFlowGraph> *cached = graphCache.object(fno);
+	if (cached) {
+		setGraph(*cached);
+		return;
+	}
+	if (building == fno)
+		return;
+
+	cancelBuild();
+	cancelled = false;
+	building = fno;
+	setGraph(QSharedPointer<const ControlFlowGraph>());
+
+	int gen = ++generation;
+	struct ain *a = ain;
+	int f = fno;
+	QSharedPointer<const CodeIndex> index = codeIndex;
+	QSharedPointer<const InstructionPrinter> p = printer;
+	thread = QThread::create([this, a, f, index, p, gen] {
+		ControlFlowGraph *g = ControlFlowGraph::build(a, *index, f, *p, &cancelled);
+		if (!g)
+			return;
+		QSharedPointer<const ControlFlowGraph> ptr(g);
+		QMetaObject::invokeMethod(this, [this, f, index, ptr, gen] {
+			// the function or index changed in the meantime
+			if (gen != generation)
+				return;
+			building = -1;
+			graphCache.insert(f, new QSharedPointer<const ControlFlowGraph>(ptr));
+			if (f == fno && index == codeIndex)
+				setGraph(ptr);
+		}, Qt::QueuedConnection);
+	});
+	thread->start(QThread::LowPriority);
+}
+
+void ControlFlowView::showFunction(struct ain *a, int f)
+{
+	if (a == ain && f == fno)
+		return;
+	if (a != ain)
+		clearCache();
+	ain = a;
+	fno = f;
+	requestGraph();
+}
+
+void ControlFlowView::setCurrentAddress(uint32_t address)
+{
+	currentAddress = address;
+	if (!graph)
+		return;
+	int i = instructionIndex(address);
+	currentBlock = i >= 0 ? graph->blockAt(i) : -1;
+	viewport()->update();
+	if (i < 0)
+		return;
+
+	// only scroll if the instruction is out of view
+	const ControlFlowGraph::Block &block = graph->blocks()[currentBlock];
+	QPointF p = ControlFlowGraph::linePosition(block, i - block.first + 1);
+	QRectF visible(toScene(QPoint(0, 0)), toScene(viewport()->rect().bottomRight()));
+	if (!visible.contains(p))
+		centerOn(i);
+}
+
+void ControlFlowView::scrollToAddress(uint32_t address)
+{
+	int i = graph && graphFno == fno ? instructionIndex(address) : -1;
+	if (i >= 0)
+		centerOn(i);
+	else
+		pendingAddress = address;
+}
+
+void ControlFlowView::clearCache()
+{
+	cancelBuild();
+	graphCache.clear();
+	setGraph(QSharedPointer<const ControlFlowGraph>());
+}
+
+void ControlFlowView::setPrinter(QSharedPointer<const InstructionPrinter> p)
+{
+	// block widths depend on the printed text; the graph is requested
+	// again once the function of the new ain is shown
+	printer = p;
+	clearCache();
+}
+
+void ControlFlowView::setCodeIndex(QSharedPointer<const CodeIndex> index)
+{
+	codeIndex = index;
+	clearCache();
+	requestGraph();
+}
@@ -0,0 +1,116 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_CONTROL_FLOW_VIEW_HPP
+#define XSYS4DBG_CONTROL_FLOW_VIEW_HPP
+
+#include <atomic>
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QSharedPointer>
+#include "codeindex.hpp"
+#include "controlflowgraph.hpp"
+#include "instructionprinter.hpp"
+
+class QThread;
+
+/*
+ * Basic-block graph of the current function. Graphs are built and laid out
+ * on a worker thread when the view is shown (not when the function
+ * changes), and cached per function. Painting only touches the blocks and
+ * edges that intersect the viewport, and only the rows of visible blocks
+ * are rendered.
+ */
+class ControlFlowView : public QAbstractScrollArea
+{
+	Q_OBJECT
+public:
+	ControlFlowView(QWidget *parent = nullptr);
+	~ControlFlowView();
+
+	void showFunction(struct ain *ain, int fno);
+	// highlight the block containing the current instruction
+	void setCurrentAddress(uint32_t address);
+	// center the block containing `address` (once the graph is built)
+	void scrollToAddress(uint32_t address);
+	void setPrinter(QSharedPointer<const InstructionPrinter> printer);
+	void setCodeIndex(QSharedPointer<const CodeIndex> index);
+	// Stop building a graph and wait for the worker (before the ain is
+	// freed).
+	void cancelBuild();
+
+signals:
+	// an instruction was double clicked
+	void addressActivated(uint32_t address);
+
+protected:
+	void paintEvent(QPaintEvent *event) override;
+	void resizeEvent(QResizeEvent *event) override;
+	void showEvent(QShowEvent *event) override;
+	void mousePressEvent(QMouseEvent *event) override;
+	void mouseMoveEvent(QMouseEvent *event) override;
+	void mouseReleaseEvent(QMouseEvent *event) override;
+	void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+	typedef InstructionPrinter::Line Row;
+
+	void requestGraph();
+	void setGraph(QSharedPointer<const ControlFlowGraph> graph);
+	void clearCache();
+	const Row *row(int i);
+	int instructionIndex(uint32_t address) const;
+	bool instructionAt(const QPoint &pos, int *out) const;
+	void centerOn(int instr);
+	void showEntry();
+	void updateScrollBars();
+	qreal charWidth() const;
+	int lineHeight() const;
+	QPointF toScene(const QPoint &pos) const;
+
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
+	struct ain *ain = nullptr;
+	int fno = -1;
+
+	// graph of the current function, if built; instructions
+	// [instrs, instrs + nrInstrs) point into graphIndex
+	QSharedPointer<const ControlFlowGraph> graph;
+	int graphFno = -1;
+	QSharedPointer<const CodeIndex> graphIndex;
+	const CodeIndex::Instruction *instrs = nullptr;
+	int nrInstrs = 0;
+	QCache<int, QSharedPointer<const ControlFlowGraph>> graphCache;
+	// rendered rows of the current function
+	QCache<int, Row> rowCache;
+
+	uint32_t currentAddress = 0;
+	int currentBlock = -1;
+	// address to center on once the graph is built, if >= 0
+	int64_t pendingAddress = -1;
+
+	QPoint dragStart;
+	QPoint dragScroll;
+	bool dragging = false;
+
+	QThread *thread = nullptr;
+	std::atomic<bool> cancelled { false };
+	int generation = 0;
+	// function being built, or -1
+	int building = -1;
+};
+
+#endif
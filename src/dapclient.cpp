@@ -14,27 +14,80 @@
  * along with this program; if not, see <http://gnu.org/licenses/>.
  */
 
-#include <QImage>
-#include <QPixmap>
 #include <QJsonArray>
-#include <QJsonDocument>
 #include <QJsonObject>
-#include <QProcess>
+#include <QStringList>
 #include <QDebug>
 
 #include "dapclient.hpp"
 
 DAPClient::DAPClient()
 {
+	qRegisterMetaType<QVector<StackFrame>>();
+	qRegisterMetaType<QVector<Scope>>();
+	qRegisterMetaType<QVector<Variable>>();
+	qRegisterMetaType<QVector<FrameSnapshot>>();
+	qRegisterMetaType<QVector<uint32_t>>();
+	qRegisterMetaType<QVector<SceneEntity>>();
+
+	connection = new DAPConnection;
+	connection->moveToThread(&ioThread);
+	connect(&ioThread, &QThread::finished, connection, &QObject::deleteLater);
+
+	// state transitions
+	connect(connection, &DAPConnection::started, this, [this]{
+		state = DS_INITIALIZING;
+	});
+	connect(connection, &DAPConnection::failedToStart, this, [this]{
+		state = DS_NOT_STARTED;
+	});
+	connect(connection, &DAPConnection::initialized, this, [this]{
+		state = DS_CONFIGURING;
+		emit initialized();
+	});
+	connect(connection, &DAPConnection::launched, this, [this]{
+		state = DS_RUNNING;
+		emit launched();
+	});
+	connect(connection, &DAPConnection::continued, this, [this]{
+		state = DS_RUNNING;
+		emit continued();
+	});
+	connect(connection, &DAPConnection::paused, this, [this](const QString &message){
+		state = DS_PAUSED;
+		emit paused(message);
+	});
+	connect(connection, &DAPConnection::terminated, this, [this]{
+		state = DS_NOT_STARTED;
+		emit terminated();
+	});
+
+	// decoded results are forwarded as-is
+	connect(connection, &DAPConnection::terminateFinished, this, &DAPClient::terminateFinished);
+	connect(connection, &DAPConnection::outputReceived, this, &DAPClient::outputReceived);
+	connect(connection, &DAPConnection::stackTraceReceived, this, &DAPClient::stackTraceReceived);
+	connect(connection, &DAPConnection::scopesReceived, this, &DAPClient::scopesReceived);
+	connect(connection, &DAPConnection::variablesReceived, this, &DAPClient::variablesReceived);
+	connect(connection, &DAPConnection::stackSnapshotReceived, this, &DAPClient::stackSnapshotReceived);
+	connect(connection, &DAPConnection::breakpointsReceived, this, &DAPClient::breakpointsReceived);
+	connect(connection, &DAPConnection::sceneReceived, this, &DAPClient::sceneReceived);
+	connect(connection, &DAPConnection::renderEntityReceived, this, &DAPClient::renderEntityReceived);
+	connect(connection, &DAPConnection::renderPartsReceived, this, &DAPClient::renderPartsReceived);
+	connect(connection, &DAPConnection::errorOccurred, this, &DAPClient::errorOccurred);
+
+	ioThread.setObjectName("DAP I/O");
+	ioThread.start();
 }
 
 DAPClient::~DAPClient()
 {
+	ioThread.quit();
+	ioThread.wait();
 }
 
 bool DAPClient::connected()
 {
-	return process && process->state() != QProcess::NotRunning;
+	return connection->running();
 }
 
 void DAPClient::initialize(const QString &program, const QStringList &arguments,
@@ -44,37 +97,10 @@ void DAPClient::initialize(const QString &program, const QStringList &arguments,
 		qDebug() << "unexpected debugger state at initialization:" << state;
 		state = DS_NOT_STARTED;
 	}
-	if (process) {
-		if (process->state() != QProcess::NotRunning)
-			qDebug() << "killing running process";
-		delete process;
-	}
-	process = new QProcess(this);
-	process->setWorkingDirectory(workingDirectory);
-	process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
-	connect(process, &QProcess::readyReadStandardOutput, this, &DAPClient::readInput);
-	connect(process, &QProcess::started, [this]{
-		QJsonObject args = { { "adapterId", "xsystem4" } };
-		sendRequest("initialize", args);
-		state = DS_INITIALIZING;
-	});
-	connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-			[this](int exitCode, QProcess::ExitStatus exitStatus) {
-		if (exitStatus == QProcess::CrashExit) {
-			// XXX: we don't emit terminateFinished here to prevent infinite
-			//      crash-restart loop
-			// TODO: should be some way to reinitialize manually in case of crash
-			emit errorOccurred("xsystem4 process crashed");
-		} else {
-			emit terminateFinished();
-		}
-	});
-	connect(process, &QProcess::errorOccurred, [this](QProcess::ProcessError error) {
-		if (error == QProcess::FailedToStart)
-			state = DS_NOT_STARTED;
-		qDebug() << "error occurred:" << error;
-	});
-	process->start(program, arguments);
+	// blocking so that connected() is accurate as soon as we return
+	DAPConnection *conn = connection;
+	QMetaObject::invokeMethod(conn, [=]{ conn->start(program, arguments, workingDirectory); },
+			Qt::BlockingQueuedConnection);
 }
 
 void DAPClient::launch()
@@ -96,20 +122,17 @@ void DAPClient::pause()
 void DAPClient::terminate()
 {
 	sendRequest("disconnect");
-	process->closeWriteChannel();
+	DAPConnection *conn = connection;
+	QMetaObject::invokeMethod(conn, [conn]{ conn->closeWriteChannel(); },
+			Qt::QueuedConnection);
 	// FIXME: handle unresponsive xsystem4 process
 }
 
 void DAPClient::kill(int msec)
 {
-	if (!process)
-		return;
-
-	sendRequest("disconnect");
-	process->closeWriteChannel();
-	if (!process->waitForFinished(msec)) {
-		process->kill();
-	}
+	DAPConnection *conn = connection;
+	QMetaObject::invokeMethod(conn, [conn, msec]{ conn->kill(msec); },
+			Qt::BlockingQueuedConnection);
 }
 
 void DAPClient::next()
@@ -148,6 +171,43 @@ int DAPClient::requestVariables(int variablesReference)
 	return sendRequest("variables", args);
 }
 
+// Request a subset of a variable's children. `filter` is "indexed", "named"
+// or empty (all children); start/count select a page of the indexed children.
+int DAPClient::requestVariables(int variablesReference, const QString &filter, int start,
+		int count)
+{
+	QJsonObject args { { "variablesReference", variablesReference } };
+	if (!filter.isEmpty())
+		args["filter"] = filter;
+	if (count > 0) {
+		args["start"] = start;
+		args["count"] = count;
+	}
+	return sendRequest("variables", args);
+}
+
+// Frames, scopes and top-level variables in a single round trip. Only valid
+// if the adapter advertises xsystem4.supportsStackSnapshot. If variableFrames
+// is non-negative, scopes are only included for that many frames (starting
+// from the top); the rest must be fetched with requestScopes.
+int DAPClient::requestStackSnapshot(int variableFrames)
+{
+	QJsonObject args { { "threadId", 0 } };
+	if (variableFrames >= 0)
+		args["variableFrames"] = variableFrames;
+	return sendRequest("xsystem4.stackSnapshot", args);
+}
+
+// Ask the adapter to abandon an outstanding request. No-op if the adapter
+// doesn't support cancellation (the response will simply be ignored).
+void DAPClient::cancel(int reqId)
+{
+	if (!connection->supportsCancelRequest())
+		return;
+	QJsonObject args { { "requestId", reqId } };
+	sendRequest("cancel", args);
+}
+
 int DAPClient::setInstructionBreakpoints(QSet<uint32_t> locations)
 {
 	QJsonArray breakpoints;
@@ -164,258 +224,60 @@ int DAPClient::requestScene()
 	return sendRequest("xsystem4.scene");
 }
 
+/*
+ * Ask for pixel data to be delivered through shared memory when the adapter
+ * supports it. The adapter is free to ignore this and send base64 anyway;
+ * parseTexture handles both.
+ */
+void DAPClient::addTextureTransport(QJsonObject &args)
+{
+	if (connection->supportsSharedMemoryTextures())
+		args["textureTransport"] = "shm";
+}
+
 int DAPClient::requestRenderEntity(int entityId)
 {
 	QJsonObject args { { "entityId", entityId } };
+	addTextureTransport(args);
 	return sendRequest("xsystem4.renderEntity", args);
 }
 
 int DAPClient::requestRenderParts(int partsId)
 {
 	QJsonObject args = { { "partsId", partsId } };
+	addTextureTransport(args);
 	return sendRequest("xsystem4.renderParts", args);
 }
 
-void DAPClient::handleEvent(QJsonObject &event)
-{
-	QString evtype = event["event"].toString();
-	if (evtype == "output") {
-		QJsonObject body = event["body"].toObject();
-		QString category = body["category"].toString();
-		QString output = body["output"].toString();
-		emit outputReceived(category, output);
-	} else if (evtype == "initialized") {
-		state = DS_CONFIGURING;
-		emit initialized();
-	} else if (evtype == "stopped") {
-		state = DS_PAUSED;
-		QJsonObject body = event["body"].toObject();
-		QString message = body["description"].toString();
-		emit paused(message);
-	} else if (evtype == "terminated") {
-		state = DS_NOT_STARTED;
-		process->closeWriteChannel();
-		emit terminated();
-	} else {
-		qDebug() << "Unhandled event type: " << evtype;
-	}
-}
-
-void DAPClient::handleResponse(QJsonObject &response)
-{
-	if (!response["success"].toBool()) {
-		qDebug() << response["command"].toString() << " request failed!";
-		return;
-	}
-
-	int reqId = response["request_seq"].toInt();
-	QString cmd = response["command"].toString();
-	if (cmd == "launch") {
-		state = DS_RUNNING;
-		emit launched();
-	} else if (cmd == "continue") {
-		state = DS_RUNNING;
-		emit continued();
-	} else if (cmd == "stackTrace") {
-		QJsonArray jsonFrames = response["body"].toObject()["stackFrames"].toArray();
-		if (jsonFrames.size() == 0) {
-			qDebug() << "stackTrace returned 0 frames";
-		}
-		QVector<StackFrame> frames(jsonFrames.size());
-		for (int i = 0; i < jsonFrames.size(); i++) {
-			QJsonObject frame = jsonFrames[i].toObject();
-			QString ipStr = frame["instructionPointerReference"].toString();
-			frames[i] = {
-				.id = frame["id"].toInt(),
-				.name = frame["name"].toString(),
-				.address = ipStr.toInt(nullptr, 16)
-			};
-		}
-		emit stackTraceReceived(reqId, frames);
-	} else if (cmd == "scopes") {
-		QJsonArray jsonScopes = response["body"].toObject()["scopes"].toArray();
-		if (jsonScopes.size() == 0) {
-			qDebug() << "scopes returned 0 scopes";
-		}
-
-		QVector<Scope> scopes(jsonScopes.size());
-		for (int i = 0; i < jsonScopes.size(); i++) {
-			QJsonObject scope = jsonScopes[i].toObject();
-			scopes[i] = {
-				.name = scope["name"].toString(),
-				.presentationHint = scope["presentationHint"].toString(),
-				.variablesReference = scope["variablesReference"].toInt()
-			};
-		}
-		emit scopesReceived(reqId, scopes);
-	} else if (cmd == "variables") {
-		QJsonArray jsonVars = response["body"].toObject()["variables"].toArray();
-		QVector<Variable> vars(jsonVars.size());
-		for (int i = 0; i < jsonVars.size(); i++) {
-			QJsonObject var = jsonVars[i].toObject();
-			vars[i] = {
-				.name = var["name"].toString(),
-				.value = var["value"].toString(),
-				.type = var["type"].toString()
-			};
-		}
-		emit variablesReceived(reqId, vars);
-	} else if (cmd == "setInstructionBreakpoints") {
-		QJsonArray jBreakpoints = response["body"].toObject()["breakpoints"].toArray();
-		QVector<uint32_t> breakpoints;
-		for (int i = 0; i < jBreakpoints.size(); i++) {
-			QJsonObject obj = jBreakpoints[i].toObject();
-			if (!obj["verified"].toBool()) {
-				qDebug() << "breakpoint not verified";
-				continue;
-			}
-			QString addrStr = obj["instructionReference"].toString();
-			breakpoints.push_back(addrStr.toULong(nullptr, 16));
-		}
-		emit breakpointsReceived(reqId, breakpoints);
-	} else if (cmd == "xsystem4.scene") {
-		QJsonArray jEntities = response["body"].toObject()["entities"].toArray();
-		QVector<SceneEntity> entities;
-		for (const QJsonValue &val : jEntities) {
-			entities.append(SceneEntity(val));
-		}
-		emit sceneReceived(reqId, entities);
-	} else if (cmd == "xsystem4.renderEntity") {
-		QJsonObject body = response["body"].toObject();
-		int entityId = body["entityId"].toInt();
-		QJsonObject texture = body["texture"].toObject();
-		int width = texture["width"].toInt();
-		int height = texture["height"].toInt();
-		QByteArray b64 = texture["pixels"].toString().toLatin1();
-		QByteArray pixels = QByteArray::fromBase64(b64, QByteArray::Base64Encoding);
-		if (pixels.size() < width * height * 4) {
-			qDebug() << "pixel data truncated?";
-		} else {
-			QImage image((uchar*)pixels.data(), width, height, width * 4,
-					QImage::Format_RGBA8888);
-			QPixmap pixmap = QPixmap::fromImage(image);
-			emit renderEntityReceived(reqId, entityId, pixmap);
-		}
-	} else if (cmd == "xsystem4.renderParts") {
-		QJsonObject body = response["body"].toObject();
-		int partsNo = body["partsId"].toInt();
-		QPixmap pixmap = parseTexture(body["texture"]);
-		if (pixmap.isNull()) {
-			qDebug() << "failed to parse texture object";
-		} else {
-			emit renderPartsReceived(reqId, partsNo, pixmap);
-		}
-	}
-}
-
-void DAPClient::error(const QString &message)
-{
-	qDebug() << "DAP error:" << message;
-	emit errorOccurred(message);
-}
-
-void DAPClient::handleMessage(const char *msg)
-{
-	QJsonDocument json = QJsonDocument::fromJson(msg);
-	if (!json.isObject()) {
-		error("message is not a JSON object");
-		return;
-	}
-
-	QJsonObject obj = json.object();
-	QString t = obj["type"].toString();
-	if (t == "event")
-		handleEvent(obj);
-	else if (t == "response")
-		handleResponse(obj);
-	else {
-		// ?
-	}
-}
-
-void DAPClient::readInput()
-{
-	while (true) {
-		if (readState == READING_HEADERS) {
-			char header[512];
-			qint64 nr_read = process->readLine(header, 512);
-			// full line is not available
-			if (!nr_read)
-				return;
-			// handle read error
-			if (nr_read < 0 || header[nr_read - 1] != '\n') {
-				error("read error");
-				return;
-			}
-			// read header
-			if (sscanf(header, "Content-Length: %d", &contentLength) == 1) {
-				if (contentLength < 1) {
-					error("invalid value for Content-Length");
-					return;
-				}
-				content = (char*)malloc(contentLength + 1);
-				contentRead = 0;
-			} else if ((header[0] == '\r' && header[1] == '\n') || header[0] == '\n') {
-				// reached end of headers without Content-Length
-				if (!content) {
-					error("missing value for Content-Length");
-					return;
-				}
-				readState = READING_CONTENT;
-			} else {
-				error(QString("unknown header: ") + header);
-			}
-		} else if (readState == READING_CONTENT) {
-			qint64 nr_read = process->read(content + contentRead, contentLength - contentRead);
-			if (!nr_read)
-				return;
-			if (nr_read < 1) {
-				error("read error");
-				return;
-			}
-			contentRead += nr_read;
-			if (contentRead == contentLength) {
-				content[contentLength] = '\0';
-				handleMessage(content);
-				free(content);
-				content = nullptr;
-				contentLength = -1;
-				contentRead = 0;
-				readState = READING_HEADERS;
-			}
-		}
-	}
-}
-
 int DAPClient::sendRequest(const QString &command)
 {
 	QJsonObject req {
 		{ "type", "request" },
 		{ "command", command }
 	};
-	return sendJson(req);
+	return post(req);
 }
 
-int DAPClient::sendRequest(const QString &command, QJsonObject &args)
+int DAPClient::sendRequest(const QString &command, const QJsonObject &args)
 {
 	QJsonObject req {
 		{ "type", "request" },
 		{ "command", command },
 		{ "arguments", args }
 	};
-	return sendJson(req);
+	return post(req);
 }
 
-int DAPClient::sendJson(QJsonObject &obj)
+// Hand a request to the I/O thread. The sequence number is allocated here so
+// that it can be returned to the caller immediately.
+int DAPClient::post(const QJsonObject &req)
 {
-	static int seq = 1;
+	int seq = connection->nextSeq();
+	QJsonObject obj = req;
 	obj["seq"] = seq;
 
-	QJsonDocument doc(obj);
-	QByteArray bytes = doc.toJson();
-	int len = bytes.size();
-
-	process->write(QString("Content-Length: %1\r\n\r\n").arg(len).toUtf8());
-	process->write(bytes);
-	return seq++;
+	DAPConnection *conn = connection;
+	QMetaObject::invokeMethod(conn, [conn, obj]{ conn->send(obj); },
+			Qt::QueuedConnection);
+	return seq;
 }
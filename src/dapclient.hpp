@@ -19,16 +19,22 @@
 
 #include <QObject>
 #include <QSet>
+#include <QThread>
 #include <QVariant>
 #include <QVector>
 #include <QString>
+#include "dapconnection.hpp"
 #include "xsystem4.hpp"
 
 class QStringList;
-class QProcess;
 class QJsonObject;
-class QPixmap;
+class QImage;
 
+/*
+ * Debug adapter client. The public interface is used from the GUI thread;
+ * all I/O and message decoding happens on a dedicated thread (see
+ * DAPConnection), and only decoded results are delivered back here.
+ */
 class DAPClient : public QObject
 {
 	Q_OBJECT
@@ -44,30 +50,24 @@ public:
 	int requestStackTrace();
 	int requestScopes(int frameId);
 	int requestVariables(int variablesReference);
+	int requestVariables(int variablesReference, const QString &filter, int start, int count);
+	int requestStackSnapshot(int variableFrames = -1);
+	void cancel(int reqId);
+	bool supportsStackSnapshot() const { return connection->supportsStackSnapshot(); }
 	int setInstructionBreakpoints(QSet<uint32_t> locations);
 	int requestScene();
 	int requestRenderEntity(int entityId);
 	int requestSpriteTexture(int spriteId);
 	int requestRenderParts(int partsId);
 
-	struct StackFrame {
-		int id;
-		QString name;
-		int address;
-	};
+	typedef DAPConnection::StackFrame StackFrame;
+	typedef DAPConnection::Scope Scope;
+	typedef DAPConnection::Variable Variable;
+	typedef DAPConnection::FrameSnapshot FrameSnapshot;
+	typedef DAPConnection::Stats Stats;
 
-	struct Scope {
-		QString name;
-		QString presentationHint;
-		int variablesReference;
-	};
-
-	struct Variable {
-		QString name;
-		QString value;
-		QString type;
-		int variablesReference;
-	};
+	Stats stats() const { return connection->stats(); }
+	void resetStats() { connection->resetStats(); }
 
 public slots:
 	void launch();
@@ -84,35 +84,25 @@ signals:
 	void terminated();
 	void terminateFinished();
 	void outputReceived(const QString &category, const QString &message);
-	void stackTraceReceived(int reqId, QVector<StackFrame> &frames);
-	void scopesReceived(int reqId, QVector<Scope> &scopes);
-	void variablesReceived(int reqId, QVector<Variable> &variables);
-	void breakpointsReceived(int reqId, QVector<uint32_t> &breakpoints);
+	void stackTraceReceived(int reqId, const QVector<DAPClient::StackFrame> &frames);
+	void scopesReceived(int reqId, const QVector<DAPClient::Scope> &scopes);
+	void variablesReceived(int reqId, const QVector<DAPClient::Variable> &variables);
+	void stackSnapshotReceived(int reqId, const QVector<DAPClient::FrameSnapshot> &frames);
+	void breakpointsReceived(int reqId, const QVector<uint32_t> &breakpoints);
 	void sceneReceived(int reqId, const QVector<SceneEntity> &entities);
-	void renderEntityReceived(int reqId, int entityId, const QPixmap &pixmap);
-	void renderPartsReceived(int reqId, int partsNo, const QPixmap &pixmap);
+	void renderEntityReceived(int reqId, int entityId, const QImage &image);
+	void renderPartsReceived(int reqId, int partsNo, const QImage &image);
 	void errorOccurred(const QString &message);
 
 private:
 
-	int sendJson(QJsonObject &obj);
 	int sendRequest(const QString &command);
-	int sendRequest(const QString &command, QJsonObject &args);
-	void readInput();
-	void handleMessage(const char *msg);
-	void handleResponse(QJsonObject &response);
-	void handleEvent(QJsonObject &event);
-	void error(const QString &message);
-
-	enum ReadState {
-		READING_HEADERS,
-		READING_CONTENT
-	};
+	int sendRequest(const QString &command, const QJsonObject &args);
+	int post(const QJsonObject &req);
+	void addTextureTransport(QJsonObject &args);
 
-	enum ReadState readState = READING_HEADERS;
-	char *content = nullptr;
-	int contentLength = -1;
-	int contentRead = 0;
+	QThread ioThread;
+	DAPConnection *connection;
 
 	enum DebugState {
 		DS_NOT_STARTED,
@@ -123,7 +113,6 @@ private:
 	};
 
 	enum DebugState state = DS_NOT_STARTED;
-	QProcess *process = nullptr;
 };
 
 #endif
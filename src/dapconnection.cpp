@@ -0,0 +1,358 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QDebug>
+
+#include "dapconnection.hpp"
+
+DAPConnection::DAPConnection()
+{
+}
+
+DAPConnection::~DAPConnection()
+{
+}
+
+void DAPConnection::start(const QString &program, const QStringList &arguments,
+		const QString &workingDirectory)
+{
+	if (process) {
+		if (process->state() != QProcess::NotRunning)
+			qDebug() << "killing running process";
+		delete process;
+	}
+	process = new QProcess(this);
+	framer.reset();
+	sharedMemoryTextures = false;
+	stackSnapshot = false;
+	cancelRequest = false;
+	process->setWorkingDirectory(workingDirectory);
+	process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+	connect(process, &QProcess::readyReadStandardOutput, this, &DAPConnection::readInput);
+	connect(process, &QProcess::started, [this]{
+		QJsonObject args = {
+			{ "adapterId", "xsystem4" },
+			{ "xsystem4.supportsSharedMemoryTextures", textureSharedMemorySupported() }
+		};
+		sendRequest("initialize", args);
+		emit started();
+	});
+	connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+			[this](int exitCode, QProcess::ExitStatus exitStatus) {
+		processRunning = false;
+		if (exitStatus == QProcess::CrashExit) {
+			// XXX: we don't emit terminateFinished here to prevent infinite
+			//      crash-restart loop
+			// TODO: should be some way to reinitialize manually in case of crash
+			emit errorOccurred("xsystem4 process crashed");
+		} else {
+			emit terminateFinished();
+		}
+	});
+	connect(process, &QProcess::errorOccurred, [this](QProcess::ProcessError error) {
+		if (error == QProcess::FailedToStart) {
+			processRunning = false;
+			emit failedToStart();
+		}
+		qDebug() << "error occurred:" << error;
+	});
+	processRunning = true;
+	process->start(program, arguments);
+}
+
+void DAPConnection::closeWriteChannel()
+{
+	if (process)
+		process->closeWriteChannel();
+}
+
+void DAPConnection::kill(int msec)
+{
+	if (!process)
+		return;
+
+	QJsonObject req {
+		{ "seq", nextSeq() },
+		{ "type", "request" },
+		{ "command", "disconnect" }
+	};
+	send(req);
+	process->closeWriteChannel();
+	if (!process->waitForFinished(msec)) {
+		process->kill();
+	}
+}
+
+void DAPConnection::handleEvent(QJsonObject &event)
+{
+	QString evtype = event["event"].toString();
+	if (evtype == "output") {
+		QJsonObject body = event["body"].toObject();
+		QString category = body["category"].toString();
+		QString output = body["output"].toString();
+		emit outputReceived(category, output);
+	} else if (evtype == "initialized") {
+		emit initialized();
+	} else if (evtype == "stopped") {
+		QJsonObject body = event["body"].toObject();
+		QString message = body["description"].toString();
+		emit paused(message);
+	} else if (evtype == "terminated") {
+		process->closeWriteChannel();
+		emit terminated();
+	} else {
+		qDebug() << "Unhandled event type: " << evtype;
+	}
+}
+
+static DAPConnection::StackFrame parseStackFrame(const QJsonObject &frame)
+{
+	QString ipStr = frame["instructionPointerReference"].toString();
+	return {
+		.id = frame["id"].toInt(),
+		.name = frame["name"].toString(),
+		.address = ipStr.toInt(nullptr, 16)
+	};
+}
+
+static DAPConnection::Scope parseScope(const QJsonObject &scope)
+{
+	return {
+		.name = scope["name"].toString(),
+		.presentationHint = scope["presentationHint"].toString(),
+		.variablesReference = scope["variablesReference"].toInt()
+	};
+}
+
+static DAPConnection::Variable parseVariable(const QJsonObject &var)
+{
+	return {
+		.name = var["name"].toString(),
+		.value = var["value"].toString(),
+		.type = var["type"].toString(),
+		.variablesReference = var["variablesReference"].toInt(),
+		.indexedVariables = var["indexedVariables"].toInt(),
+		.namedVariables = var["namedVariables"].toInt()
+	};
+}
+
+void DAPConnection::handleResponse(QJsonObject &response)
+{
+	if (!response["success"].toBool()) {
+		qDebug() << response["command"].toString() << " request failed!";
+		return;
+	}
+
+	int reqId = response["request_seq"].toInt();
+	QString cmd = response["command"].toString();
+	if (cmd == "initialize") {
+		QJsonObject caps = response["body"].toObject();
+		sharedMemoryTextures = textureSharedMemorySupported()
+			&& caps["xsystem4.supportsSharedMemoryTextures"].toBool();
+		stackSnapshot = caps["xsystem4.supportsStackSnapshot"].toBool();
+		cancelRequest = caps["supportsCancelRequest"].toBool();
+	} else if (cmd == "launch") {
+		emit launched();
+	} else if (cmd == "continue") {
+		emit continued();
+	} else if (cmd == "stackTrace") {
+		QJsonArray jsonFrames = response["body"].toObject()["stackFrames"].toArray();
+		if (jsonFrames.size() == 0) {
+			qDebug() << "stackTrace returned 0 frames";
+		}
+		QVector<StackFrame> frames(jsonFrames.size());
+		for (int i = 0; i < jsonFrames.size(); i++) {
+			frames[i] = parseStackFrame(jsonFrames[i].toObject());
+		}
+		emit stackTraceReceived(reqId, frames);
+	} else if (cmd == "scopes") {
+		QJsonArray jsonScopes = response["body"].toObject()["scopes"].toArray();
+		if (jsonScopes.size() == 0) {
+			qDebug() << "scopes returned 0 scopes";
+		}
+
+		QVector<Scope> scopes(jsonScopes.size());
+		for (int i = 0; i < jsonScopes.size(); i++) {
+			scopes[i] = parseScope(jsonScopes[i].toObject());
+		}
+		emit scopesReceived(reqId, scopes);
+	} else if (cmd == "variables") {
+		QJsonArray jsonVars = response["body"].toObject()["variables"].toArray();
+		QVector<Variable> vars(jsonVars.size());
+		for (int i = 0; i < jsonVars.size(); i++) {
+			vars[i] = parseVariable(jsonVars[i].toObject());
+		}
+		emit variablesReceived(reqId, vars);
+	} else if (cmd == "xsystem4.stackSnapshot") {
+		QJsonArray jsonFrames = response["body"].toObject()["stackFrames"].toArray();
+		QVector<FrameSnapshot> frames(jsonFrames.size());
+		for (int i = 0; i < jsonFrames.size(); i++) {
+			QJsonObject frame = jsonFrames[i].toObject();
+			QJsonArray jsonScopes = frame["scopes"].toArray();
+			frames[i].frame = parseStackFrame(frame);
+			frames[i].complete = frame.contains("scopes");
+			frames[i].scopes.resize(jsonScopes.size());
+			for (int j = 0; j < jsonScopes.size(); j++) {
+				QJsonObject scope = jsonScopes[j].toObject();
+				QJsonArray jsonVars = scope["variables"].toArray();
+				ScopeSnapshot &snap = frames[i].scopes[j];
+				snap.scope = parseScope(scope);
+				snap.variables.resize(jsonVars.size());
+				for (int k = 0; k < jsonVars.size(); k++) {
+					snap.variables[k] = parseVariable(jsonVars[k].toObject());
+				}
+			}
+		}
+		emit stackSnapshotReceived(reqId, frames);
+	} else if (cmd == "setInstructionBreakpoints") {
+		QJsonArray jBreakpoints = response["body"].toObject()["breakpoints"].toArray();
+		QVector<uint32_t> breakpoints;
+		for (int i = 0; i < jBreakpoints.size(); i++) {
+			QJsonObject obj = jBreakpoints[i].toObject();
+			if (!obj["verified"].toBool()) {
+				qDebug() << "breakpoint not verified";
+				continue;
+			}
+			QString addrStr = obj["instructionReference"].toString();
+			breakpoints.push_back(addrStr.toULong(nullptr, 16));
+		}
+		emit breakpointsReceived(reqId, breakpoints);
+	} else if (cmd == "xsystem4.scene") {
+		QJsonArray jEntities = response["body"].toObject()["entities"].toArray();
+		QVector<SceneEntity> entities;
+		for (const QJsonValue &val : jEntities) {
+			entities.append(SceneEntity(val));
+		}
+		emit sceneReceived(reqId, entities);
+	} else if (cmd == "xsystem4.renderEntity") {
+		QJsonObject body = response["body"].toObject();
+		int entityId = body["entityId"].toInt();
+		QImage image = parseTexture(body["texture"]);
+		if (image.isNull()) {
+			qDebug() << "failed to parse texture object";
+		} else {
+			emit renderEntityReceived(reqId, entityId, image);
+		}
+	} else if (cmd == "xsystem4.renderParts") {
+		QJsonObject body = response["body"].toObject();
+		int partsNo = body["partsId"].toInt();
+		QImage image = parseTexture(body["texture"]);
+		if (image.isNull()) {
+			qDebug() << "failed to parse texture object";
+		} else {
+			emit renderPartsReceived(reqId, partsNo, image);
+		}
+	}
+}
+
+void DAPConnection::error(const QString &message)
+{
+	qDebug() << "DAP error:" << message;
+	emit errorOccurred(message);
+}
+
+void DAPConnection::handleMessage(const char *msg, int size)
+{
+	// XXX: fromRawData doesn't copy; the framer keeps the bytes alive until
+	//      the next read
+	QJsonDocument json = QJsonDocument::fromJson(QByteArray::fromRawData(msg, size));
+	if (!json.isObject()) {
+		error("message is not a JSON object");
+		return;
+	}
+
+	QJsonObject obj = json.object();
+	QString t = obj["type"].toString();
+	if (t == "event")
+		handleEvent(obj);
+	else if (t == "response")
+		handleResponse(obj);
+	else {
+		// ?
+	}
+}
+
+DAPConnection::Stats DAPConnection::stats() const
+{
+	QMutexLocker lock(&statsMutex);
+	return ioStats;
+}
+
+void DAPConnection::resetStats()
+{
+	QMutexLocker lock(&statsMutex);
+	ioStats = {};
+}
+
+void DAPConnection::readInput()
+{
+	// drain everything the process has buffered in a single read
+	qint64 nr_read = framer.fill(process);
+	if (nr_read < 0) {
+		error(framer.errorString());
+		return;
+	}
+
+	int nr_messages = 0;
+	DAPFramer::Frame frame;
+	DAPFramer::Status status;
+	while ((status = framer.next(&frame)) == DAPFramer::FRAME_OK) {
+		handleMessage(frame.data, frame.size);
+		nr_messages++;
+	}
+	if (status == DAPFramer::FRAME_ERROR) {
+		// the stream can't be resynchronized after a framing error
+		error(framer.errorString());
+		framer.reset();
+	}
+
+	QMutexLocker lock(&statsMutex);
+	ioStats.wakeups++;
+	ioStats.bytes += nr_read;
+	ioStats.messages += nr_messages;
+	ioStats.lastBytes = nr_read;
+	ioStats.lastMessages = nr_messages;
+	ioStats.maxMessages = qMax(ioStats.maxMessages, nr_messages);
+}
+
+void DAPConnection::sendRequest(const QString &command, const QJsonObject &args)
+{
+	QJsonObject req {
+		{ "seq", nextSeq() },
+		{ "type", "request" },
+		{ "command", command },
+		{ "arguments", args }
+	};
+	send(req);
+}
+
+void DAPConnection::send(const QJsonObject &obj)
+{
+	if (!process)
+		return;
+
+	QJsonDocument doc(obj);
+	QByteArray bytes = doc.toJson();
+	int len = bytes.size();
+
+	process->write(QString("Content-Length: %1\r\n\r\n").arg(len).toUtf8());
+	process->write(bytes);
+}
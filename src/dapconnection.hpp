@@ -0,0 +1,155 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_DAP_CONNECTION_HPP
+#define XSYS4DBG_DAP_CONNECTION_HPP
+
+#include <atomic>
+#include <QAtomicInt>
+#include <QMetaType>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <QString>
+#include "dapframer.hpp"
+#include "xsystem4.hpp"
+
+class QStringList;
+class QProcess;
+class QJsonObject;
+class QImage;
+
+/*
+ * The transport side of DAPClient. Lives on DAPClient's I/O thread: owns the
+ * xsystem4 process, reads and frames its output and decodes responses into
+ * typed values, which are delivered to the GUI thread through (queued)
+ * signals.
+ */
+class DAPConnection : public QObject
+{
+	Q_OBJECT
+public:
+	DAPConnection();
+	~DAPConnection();
+
+	struct StackFrame {
+		int id;
+		QString name;
+		int address;
+	};
+
+	struct Scope {
+		QString name;
+		QString presentationHint;
+		int variablesReference;
+	};
+
+	struct Variable {
+		QString name;
+		QString value;
+		QString type;
+		int variablesReference; // 0 if the variable has no children
+		int indexedVariables;   // number of indexed children (arrays)
+		int namedVariables;     // number of named children (structs)
+	};
+
+	// result of xsystem4.stackSnapshot: frames with scopes and top-level
+	// variables, in one message
+	struct ScopeSnapshot {
+		Scope scope;
+		QVector<Variable> variables;
+	};
+
+	struct FrameSnapshot {
+		StackFrame frame;
+		QVector<ScopeSnapshot> scopes;
+		bool complete; // false if scopes were omitted for this frame
+	};
+
+	struct Stats {
+		quint64 wakeups;
+		quint64 bytes;
+		quint64 messages;
+		int lastBytes;
+		int lastMessages;
+		int maxMessages;
+	};
+
+	// thread-safe
+	bool running() const { return processRunning; }
+	bool supportsSharedMemoryTextures() const { return sharedMemoryTextures; }
+	bool supportsStackSnapshot() const { return stackSnapshot; }
+	bool supportsCancelRequest() const { return cancelRequest; }
+	int nextSeq() { return seq.fetchAndAddRelaxed(1); }
+	Stats stats() const;
+	void resetStats();
+
+	// must be called on the I/O thread
+	void start(const QString &program, const QStringList &arguments,
+			const QString &workingDirectory);
+	void send(const QJsonObject &obj);
+	void closeWriteChannel();
+	void kill(int msec);
+
+signals:
+	void started();
+	void failedToStart();
+	void initialized();
+	void launched();
+	void paused(const QString &message);
+	void continued();
+	void terminated();
+	void terminateFinished();
+	void outputReceived(const QString &category, const QString &message);
+	void stackTraceReceived(int reqId, const QVector<DAPConnection::StackFrame> &frames);
+	void scopesReceived(int reqId, const QVector<DAPConnection::Scope> &scopes);
+	void variablesReceived(int reqId, const QVector<DAPConnection::Variable> &variables);
+	void stackSnapshotReceived(int reqId, const QVector<DAPConnection::FrameSnapshot> &frames);
+	void breakpointsReceived(int reqId, const QVector<uint32_t> &breakpoints);
+	void sceneReceived(int reqId, const QVector<SceneEntity> &entities);
+	void renderEntityReceived(int reqId, int entityId, const QImage &image);
+	void renderPartsReceived(int reqId, int partsNo, const QImage &image);
+	void errorOccurred(const QString &message);
+
+private:
+	void sendRequest(const QString &command, const QJsonObject &args);
+	void readInput();
+	void handleMessage(const char *msg, int size);
+	void handleResponse(QJsonObject &response);
+	void handleEvent(QJsonObject &event);
+	void error(const QString &message);
+
+	QProcess *process = nullptr;
+	DAPFramer framer;
+
+	mutable QMutex statsMutex;
+	Stats ioStats = {};
+
+	QAtomicInt seq = 1;
+	std::atomic<bool> processRunning { false };
+	// adapter capabilities (from initialize response)
+	std::atomic<bool> sharedMemoryTextures { false };
+	std::atomic<bool> stackSnapshot { false };
+	std::atomic<bool> cancelRequest { false };
+};
+
+Q_DECLARE_METATYPE(DAPConnection::StackFrame)
+Q_DECLARE_METATYPE(DAPConnection::Scope)
+Q_DECLARE_METATYPE(DAPConnection::Variable)
+Q_DECLARE_METATYPE(DAPConnection::FrameSnapshot)
+Q_DECLARE_METATYPE(SceneEntity)
+
+#endif
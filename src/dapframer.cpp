@@ -0,0 +1,150 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QIODevice>
+#include <string.h>
+
+#include "dapframer.hpp"
+
+#define INITIAL_BUFFER_SIZE (64 * 1024)
+
+DAPFramer::DAPFramer()
+{
+	buffer.resize(INITIAL_BUFFER_SIZE);
+}
+
+void DAPFramer::reset()
+{
+	begin = 0;
+	end = 0;
+	contentLength = -1;
+	error.clear();
+}
+
+// Make room for at least `size` more bytes after `end`.
+void DAPFramer::reserve(qint64 size)
+{
+	if (buffer.size() - end >= size)
+		return;
+
+	// move unconsumed data to the front of the buffer
+	if (begin > 0) {
+		memmove(buffer.data(), buffer.data() + begin, end - begin);
+		end -= begin;
+		begin = 0;
+	}
+	if (buffer.size() - end >= size)
+		return;
+
+	qint64 newSize = buffer.size() * 2;
+	while (newSize - end < size)
+		newSize *= 2;
+	buffer.resize(newSize);
+}
+
+qint64 DAPFramer::fill(QIODevice *device)
+{
+	qint64 avail = device->bytesAvailable();
+	if (avail <= 0)
+		return 0;
+
+	reserve(avail);
+	qint64 nr_read = device->read(buffer.data() + end, avail);
+	if (nr_read < 0) {
+		error = "read error";
+		return -1;
+	}
+	end += nr_read;
+	return nr_read;
+}
+
+void DAPFramer::append(const char *data, int size)
+{
+	reserve(size);
+	memcpy(buffer.data() + end, data, size);
+	end += size;
+}
+
+DAPFramer::Status DAPFramer::parseHeaders()
+{
+	const char *data = buffer.constData();
+	int pos = begin;
+	int length = -1;
+
+	while (true) {
+		const char *nl = (const char*)memchr(data + pos, '\n', end - pos);
+		// full line is not available
+		if (!nl)
+			return FRAME_INCOMPLETE;
+
+		const char *line = data + pos;
+		int lineLen = nl - line;
+		pos += lineLen + 1;
+		if (lineLen > 0 && line[lineLen-1] == '\r')
+			lineLen--;
+
+		// reached end of headers
+		if (lineLen == 0)
+			break;
+
+		static const char clHeader[] = "Content-Length:";
+		static const int clHeaderLen = sizeof(clHeader) - 1;
+		if (lineLen > clHeaderLen && !strncmp(line, clHeader, clHeaderLen)) {
+			bool ok;
+			length = QByteArray::fromRawData(line + clHeaderLen, lineLen - clHeaderLen)
+				.trimmed().toInt(&ok);
+			if (!ok || length < 1) {
+				error = "invalid value for Content-Length";
+				return FRAME_ERROR;
+			}
+		}
+		// other headers are ignored
+	}
+
+	if (length < 0) {
+		error = "missing value for Content-Length";
+		return FRAME_ERROR;
+	}
+
+	begin = pos;
+	contentLength = length;
+	return FRAME_OK;
+}
+
+DAPFramer::Status DAPFramer::next(Frame *frame)
+{
+	if (contentLength < 0) {
+		Status status = parseHeaders();
+		if (status != FRAME_OK)
+			return status;
+	}
+
+	if (end - begin < contentLength)
+		return FRAME_INCOMPLETE;
+
+	frame->data = buffer.constData() + begin;
+	frame->size = contentLength;
+	begin += contentLength;
+	contentLength = -1;
+
+	// buffer fully consumed; start over at the front (frame data stays valid
+	// until the next fill)
+	if (begin == end) {
+		begin = 0;
+		end = 0;
+	}
+	return FRAME_OK;
+}
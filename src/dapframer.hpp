@@ -0,0 +1,74 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_DAP_FRAMER_HPP
+#define XSYS4DBG_DAP_FRAMER_HPP
+
+#include <QByteArray>
+#include <QString>
+
+class QIODevice;
+
+/*
+ * Splits the DAP byte stream into Content-Length delimited frames.
+ *
+ * Input is read into a single reusable buffer. Consumed bytes are only
+ * discarded (by moving the unconsumed tail to the front) when more space is
+ * needed, so every complete frame is contiguous in memory and can be handed
+ * out as a view without copying.
+ */
+class DAPFramer
+{
+public:
+	DAPFramer();
+
+	struct Frame {
+		const char *data;
+		int size;
+	};
+
+	enum Status {
+		FRAME_OK,
+		FRAME_INCOMPLETE,
+		FRAME_ERROR
+	};
+
+	// Read everything the device currently has available. Returns the number
+	// of bytes read, or -1 on error.
+	qint64 fill(QIODevice *device);
+	// Append bytes directly (used when input doesn't come from a QIODevice).
+	void append(const char *data, int size);
+	// Get the next complete frame. The returned view is valid until the next
+	// call to fill(), append() or reset().
+	Status next(Frame *frame);
+	void reset();
+
+	const QString &errorString() const { return error; }
+	int buffered() const { return end - begin; }
+
+private:
+	void reserve(qint64 size);
+	Status parseHeaders();
+
+	QByteArray buffer;
+	int begin = 0;
+	int end = 0;
+	// length of the frame currently being assembled (-1 if headers not yet read)
+	int contentLength = -1;
+	QString error;
+};
+
+#endif
@@ -15,6 +15,7 @@
  */
 
 #include <QHash>
+#include <QImage>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -38,6 +39,7 @@ Debugger::Debugger() : QObject()
 	connect(&client, &DAPClient::terminateFinished, this, &Debugger::initialize);
 	connect(&client, &DAPClient::scopesReceived, this, &Debugger::onScopesReceived);
 	connect(&client, &DAPClient::variablesReceived, this, &Debugger::onVariablesReceived);
+	connect(&client, &DAPClient::stackSnapshotReceived, this, &Debugger::onStackSnapshotReceived);
 	connect(&client, &DAPClient::breakpointsReceived, this, &Debugger::onBreakpointsReceived);
 	connect(&client, &DAPClient::sceneReceived, this, &Debugger::onSceneReceived);
 	connect(&client, &DAPClient::renderEntityReceived, this, &Debugger::onRenderEntityReceived);
@@ -128,8 +130,50 @@ void Debugger::renderParts(int no, renderEntityHandler handler)
 	renderEntityRequests[client.requestRenderParts(no)] = handler;
 }
 
+// Debugger manages the chain of requests to get full stack trace info
+// (stackTrace -> scopes -> variables), unless the adapter can send it all at
+// once with xsystem4.stackSnapshot.
+//
+// Only the top frame is loaded eagerly; other frames are loaded on demand with
+// loadStackFrame(). Loaded frames are cached until execution resumes.
+static int pendingStackTrace = 0;
+static bool stackTraceEmitted = false;
+static QHash<int, int> pendingScopes;
+static QHash<int, QPair<int, int>> pendingVariables;
+static QVector<Debugger::StackFrame> stackTrace;
+
+static int pendingScene = 0;
+
+static bool frameLoading(int frame)
+{
+	for (int f : qAsConst(pendingScopes)) {
+		if (f == frame)
+			return true;
+	}
+	for (const QPair<int, int> &fs : qAsConst(pendingVariables)) {
+		if (fs.first == frame)
+			return true;
+	}
+	return false;
+}
+
+// requests for children of structured variables (see VariablesModel)
+static QHash<int, variablesHandler> variablesRequests;
+
+static void clearStackTrace()
+{
+	stackTrace.clear();
+	stackTraceEmitted = false;
+	pendingStackTrace = 0;
+	pendingVariables.clear();
+	pendingScopes.clear();
+	// variable references are only valid while paused
+	variablesRequests.clear();
+}
+
 void Debugger::launch()
 {
+	clearStackTrace();
 	client.launch();
 }
 
@@ -145,28 +189,91 @@ void Debugger::stop()
 
 void Debugger::next()
 {
+	clearStackTrace();
 	client.next();
 }
 
 void Debugger::stepIn()
 {
+	clearStackTrace();
 	client.stepIn();
 }
 
 void Debugger::stepOut()
 {
+	clearStackTrace();
 	client.stepOut();
 }
 
-// Debugger manages the chain of requests to get full stack trace info
-static int pendingStackTrace = 0;
-static QHash<int, int> pendingScopes;
-static QHash<int, QPair<int, int>> pendingVariables;
-static QVector<Debugger::StackFrame> stackTrace;
+void Debugger::requestFrame(int frame)
+{
+	int reqId = client.requestScopes(stackTrace[frame].id);
+	pendingScopes[reqId] = frame;
+}
 
-static int pendingScene = 0;
+// Abandon requests for frames other than the top frame and `keep`.
+void Debugger::cancelFrameRequests(int keep)
+{
+	QSet<int> cancelled;
+	for (auto it = pendingScopes.begin(); it != pendingScopes.end();) {
+		if (it.value() == 0 || it.value() == keep) {
+			++it;
+			continue;
+		}
+		client.cancel(it.key());
+		cancelled.insert(it.value());
+		it = pendingScopes.erase(it);
+	}
+	for (auto it = pendingVariables.begin(); it != pendingVariables.end();) {
+		if (it.value().first == 0 || it.value().first == keep) {
+			++it;
+			continue;
+		}
+		client.cancel(it.key());
+		cancelled.insert(it.value().first);
+		it = pendingVariables.erase(it);
+	}
+	// partially loaded frames have to be fetched again from scratch
+	for (int frame : cancelled) {
+		stackTrace[frame].scopes.clear();
+	}
+}
 
-void Debugger::onStackTraceReceived(int reqId, QVector<DAPClient::StackFrame> &frames)
+void Debugger::loadStackFrame(int frame)
+{
+	if (frame < 0 || frame >= stackTrace.size())
+		return;
+	cancelFrameRequests(frame);
+	if (stackTrace[frame].loaded) {
+		emit stackFrameReceived(frame, stackTrace[frame]);
+		return;
+	}
+	if (!frameLoading(frame))
+		requestFrame(frame);
+}
+
+void Debugger::requestVariables(int variablesReference, const QString &filter, int start,
+		int count, variablesHandler handler)
+{
+	int reqId = client.requestVariables(variablesReference, filter, start, count);
+	variablesRequests[reqId] = handler;
+}
+
+void Debugger::frameFinished(int frame)
+{
+	if (frameLoading(frame))
+		return;
+
+	stackTrace[frame].loaded = true;
+	if (frame == 0 && !stackTraceEmitted) {
+		stackTraceEmitted = true;
+		emit stackTraceReceived(stackTrace);
+	} else if (frame != 0) {
+		emit stackFrameReceived(frame, stackTrace[frame]);
+	}
+}
+
+void Debugger::onStackTraceReceived(int reqId, const QVector<DAPClient::StackFrame> &frames)
 {
 	if (reqId != pendingStackTrace) {
 		qDebug() << "unknown stackTrace request:" << reqId;
@@ -179,14 +286,18 @@ void Debugger::onStackTraceReceived(int reqId, QVector<DAPClient::StackFrame> &f
 		stackTrace[i].name = frames[i].name;
 		stackTrace[i].address = frames[i].address;
 		stackTrace[i].scopes.clear();
+		stackTrace[i].loaded = false;
 	}
-	for (int i = 0; i < stackTrace.size(); i++) {
-		int reqId = client.requestScopes(frames[i].id);
-		pendingScopes[reqId] = i;
+
+	if (stackTrace.isEmpty()) {
+		stackTraceEmitted = true;
+		emit stackTraceReceived(stackTrace);
+		return;
 	}
+	requestFrame(0);
 }
 
-void Debugger::onScopesReceived(int reqId, QVector<DAPClient::Scope> &scopes)
+void Debugger::onScopesReceived(int reqId, const QVector<DAPClient::Scope> &scopes)
 {
 	if (!pendingScopes.contains(reqId)) {
 		qDebug() << "unknown scopes request:" << reqId;
@@ -205,13 +316,16 @@ void Debugger::onScopesReceived(int reqId, QVector<DAPClient::Scope> &scopes)
 		pendingVariables[reqId] = { frameId, i };
 	}
 
-	if (pendingVariables.isEmpty() && pendingScopes.isEmpty()) {
-		emit stackTraceReceived(stackTrace);
-	}
+	frameFinished(frameId);
 }
 
-void Debugger::onVariablesReceived(int reqId, QVector<DAPClient::Variable> &variables)
+void Debugger::onVariablesReceived(int reqId, const QVector<DAPClient::Variable> &variables)
 {
+	if (variablesRequests.contains(reqId)) {
+		variablesHandler cb = variablesRequests.take(reqId);
+		cb(variables);
+		return;
+	}
 	if (!pendingVariables.contains(reqId)) {
 		qDebug() << "unknown variables request:" << reqId;
 		return;
@@ -226,12 +340,36 @@ void Debugger::onVariablesReceived(int reqId, QVector<DAPClient::Variable> &vari
 		scope.variables[i] = variables[i];
 	}
 
-	if (pendingVariables.isEmpty() && pendingScopes.isEmpty()) {
-		emit stackTraceReceived(stackTrace);
+	frameFinished(frameId);
+}
+
+void Debugger::onStackSnapshotReceived(int reqId, const QVector<DAPClient::FrameSnapshot> &frames)
+{
+	if (reqId != pendingStackTrace) {
+		qDebug() << "unknown stackSnapshot request:" << reqId;
+		return;
 	}
+	pendingStackTrace = 0;
+	stackTrace.resize(frames.size());
+	for (int i = 0; i < frames.size(); i++) {
+		const DAPClient::FrameSnapshot &frame = frames[i];
+		stackTrace[i].id = frame.frame.id;
+		stackTrace[i].name = frame.frame.name;
+		stackTrace[i].address = frame.frame.address;
+		stackTrace[i].loaded = frame.complete;
+		stackTrace[i].scopes.resize(frame.scopes.size());
+		for (int j = 0; j < frame.scopes.size(); j++) {
+			Scope &scope = stackTrace[i].scopes[j];
+			scope.name = frame.scopes[j].scope.name;
+			scope.presentationHint = frame.scopes[j].scope.presentationHint;
+			scope.variables = frame.scopes[j].variables;
+		}
+	}
+	stackTraceEmitted = true;
+	emit stackTraceReceived(stackTrace);
 }
 
-void Debugger::onBreakpointsReceived(int reqId, QVector<uint32_t> &breakpoints)
+void Debugger::onBreakpointsReceived(int reqId, const QVector<uint32_t> &breakpoints)
 {
 	instructionBreakpoints.clear();
 	for (uint32_t bp : breakpoints) {
@@ -249,7 +387,7 @@ void Debugger::onSceneReceived(int reqId, const QVector<SceneEntity> &entities)
 	emit sceneReceived(entities);
 }
 
-void Debugger::onRenderEntityReceived(int reqId, int entityId, const QPixmap &pixmap)
+void Debugger::onRenderEntityReceived(int reqId, int entityId, const QImage &image)
 {
 	if (!renderEntityRequests.contains(reqId)) {
 		qDebug() << "unknown renderEntity request:" << reqId;
@@ -257,10 +395,10 @@ void Debugger::onRenderEntityReceived(int reqId, int entityId, const QPixmap &pi
 	}
 
 	renderEntityHandler cb = renderEntityRequests.take(reqId);
-	cb(pixmap);
+	cb(QPixmap::fromImage(image));
 }
 
-void Debugger::onRenderPartsReceived(int reqId, int partsNo, const QPixmap &pixmap)
+void Debugger::onRenderPartsReceived(int reqId, int partsNo, const QImage &image)
 {
 	if (!renderEntityRequests.contains(reqId)) {
 		qDebug() << "unknown renderParts request:" << reqId;
@@ -268,7 +406,7 @@ void Debugger::onRenderPartsReceived(int reqId, int partsNo, const QPixmap &pixm
 	}
 
 	renderEntityHandler cb = renderEntityRequests.take(reqId);
-	cb(pixmap);
+	cb(QPixmap::fromImage(image));
 }
 
 void Debugger::onInitialized()
@@ -287,6 +425,7 @@ void Debugger::onLaunched()
 void Debugger::onContinued()
 {
 	configureOk = false;
+	clearStackTrace();
 	emit continued();
 }
 
@@ -295,10 +434,11 @@ void Debugger::onPaused(const QString &message)
 	configureOk = true;
 	emit paused(message);
 
-	stackTrace.clear();
-	pendingVariables.clear();
-	pendingScopes.clear();
-	pendingStackTrace = client.requestStackTrace();
+	clearStackTrace();
+	if (client.supportsStackSnapshot())
+		pendingStackTrace = client.requestStackSnapshot(1);
+	else
+		pendingStackTrace = client.requestStackTrace();
 	pendingScene = client.requestScene();
 }
 
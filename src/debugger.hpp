@@ -28,6 +28,7 @@ class QProcess;
 class QJsonObject;
 
 typedef std::function<void(const QPixmap &)> renderEntityHandler;
+typedef std::function<void(const QVector<DAPClient::Variable> &)> variablesHandler;
 
 class Debugger : public QObject
 {
@@ -53,6 +54,12 @@ public:
 	void renderEntity(int id, renderEntityHandler handler);
 	void renderParts(int no, renderEntityHandler handler);
 
+	DAPClient::Stats ioStats() const { return client.stats(); }
+
+	void loadStackFrame(int frame);
+	void requestVariables(int variablesReference, const QString &filter, int start,
+			int count, variablesHandler handler);
+
 	struct Scope {
 		QString name;
 		QString presentationHint;
@@ -64,6 +71,7 @@ public:
 		QString name;
 		int address;
 		QVector<Scope> scopes;
+		bool loaded = false; // scopes/variables have been received
 	};
 
 public slots:
@@ -83,6 +91,7 @@ signals:
 
 	void outputReceived(const QString &source, const QString &message);
 	void stackTraceReceived(QVector<StackFrame> &frames);
+	void stackFrameReceived(int frame, const StackFrame &stackFrame);
 	void breakpointsReceived(QSet<uint32_t> &breakpoints);
 	void sceneReceived(const QVector<SceneEntity> &entities);
 
@@ -95,18 +104,23 @@ private slots:
 	void onContinued();
 	void onPaused(const QString &message);
 	void onTerminated();
-	void onStackTraceReceived(int reqId, QVector<DAPClient::StackFrame> &frames);
-	void onScopesReceived(int reqId, QVector<DAPClient::Scope> &scopes);
-	void onVariablesReceived(int reqId, QVector<DAPClient::Variable> &variables);
-	void onBreakpointsReceived(int reqId, QVector<uint32_t> &breakpoints);
+	void onStackTraceReceived(int reqId, const QVector<DAPClient::StackFrame> &frames);
+	void onScopesReceived(int reqId, const QVector<DAPClient::Scope> &scopes);
+	void onVariablesReceived(int reqId, const QVector<DAPClient::Variable> &variables);
+	void onStackSnapshotReceived(int reqId, const QVector<DAPClient::FrameSnapshot> &frames);
+	void onBreakpointsReceived(int reqId, const QVector<uint32_t> &breakpoints);
 	void onSceneReceived(int reqId, const QVector<SceneEntity> &entities);
-	void onRenderEntityReceived(int reqId, int entityId, const QPixmap &image);
-	void onRenderPartsReceived(int reqId, int partsNo, const QPixmap &image);
+	void onRenderEntityReceived(int reqId, int entityId, const QImage &image);
+	void onRenderPartsReceived(int reqId, int partsNo, const QImage &image);
 
 private:
 	Debugger();
 	~Debugger();
 
+	void requestFrame(int frame);
+	void cancelFrameRequests(int keep);
+	void frameFinished(int frame);
+
 	bool killing = false; // FIXME: this sucks
 
 	bool configureOk = false;
@@ -0,0 +1,201 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <QDebug>
+#include <QSettings>
+#include <QTimer>
+
+#include "callgraph.hpp"
+#include "codeindex.hpp"
+#include "gamecache.hpp"
+#include "instructionprinter.hpp"
+#include "symbolindex.hpp"
+#include "symboltable.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+}
+
+// time without anything being opened before preloading (another) game
+#define PRELOAD_DELAY_MS 2000
+
+GameCache::GameCache(QObject *parent)
+	: QObject(parent)
+{
+	idleTimer = new QTimer(this);
+	idleTimer->setSingleShot(true);
+	idleTimer->setInterval(PRELOAD_DELAY_MS);
+	connect(idleTimer, &QTimer::timeout, this, &GameCache::preloadNext);
+
+	loader = new GameLoader(this);
+	connect(loader, &GameLoader::finished, this, [this](const GameLoader::Game &game) {
+		pending.game = game;
+		indexer->start(game.ain, game.ainPath, game.hash);
+	});
+	connect(loader, &GameLoader::failed, this, [this](const QString &message) {
+		qDebug() << "Failed to preload" << pending.game.path << ":" << message;
+		skipped.insert(pending.game.path);
+		pending = Entry();
+		idleTimer->start();
+	});
+
+	// a cached call graph may arrive before the index
+	indexer = new CodeIndexer(this);
+	connect(indexer, &CodeIndexer::finished, this, [this](QSharedPointer<const CodeIndex> index) {
+		pending.index = index;
+		if (pending.callGraph)
+			preloadFinished();
+	});
+	connect(indexer, &CodeIndexer::callGraphFinished, this,
+			[this](QSharedPointer<const CallGraph> graph) {
+		pending.callGraph = graph;
+		if (pending.index)
+			preloadFinished();
+	});
+
+	readSettings();
+}
+
+GameCache::~GameCache()
+{
+	pause();
+	for (Entry &entry : entries) {
+		destroy(entry);
+	}
+}
+
+qint64 GameCache::cost(const Entry &entry)
+{
+	return (qint64)entry.game.ain->code_size + entry.game.textSize
+		+ entry.game.printer->symbolTable().memoryUsage()
+		+ entry.game.symbols->memoryUsage()
+		+ entry.index->memoryUsage()
+		+ (qint64)entry.callGraph->nrEdges() * 2 * sizeof(CallGraph::Call);
+}
+
+void GameCache::destroy(Entry &entry)
+{
+	struct ain *ain = entry.game.ain;
+	entry = Entry();
+	if (ain)
+		ain_free(ain);
+}
+
+bool GameCache::take(const QString &path, Entry *out)
+{
+	for (int i = 0; i < entries.size(); i++) {
+		if (entries[i].game.path == path) {
+			*out = entries.takeAt(i);
+			used -= out->cost;
+			return true;
+		}
+	}
+	return false;
+}
+
+void GameCache::release(const Entry &entry)
+{
+	Entry e = entry;
+	if (!enabled || !e.index || !e.callGraph) {
+		destroy(e);
+		return;
+	}
+	e.cost = cost(e);
+	entries.prepend(e);
+	used += e.cost;
+	evict();
+}
+
+void GameCache::evict()
+{
+	while (used > budget && !entries.isEmpty()) {
+		Entry e = entries.takeLast();
+		used -= e.cost;
+		destroy(e);
+	}
+}
+
+void GameCache::resume(const QString &path)
+{
+	current = path;
+	if (enabled)
+		idleTimer->start();
+}
+
+void GameCache::pause()
+{
+	idleTimer->stop();
+	loader->cancel();
+	indexer->cancel();
+	destroy(pending);
+}
+
+void GameCache::readSettings()
+{
+	QSettings settings;
+	enabled = settings.value("preload/enabled", false).toBool();
+	budget = settings.value("preload/budget", DEFAULT_BUDGET_MB).toLongLong() * 1024 * 1024;
+	skipped.clear();
+	if (!enabled) {
+		pause();
+		for (Entry &entry : entries) {
+			destroy(entry);
+		}
+		entries.clear();
+		used = 0;
+		return;
+	}
+	evict();
+	if (!current.isEmpty())
+		idleTimer->start();
+}
+
+void GameCache::preloadNext()
+{
+	// one game at a time
+	if (!enabled || !pending.game.path.isEmpty() || used >= budget)
+		return;
+
+	QSettings settings;
+	for (const QString &path : settings.value("recent").toStringList()) {
+		if (path == current || skipped.contains(path))
+			continue;
+		auto cached = std::find_if(entries.begin(), entries.end(),
+				[&path](const Entry &e) { return e.game.path == path; });
+		if (cached != entries.end())
+			continue;
+		pending.game.path = path;
+		loader->start(path);
+		return;
+	}
+}
+
+void GameCache::preloadFinished()
+{
+	Entry e = pending;
+	pending = Entry();
+	// games opened more recently are never evicted for a preloaded one
+	e.cost = cost(e);
+	if (used + e.cost > budget) {
+		skipped.insert(e.game.path);
+		destroy(e);
+		return;
+	}
+	entries.append(e);
+	used += e.cost;
+	idleTimer->start();
+}
@@ -0,0 +1,97 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_GAME_CACHE_HPP
+#define XSYS4DBG_GAME_CACHE_HPP
+
+#include <QObject>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include "gameloader.hpp"
+
+class CallGraph;
+class CodeIndex;
+class CodeIndexer;
+class QTimer;
+
+/*
+ * Games kept loaded (and indexed) in the background, so that switching to
+ * them only needs xsystem4 to be started. When enabled in the settings, the
+ * most recently opened games are preloaded one at a time while the
+ * application is idle, and the game being switched away from is kept as
+ * well, until the memory budget is used up. The least recently used games
+ * are evicted first.
+ */
+class GameCache : public QObject
+{
+	Q_OBJECT
+public:
+	// a loaded game; index and callGraph are null until indexing finishes
+	struct Entry {
+		GameLoader::Game game;
+		QSharedPointer<const CodeIndex> index;
+		QSharedPointer<const CallGraph> callGraph;
+		// counted against the budget while cached (the literal cache
+		// grows, so it isn't recomputed on the way out)
+		qint64 cost;
+	};
+
+	// default for the "preload/budget" setting
+	enum { DEFAULT_BUDGET_MB = 512 };
+
+	GameCache(QObject *parent = nullptr);
+	~GameCache();
+
+	// Take the game in directory `path` out of the cache. Returns false if
+	// it isn't cached.
+	bool take(const QString &path, Entry *out);
+	// Keep a game that is no longer shown, if it is fully indexed and fits
+	// the budget. Its ain is freed otherwise.
+	void release(const Entry &entry);
+
+	// Start preloading (after a delay) games other than the one in
+	// `current`.
+	void resume(const QString &current);
+	// Stop preloading; the game being loaded is discarded.
+	void pause();
+	// Apply changed settings (enabled, budget).
+	void readSettings();
+
+private:
+	void preloadNext();
+	void preloadFinished();
+	void evict();
+	static qint64 cost(const Entry &entry);
+	static void destroy(Entry &entry);
+
+	bool enabled = false;
+	qint64 budget = 0;
+	// most recently used first
+	QVector<Entry> entries;
+	qint64 used = 0;
+
+	QString current;
+	// games that failed to load or don't fit; not retried
+	QSet<QString> skipped;
+	QTimer *idleTimer;
+	GameLoader *loader;
+	CodeIndexer *indexer;
+	Entry pending = {};
+};
+
+#endif
@@ -0,0 +1,264 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+
+#include "aintext.hpp"
+#include "cachefile.hpp"
+#include "gameloader.hpp"
+#include "instructionprinter.hpp"
+#include "symbolindex.hpp"
+#include "symboltable.hpp"
+
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include "system4/ain.h"
+#include "system4/ini.h"
+#include "system4/string.h"
+}
+
+#define SYMBOL_CACHE_MAGIC 0x5853594d // "XSYM"
+#define SYMBOL_CACHE_VERSION 1
+
+static void ini_free(struct ini_entry *ini, int nr_entries)
+{
+	for (int i = 0; i < nr_entries; i++) {
+		ini_free_entry(&ini[i]);
+	}
+	free(ini);
+}
+
+// Load the symbol table and finder index cached for `ain`.
+static bool load_symbols(const QString &path, struct ain *ain,
+		QSharedPointer<const SymbolTable> *symbols, QSharedPointer<const SymbolIndex> *index)
+{
+	CacheReader in(path, SYMBOL_CACHE_MAGIC, SYMBOL_CACHE_VERSION);
+	QSharedPointer<const SymbolTable> table(SymbolTable::load(in, ain));
+	if (!table)
+		return false;
+	QSharedPointer<const SymbolIndex> finder(SymbolIndex::load(in, *table));
+	if (!finder || !in.atEnd())
+		return false;
+	*symbols = table;
+	*index = finder;
+	return true;
+}
+
+static bool save_symbols(const QString &path, const SymbolTable &symbols,
+		const SymbolIndex &index)
+{
+	CacheWriter out(path, SYMBOL_CACHE_MAGIC, SYMBOL_CACHE_VERSION);
+	symbols.save(out);
+	index.save(out);
+	return out.commit();
+}
+
+static qint64 ain_text_size(struct ain *ain)
+{
+	qint64 size = 0;
+	for (int i = 0; i < ain->nr_strings; i++) {
+		size += ain->strings[i]->size;
+	}
+	for (int i = 0; i < ain->nr_messages; i++) {
+		size += ain->messages[i]->size;
+	}
+	return size;
+}
+
+static bool read_ini(const QString &path, GameLoader::Game *game, QString *error)
+{
+	int ini_size;
+	struct ini_entry *ini = ini_parse(path.toUtf8().constData(), &ini_size);
+	if (!ini) {
+		*error = "Failed to parse .ini file";
+		return false;
+	}
+
+	const char *code_name = NULL;
+	const char *game_name = NULL;
+	for (int i = 0; i < ini_size; i++) {
+		if (!strcmp(ini[i].name->text, "CodeName")) {
+			if (ini[i].value.type != INI_STRING) {
+				*error = ".ini \"CodeName\" value is not a string";
+				ini_free(ini, ini_size);
+				return false;
+			}
+			code_name = ini[i].value.s->text;
+			continue;
+		}
+		if (!strcmp(ini[i].name->text, "GameName")) {
+			if (ini[i].value.type != INI_STRING)
+				continue;
+			game_name = ini[i].value.s->text;
+			continue;
+		}
+	}
+	if (code_name == NULL) {
+		*error = ".ini file has no \"CodeName\" value";
+		ini_free(ini, ini_size);
+		return false;
+	}
+
+	game->codeName = sjis_decode(code_name);
+	if (game_name)
+		game->gameName = sjis_decode(game_name);
+	ini_free(ini, ini_size);
+	return true;
+}
+
+GameLoader::GameLoader(QObject *parent)
+	: QObject(parent)
+{
+}
+
+GameLoader::~GameLoader()
+{
+	cancel();
+	for (QThread *thread : threads) {
+		thread->wait();
+		delete thread;
+	}
+	// queued deliveries are discarded with the loader
+	for (struct ain *ain : undelivered) {
+		ain_free(ain);
+	}
+}
+
+void GameLoader::start(const QString &path)
+{
+	cancel();
+	cancelled = std::make_shared<std::atomic<bool>>(false);
+	active = true;
+
+	int gen = ++generation;
+	std::shared_ptr<std::atomic<bool>> stop = cancelled;
+	QThread *thread = QThread::create([this, path, gen, stop] {
+		// results are delivered on the loader's thread; the load may have
+		// been cancelled (or another one started) in the meantime
+		auto deliver = [this, gen](auto fn) {
+			QMetaObject::invokeMethod(this, [this, gen, fn] {
+				if (gen == generation)
+					fn();
+			}, Qt::QueuedConnection);
+		};
+		auto fail = [this, &deliver](const QString &message) {
+			deliver([this, message] {
+				active = false;
+				emit failed(message);
+			});
+		};
+
+		deliver([this] { emit progress(READ_INI, "Reading .ini file"); });
+		QDir dir(path);
+		QString iniPath = dir.filePath("System40.ini");
+		if (!QFile::exists(iniPath)) {
+			iniPath = dir.filePath("AliceStart.ini");
+			if (!QFile::exists(iniPath)) {
+				fail("Couldn't find .ini file in given directory");
+				return;
+			}
+		}
+
+		Game game = {};
+		game.path = path;
+		QString error;
+		if (!read_ini(iniPath, &game, &error)) {
+			fail(error);
+			return;
+		}
+		game.ainPath = dir.filePath(game.codeName);
+		if (!QFile::exists(game.ainPath)) {
+			fail(QString(".ain file \"%1\" does not exist").arg(game.ainPath));
+			return;
+		}
+		if (*stop)
+			return;
+		deliver([this, path] { emit iniRead(path); });
+
+		QString codeName = game.codeName;
+		deliver([this, codeName] {
+			emit progress(LOAD_AIN, QString("Loading .ain file: %1").arg(codeName));
+		});
+		int err;
+		// text is decoded from SJIS on demand (see aintext.hpp)
+		if (!(game.ain = ain_open_lazy(game.ainPath, &err))) {
+			fail(QString("Error opening .ain file: %1").arg(ain_strerror(err)));
+			return;
+		}
+		if (*stop) {
+			ain_free(game.ain);
+			return;
+		}
+		game.textSize = ain_text_size(game.ain);
+
+		deliver([this] { emit progress(READ_SYMBOLS, "Reading symbols"); });
+		// hashed here so the indexer can go straight to its caches
+		game.hash = file_hash(game.ainPath);
+		if (*stop) {
+			ain_free(game.ain);
+			return;
+		}
+		QSharedPointer<const SymbolTable> symbols;
+		QString cachePath = cache_path("symbols", game.hash);
+		if (game.hash.isEmpty() || !load_symbols(cachePath, game.ain, &symbols, &game.symbols)) {
+			symbols = QSharedPointer<const SymbolTable>::create(game.ain);
+			game.symbols = QSharedPointer<const SymbolIndex>::create(*symbols);
+			if (!game.hash.isEmpty() && !save_symbols(cachePath, *symbols, *game.symbols))
+				qDebug() << "Failed to write symbol cache for" << game.ainPath;
+		}
+		game.printer = QSharedPointer<const InstructionPrinter>::create(symbols);
+
+		// the ain is freed here unless finished() hands it over
+		{
+			QMutexLocker lock(&undeliveredMutex);
+			undelivered.append(game.ain);
+		}
+		QMetaObject::invokeMethod(this, [this, gen, game] {
+			{
+				QMutexLocker lock(&undeliveredMutex);
+				undelivered.removeOne(game.ain);
+			}
+			if (gen != generation) {
+				ain_free(game.ain);
+				return;
+			}
+			active = false;
+			emit finished(game);
+		}, Qt::QueuedConnection);
+	});
+	threads.append(thread);
+	connect(thread, &QThread::finished, this, [this, thread] { threadFinished(thread); });
+	thread->start();
+}
+
+void GameLoader::cancel()
+{
+	if (cancelled)
+		*cancelled = true;
+	generation++;
+	active = false;
+}
+
+void GameLoader::threadFinished(QThread *thread)
+{
+	threads.removeOne(thread);
+	thread->deleteLater();
+}
@@ -0,0 +1,96 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_GAME_LOADER_HPP
+#define XSYS4DBG_GAME_LOADER_HPP
+
+#include <atomic>
+#include <memory>
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+struct ain;
+class InstructionPrinter;
+class QThread;
+class SymbolIndex;
+
+/*
+ * Opens a game directory on a background thread, in stages: the .ini is
+ * read, then the .ain is loaded and hashed, and its symbol table and
+ * symbol finder index are loaded from the cache (or built and saved to
+ * it). iniRead() is emitted as soon as the directory is known
+ * to be valid, so the caller can start xsystem4 while the .ain is still
+ * loading.
+ *
+ * Cancelling doesn't wait for the current stage to finish; its result is
+ * discarded when it does.
+ */
+class GameLoader : public QObject
+{
+	Q_OBJECT
+public:
+	enum Stage {
+		READ_INI,
+		LOAD_AIN,
+		READ_SYMBOLS,
+		NR_STAGES
+	};
+
+	struct Game {
+		QString path; // the game directory
+		QString ainPath;
+		QString codeName;
+		QString gameName; // empty if the .ini has no GameName
+		struct ain *ain; // owned by the receiver of finished()
+		qint64 textSize; // bytes of string and message text in the ain
+		QByteArray hash; // of the .ain file, keying its caches; empty on error
+		QSharedPointer<const InstructionPrinter> printer;
+		QSharedPointer<const SymbolIndex> symbols;
+	};
+
+	GameLoader(QObject *parent = nullptr);
+	~GameLoader();
+
+	// Start loading the game in `path`, cancelling any previous load.
+	void start(const QString &path);
+	void cancel();
+	bool loading() const { return active; }
+
+signals:
+	void progress(GameLoader::Stage stage, const QString &message);
+	void iniRead(const QString &path);
+	void finished(const GameLoader::Game &game);
+	void failed(const QString &message);
+
+private:
+	void threadFinished(QThread *thread);
+
+	// threads of the current and of cancelled loads
+	QVector<QThread*> threads;
+	// ains of loaded games whose delivery is still queued; freed by the
+	// destructor if the loader goes away first
+	QMutex undeliveredMutex;
+	QVector<struct ain*> undelivered;
+	std::shared_ptr<std::atomic<bool>> cancelled;
+	int generation = 0;
+	bool active = false;
+};
+
+#endif
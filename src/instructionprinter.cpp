@@ -0,0 +1,229 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include "instructionprinter.hpp"
+#include "symboltable.hpp"
+
+extern "C" {
+#include "system4/instructions.h"
+}
+
+// highlighting class of an operand
+enum Token {
+	TOKEN_PLAIN,
+	TOKEN_NUMBER,
+	TOKEN_STRING,
+	TOKEN_ADDRESS,
+};
+
+static Token arg_token(int argtype)
+{
+	switch (argtype) {
+	case T_INT:
+	case T_SWITCH:
+	case T_FLOAT:
+	case T_HLLFUNC:
+		return TOKEN_NUMBER;
+	case T_ADDR:
+		return TOKEN_ADDRESS;
+	case T_STRING:
+	case T_MSG:
+	case T_FILE:
+		return TOKEN_STRING;
+	default:
+		return TOKEN_PLAIN;
+	}
+}
+
+static QString arg_to_string(const SymbolTable &symbols, int fno, int32_t arg, int argtype)
+{
+	const QString *name;
+	switch (argtype) {
+	case T_INT:
+	case T_SWITCH:
+		return QString::number((int)arg);
+	case T_FLOAT: {
+		union { int32_t i; float f; } cast = { .i = arg };
+		return QString::number(cast.f);
+	}
+	case T_ADDR:
+		return QString("0x%1").arg((long)arg, 8, 16, (QChar)'0');
+	case T_FUNC:
+		if (!(name = symbols.function(arg)))
+			return QString("<invalid function: %1>").arg(arg);
+		return *name;
+	case T_DLG:
+		if (!(name = symbols.delegate(arg)))
+			return QString("<invalid delegate: %1>").arg(arg);
+		return *name;
+	case T_STRING: {
+		QString str = symbols.string(arg);
+		if (str.isNull())
+			return QString("<invalid string: %1>").arg(arg);
+		return str;
+	}
+	case T_MSG: {
+		QString msg = symbols.message(arg);
+		if (msg.isNull())
+			return QString("<invalid message: %1>").arg(arg);
+		return msg;
+	}
+	case T_LOCAL:
+		if (!(name = symbols.local(fno, arg)))
+			return QString("<invalid local: %1>").arg(arg);
+		return *name;
+	case T_GLOBAL:
+		if (!(name = symbols.global(arg)))
+			return QString("<invalid global: %1>").arg(arg);
+		return *name;
+	case T_STRUCT:
+		if (!(name = symbols.structure(arg)))
+			return QString("<invalid struct: %1>").arg(arg);
+		return *name;
+	case T_SYSCALL:
+		if (arg < 0 || arg >= NR_SYSCALLS || !syscalls[arg].name)
+			return QString("<invalid/unknown syscall: %1>").arg(arg);
+		return syscalls[arg].name;
+	case T_HLL:
+		if (!(name = symbols.library(arg)))
+			return QString("<invalid library: %1>").arg(arg);
+		return *name;
+	case T_HLLFUNC:
+		return QString::number(arg);
+	case T_FILE:
+		if (!symbols.hasFilenames())
+			return QString::number(arg);
+		if (!(name = symbols.filename(arg)))
+			return QString("<invalid file: %1>").arg(arg);
+		return *name;
+	default:
+		return QString("<unknown arg type (%1): %2>").arg(argtype, arg);
+	}
+}
+
+static QString hll_function_name(const SymbolTable &symbols, int lib_no, int func_no)
+{
+	if (!symbols.library(lib_no))
+		return QString::number(func_no);
+	const QString *name = symbols.libraryFunction(lib_no, func_no);
+	if (!name)
+		return QString("<invalid library function: %1>").arg(func_no);
+	return *name;
+}
+
+InstructionPrinter::InstructionPrinter(QSharedPointer<const SymbolTable> symbols)
+	: symbols(symbols)
+{
+	keywordFormat.setForeground(Qt::blue);
+	keywordFormat.setFontWeight(QFont::Bold);
+	numberFormat.setForeground(Qt::darkCyan);
+	linkFormat = numberFormat;
+	linkFormat.setFontUnderline(true);
+	stringFormat.setForeground(Qt::red);
+}
+
+/*
+ * Write the text of `instr` to `out`, calling `span(start, length, i)` for
+ * the opcode (i = -1) and for each operand i.
+ */
+template<typename SpanFn>
+void InstructionPrinter::render(int fno, const CodeIndex::Instruction &instr, QString &out,
+		SpanFn span) const
+{
+	const struct instruction *info = instr.instr;
+	out = info->name;
+	span(0, out.size(), -1);
+
+	for (int i = 0; i < info->nr_args; i++) {
+		int start;
+		// XXX: special case: T_HLLFUNC is context-dependent
+		if (info->args[i] == T_HLLFUNC && i > 0 && info->args[i-1] == T_HLL) {
+			out += '.';
+			start = out.size();
+			out += hll_function_name(*symbols, instr.args[i-1], instr.args[i]);
+		} else {
+			out += ' ';
+			start = out.size();
+			out += arg_to_string(*symbols, fno, instr.args[i], info->args[i]);
+		}
+		span(start, out.size() - start, i);
+	}
+}
+
+InstructionPrinter::Line InstructionPrinter::print(int fno, const CodeIndex::Instruction &instr) const
+{
+	Line line;
+	const struct instruction *info = instr.instr;
+	render(fno, instr, line.text, [this, &line, &instr, info](int start, int length, int i) {
+		if (i < 0) {
+			if (info->opcode == FUNC || info->opcode == ENDFUNC)
+				line.formats.append({ start, length, keywordFormat });
+			return;
+		}
+
+		int type = info->args[i];
+		int32_t prev = i > 0 ? instr.args[i-1] : 0;
+		line.operands.append({ start, length, type, instr.args[i], prev });
+
+		// library function names are printed as lib.name
+		if (type == T_HLLFUNC && i > 0 && info->args[i-1] == T_HLL)
+			return;
+		switch (arg_token(type)) {
+		case TOKEN_NUMBER:
+			line.formats.append({ start, length, numberFormat });
+			break;
+		case TOKEN_STRING:
+			line.formats.append({ start, length, stringFormat });
+			break;
+		case TOKEN_ADDRESS:
+			line.formats.append({ start, length, linkFormat });
+			break;
+		default:
+			break;
+		}
+	});
+	return line;
+}
+
+QString InstructionPrinter::toString(int fno, const CodeIndex::Instruction &instr) const
+{
+	QString text;
+	render(fno, instr, text, [](int, int, int) {});
+	return text;
+}
+
+QString InstructionPrinter::operandText(int fno, const CodeIndex::Instruction &instr, int i) const
+{
+	const struct instruction *info = instr.instr;
+	if (i < 0 || i >= info->nr_args)
+		return QString();
+	if (info->args[i] == T_HLLFUNC && i > 0 && info->args[i-1] == T_HLL)
+		return hll_function_name(*symbols, instr.args[i-1], instr.args[i]);
+	return arg_to_string(*symbols, fno, instr.args[i], info->args[i]);
+}
+
+void InstructionPrinter::operandText(int fno, const CodeIndex::Instruction &instr, int i,
+		QString &out) const
+{
+	const struct instruction *info = instr.instr;
+	if (i >= 0 && i < info->nr_args) {
+		if (info->args[i] == T_STRING && symbols->stringTo(instr.args[i], out))
+			return;
+		if (info->args[i] == T_MSG && symbols->messageTo(instr.args[i], out))
+			return;
+	}
+	out = operandText(fno, instr, i);
+}
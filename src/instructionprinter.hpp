@@ -0,0 +1,77 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_INSTRUCTION_PRINTER_HPP
+#define XSYS4DBG_INSTRUCTION_PRINTER_HPP
+
+#include <QSharedPointer>
+#include <QString>
+#include <QTextCharFormat>
+#include <QTextLayout>
+#include <QVector>
+#include "codeindex.hpp"
+
+class SymbolTable;
+
+/*
+ * Renders instructions as text. Highlighting is produced in the same pass:
+ * the span of each opcode and operand is known while it is appended, and
+ * its format follows from the operand type, so no pattern matching is done
+ * on the resulting text.
+ */
+class InstructionPrinter
+{
+public:
+	InstructionPrinter(QSharedPointer<const SymbolTable> symbols);
+
+	// operand at [start, start + length) of a line
+	struct Operand {
+		int start;
+		int length;
+		int type;      // T_INT, T_ADDR, ...
+		int32_t value;
+		int32_t prev;  // value of the previous operand (library of T_HLLFUNC)
+	};
+
+	struct Line {
+		QString text;
+		QVector<QTextLayout::FormatRange> formats;
+		QVector<Operand> operands;
+	};
+
+	// `fno` is the function containing the instruction (for locals)
+	Line print(int fno, const CodeIndex::Instruction &instr) const;
+	QString toString(int fno, const CodeIndex::Instruction &instr) const;
+	// text of operand `i` alone, as it appears in print() (thread-safe)
+	QString operandText(int fno, const CodeIndex::Instruction &instr, int i) const;
+	// The same, written to `out`; string and message literals bypass the
+	// symbol table's literal cache (for scans)
+	void operandText(int fno, const CodeIndex::Instruction &instr, int i, QString &out) const;
+
+	const SymbolTable &symbolTable() const { return *symbols; }
+
+private:
+	template<typename SpanFn>
+	void render(int fno, const CodeIndex::Instruction &instr, QString &out, SpanFn span) const;
+
+	QSharedPointer<const SymbolTable> symbols;
+	QTextCharFormat keywordFormat;
+	QTextCharFormat numberFormat;
+	QTextCharFormat linkFormat;
+	QTextCharFormat stringFormat;
+};
+
+#endif
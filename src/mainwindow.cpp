@@ -15,20 +15,26 @@
  */
 
 #include <QtWidgets>
+#include "callgraphview.hpp"
+#include "codeindex.hpp"
 #include "codeviewer.hpp"
 #include "debugger.hpp"
+#include "gamecache.hpp"
+#include "gameloader.hpp"
+#include "instructionprinter.hpp"
 #include "mainwindow.hpp"
 #include "outputlog.hpp"
+#include "patternview.hpp"
+#include "referencesview.hpp"
+#include "searchview.hpp"
 #include "sceneviewer.hpp"
 #include "settingsdialog.hpp"
+#include "symbolfinder.hpp"
+#include "symbolindex.hpp"
 #include "version.hpp"
 
 extern "C" {
-#include <string.h>
 #include "system4/ain.h"
-#include "system4/ini.h"
-#include "system4/string.h"
-#include "system4/utfsjis.h"
 }
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
@@ -39,6 +45,48 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
 	readSettings();
 	setUnifiedTitleAndToolBarOnMac(true);
 
+	loader = new GameLoader(this);
+	connect(loader, &GameLoader::progress, this,
+			[this](GameLoader::Stage stage, const QString &message) {
+		loadProgress->setValue(stage);
+		loadProgress->show();
+		cancelLoadButton->show();
+		status(message);
+	});
+	// xsystem4 starts up while the .ain is loading and being indexed
+	connect(loader, &GameLoader::iniRead, this, &MainWindow::startDebugger);
+	connect(loader, &GameLoader::finished, this, [this](const GameLoader::Game &game) {
+		showGame({ game, nullptr, nullptr });
+	});
+	connect(loader, &GameLoader::failed, this, [this](const QString &message) {
+		stopOpening();
+		status(tr("Ready"));
+		error(message);
+	});
+
+	gameCache = new GameCache(this);
+
+	// games are preloaded once the current one has been fully indexed (a
+	// cached call graph may arrive before the index)
+	indexer = new CodeIndexer(this);
+	connect(indexer, &CodeIndexer::finished, this, [this](QSharedPointer<const CodeIndex> index) {
+		current.index = index;
+		setCodeIndex(index);
+		if (current.callGraph)
+			gameCache->resume(current.game.path);
+		status(QString("%1 %2 instructions in %3 ms")
+				.arg(index->fromCache() ? "Loaded index of" : "Indexed")
+				.arg(index->instructions().size())
+				.arg(index->buildTime()));
+	});
+	connect(indexer, &CodeIndexer::callGraphFinished, this,
+			[this](QSharedPointer<const CallGraph> graph) {
+		current.callGraph = graph;
+		callGraphView->setCallGraph(graph);
+		if (current.index)
+			gameCache->resume(current.game.path);
+	});
+
 	connect(&Debugger::getInstance(), &Debugger::errorOccurred, this, &MainWindow::error);
 }
 
@@ -48,8 +96,14 @@ MainWindow::~MainWindow()
 	for (QAction *act : recentActions) {
 		delete act;
 	}
-	if (ain)
-		ain_free(ain);
+	// the loader, indexer, graph worker and pattern query may still be
+	// using the ain
+	delete loader;
+	indexer->cancel();
+	codeViewer->cancelGraph();
+	patternView->cancelQuery();
+	if (current.game.ain)
+		ain_free(current.game.ain);
 	if (viewMenu)
 		delete viewMenu;
 }
@@ -84,9 +138,10 @@ void MainWindow::createLandingActions()
 
 	settingsAct = new QAction(tr("Settings"), this);
 	settingsAct->setStatusTip(tr("Change settings"));
-	connect(settingsAct, &QAction::triggered, []{
+	connect(settingsAct, &QAction::triggered, [this]{
 		SettingsDialog dialog;
-		dialog.exec();
+		if (dialog.exec() == QDialog::Accepted)
+			gameCache->readSettings();
 	});
 
 	const QIcon aboutIcon = QIcon::fromTheme("help-about");
@@ -174,9 +229,54 @@ void MainWindow::createOpenedActions()
 	finishAct->setEnabled(false);
 	connect(finishAct, &QAction::triggered, dbg, &Debugger::stepOut);
 
+	goToSymbolAct = new QAction(tr("Go to &Symbol..."), this);
+	goToSymbolAct->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_P));
+	goToSymbolAct->setStatusTip(tr("Find a function, struct, global or library by name"));
+	connect(goToSymbolAct, &QAction::triggered, this, [this] { symbolFinder->popup(this); });
+
+	searchAct = new QAction(tr("&Find in Code..."), this);
+	searchAct->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_F));
+	searchAct->setStatusTip(tr("Search strings, messages and names used by the code"));
+	connect(searchAct, &QAction::triggered, this, [this] { searchView->activate(); });
+
+	patternAct = new QAction(tr("Find &Pattern in Code..."), this);
+	patternAct->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_B));
+	patternAct->setStatusTip(tr("Search for sequences of instructions"));
+	connect(patternAct, &QAction::triggered, this, [this] { patternView->activate(); });
+
+	graphAct = new QAction(tr("Control Flow &Graph"), this);
+	graphAct->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_G));
+	graphAct->setStatusTip(tr("Show the current function as a graph of basic blocks"));
+	graphAct->setCheckable(true);
+	connect(graphAct, &QAction::toggled, this, [this](bool checked) {
+		tabWidget->setCurrentWidget(codeViewer);
+		codeViewer->setGraphVisible(checked);
+	});
+
+	callGraphAct = new QAction(tr("&Call Graph of Function"), this);
+	callGraphAct->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_H));
+	callGraphAct->setStatusTip(tr("Explore the callers and callees of the current function"));
+	connect(callGraphAct, &QAction::triggered, this, [this] {
+		callGraphView->show();
+		callGraphView->raise();
+		callGraphView->showFunction(currentFunction);
+	});
+
+	goToAddressAct = new QAction(tr("&Go to Address..."), this);
+	goToAddressAct->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_G));
+	goToAddressAct->setStatusTip(tr("Show the code at an address"));
+	connect(goToAddressAct, &QAction::triggered, this, &MainWindow::goToAddress);
+
 	// menus
 	viewMenu = new QMenu(tr("&View"));
 	menuBar()->insertMenu(debugMenu->menuAction(), viewMenu);
+	viewMenu->addAction(goToSymbolAct);
+	viewMenu->addAction(searchAct);
+	viewMenu->addAction(patternAct);
+	viewMenu->addAction(goToAddressAct);
+	viewMenu->addAction(graphAct);
+	viewMenu->addAction(callGraphAct);
+	viewMenu->addSeparator();
 	debugMenu->clear();
 	debugMenu->addAction(runAct);
 	debugMenu->addAction(pauseAct);
@@ -195,13 +295,16 @@ void MainWindow::createOpenedActions()
 	debugToolBar->addAction(stepAct);
 	debugToolBar->addAction(finishAct);
 
-	functionSelector = new QComboBox;
-	functionSelector->setMinimumSize(400, 0);
-	functionSelector->setEditable(true);
-	connect(functionSelector, QOverload<int>::of(&QComboBox::activated), this, [this] {
-		codeViewer->setFunction(functionSelector->currentText());
-	});
-	debugToolBar->addWidget(functionSelector);
+	// current function; opens the symbol finder
+	functionButton = new QToolButton;
+	functionButton->setMinimumSize(400, 0);
+	functionButton->setToolButtonStyle(Qt::ToolButtonTextOnly);
+	functionButton->setToolTip(goToSymbolAct->toolTip());
+	connect(functionButton, &QToolButton::clicked, goToSymbolAct, &QAction::trigger);
+	debugToolBar->addWidget(functionButton);
+
+	symbolFinder = new SymbolFinder(this);
+	connect(symbolFinder, &SymbolFinder::symbolActivated, this, &MainWindow::symbolActivated);
 
 	connect(dbg, &Debugger::initialized, [this]{
 		runAct->setEnabled(true);
@@ -248,6 +351,20 @@ void MainWindow::createOpenedActions()
 
 void MainWindow::createStatusBar()
 {
+	loadProgress = new QProgressBar;
+	loadProgress->setRange(0, GameLoader::NR_STAGES);
+	loadProgress->setMaximumWidth(200);
+	loadProgress->setTextVisible(false);
+	loadProgress->hide();
+	statusBar()->addPermanentWidget(loadProgress);
+
+	cancelLoadButton = new QToolButton;
+	cancelLoadButton->setText(tr("Cancel"));
+	cancelLoadButton->setToolTip(tr("Stop opening the game"));
+	cancelLoadButton->hide();
+	connect(cancelLoadButton, &QToolButton::clicked, this, &MainWindow::cancelOpen);
+	statusBar()->addPermanentWidget(cancelLoadButton);
+
 	status(tr("Ready"));
 }
 
@@ -260,6 +377,55 @@ void MainWindow::createDockWindows()
 
 	connect(&Debugger::getInstance(), &Debugger::outputReceived,
 			outputLog, &OutputLog::outputReceived);
+
+	referencesView = new ReferencesView(this);
+	addDockWidget(Qt::BottomDockWidgetArea, referencesView);
+	tabifyDockWidget(outputLog, referencesView);
+	outputLog->raise();
+	viewMenu->addAction(referencesView->toggleViewAction());
+
+	connect(codeViewer, &CodeViewer::findReferences, this, [this](const XrefIndex::Target &target) {
+		referencesView->show();
+		referencesView->raise();
+		referencesView->findReferences(target);
+	});
+	connect(referencesView, &ReferencesView::goToAddress, this, [this](uint32_t address) {
+		tabWidget->setCurrentWidget(codeViewer);
+		codeViewer->goToAddress(address);
+	});
+
+	searchView = new SearchView(this);
+	addDockWidget(Qt::BottomDockWidgetArea, searchView);
+	tabifyDockWidget(referencesView, searchView);
+	outputLog->raise();
+	viewMenu->addAction(searchView->toggleViewAction());
+
+	connect(searchView, &SearchView::goToAddress, this, [this](uint32_t address) {
+		tabWidget->setCurrentWidget(codeViewer);
+		codeViewer->goToAddress(address);
+	});
+
+	patternView = new PatternView(this);
+	addDockWidget(Qt::BottomDockWidgetArea, patternView);
+	tabifyDockWidget(searchView, patternView);
+	outputLog->raise();
+	viewMenu->addAction(patternView->toggleViewAction());
+
+	connect(patternView, &PatternView::goToAddress, this, [this](uint32_t address) {
+		tabWidget->setCurrentWidget(codeViewer);
+		codeViewer->goToAddress(address);
+	});
+
+	callGraphView = new CallGraphView(this);
+	addDockWidget(Qt::BottomDockWidgetArea, callGraphView);
+	tabifyDockWidget(patternView, callGraphView);
+	outputLog->raise();
+	viewMenu->addAction(callGraphView->toggleViewAction());
+
+	connect(callGraphView, &CallGraphView::functionActivated, this, [this](int fno) {
+		tabWidget->setCurrentWidget(codeViewer);
+		codeViewer->showFunction(fno);
+	});
 }
 
 void MainWindow::createViewer()
@@ -275,6 +441,7 @@ void MainWindow::createViewer()
 
 	connect(codeViewer, &CodeViewer::functionChanged,
 			this, &MainWindow::onFunctionChanged);
+	connect(codeViewer, &CodeViewer::graphVisibleChanged, graphAct, &QAction::setChecked);
 
 	const QPixmap sceneImage = QPixmap(":/icons/file-media.svg");
 	const QIcon sceneIcon = QIcon(sceneImage);
@@ -319,23 +486,44 @@ void MainWindow::status(const QString &message)
 	statusBar()->showMessage(message);
 }
 
-void MainWindow::onFunctionChanged(int fno)
+void MainWindow::goToAddress()
 {
-	int i = functionSelector->findText(ain->functions[fno].name);
-	functionSelector->setCurrentIndex(i);
+	bool ok;
+	QString text = QInputDialog::getText(this, tr("Go to Address"), tr("Address (hex):"),
+			QLineEdit::Normal, QString(), &ok).trimmed();
+	if (!ok || text.isEmpty())
+		return;
+	if (text.startsWith("0x", Qt::CaseInsensitive))
+		text = text.mid(2);
+
+	uint32_t address = text.toUInt(&ok, 16);
+	if (!ok) {
+		status(QString("Invalid address: %1").arg(text));
+		return;
+	}
+	tabWidget->setCurrentWidget(codeViewer);
+	if (!codeViewer->goToAddress(address))
+		status(QString("No instruction at address 0x%1").arg(address, 8, 16, QChar('0')));
 }
 
-static char *conv_utf8(const char *sjis)
+void MainWindow::onFunctionChanged(int fno)
 {
-	return sjis2utf(sjis, 0);
+	currentFunction = fno;
+	const QString *name = codeViewer->instructionPrinter()->symbolTable().function(fno);
+	functionButton->setText(name ? *name : QString());
 }
 
-static void ini_free(struct ini_entry *ini, int nr_entries)
+void MainWindow::symbolActivated(const XrefIndex::Target &target)
 {
-	for (int i = 0; i < nr_entries; i++) {
-		ini_free_entry(&ini[i]);
+	// functions are opened; for everything else, find where it's used
+	if (target.kind == XrefIndex::FUNCTION) {
+		tabWidget->setCurrentWidget(codeViewer);
+		codeViewer->showFunction(target.no);
+		return;
 	}
-	free(ini);
+	referencesView->show();
+	referencesView->raise();
+	referencesView->findReferences(target);
 }
 
 void MainWindow::addRecent(const QString &path)
@@ -352,81 +540,63 @@ void MainWindow::addRecent(const QString &path)
 	updateRecentActions();
 }
 
-bool MainWindow::readIni(const char *ini_path, char **code_name_out, char **game_name_out)
+void MainWindow::openGameDir(const QString &path)
 {
-	int ini_size;
-	struct ini_entry *ini = ini_parse(ini_path, &ini_size);
-	if (!ini) {
-		error("Failed to parse .ini file");
-		return false;
-	}
-
-	char *code_name = NULL;
-	char *game_name = NULL;
-	for (int i = 0; i < ini_size; i++) {
-		if (!strcmp(ini[i].name->text, "CodeName")) {
-			if (ini[i].value.type != INI_STRING) {
-				error(".ini \"CodeName\" value is not a string");
-				ini_free(ini, ini_size);
-				return false;
-			}
-			code_name = ini[i].value.s->text;
-			continue;
-		}
-		if (!strcmp(ini[i].name->text, "GameName")) {
-			if (ini[i].value.type != INI_STRING)
-				continue;
-			game_name = ini[i].value.s->text;
-			continue;
-		}
-	}
-	if (code_name == NULL) {
-		error(".ini file has no \"CodeName\" value");
-		ini_free(ini, ini_size);
-		return false;
+	// time to first disassembly
+	openTimer.start();
+	// preloading would compete with the game being opened
+	gameCache->pause();
+
+	GameCache::Entry entry;
+	if (gameCache->take(path, &entry)) {
+		// already loaded and indexed; only xsystem4 needs to be started
+		loader->cancel();
+		startDebugger(path);
+		showGame(entry);
+		return;
 	}
-
-	*code_name_out = conv_utf8(code_name);
-	*game_name_out = game_name ? conv_utf8(game_name) : NULL;
-	ini_free(ini, ini_size);
-	return true;
+	loader->start(path);
 }
 
-void MainWindow::openGameDir(const QString &path)
+void MainWindow::startDebugger(const QString &path)
 {
-	QDir dir(path);
-	QFile file(dir.filePath("System40.ini"));
-	if (!file.exists()) {
-		file.setFileName(dir.filePath("AliceStart.ini"));
-		if (!file.exists()) {
-			error("Couldn't find .ini file in given directory");
-			return;
-		}
-	}
+	debuggerDir = path;
+	if (!Debugger::getInstance().setGameDir(path))
+		error("setGameDir failed");
+}
 
-	char *code_name = NULL;
-	char *game_name = NULL;
-	if (!readIni((const char*)file.fileName().toUtf8(), &code_name, &game_name))
+void MainWindow::cancelOpen()
+{
+	if (!loader->loading())
 		return;
+	loader->cancel();
+	stopOpening();
+	status(tr("Cancelled"));
+}
 
-	QFile ainFile(dir.filePath(code_name));
-	if (!ainFile.exists()) {
-		error(QString(".ain file \"%1\" does not exist").arg(ainFile.fileName()));
-		goto end;
-	}
-
-	status(QString("Loading .ain file: %1").arg(code_name));
+void MainWindow::stopOpening()
+{
+	loadProgress->hide();
+	cancelLoadButton->hide();
+	if (current.game.path.isEmpty())
+		return;
+	// xsystem4 may already have been started for the game that wasn't opened
+	if (debuggerDir != current.game.path)
+		startDebugger(current.game.path);
+	gameCache->resume(current.game.path);
+}
 
-	int err;
-	struct ain *ainObj;
-	if (!(ainObj = ain_open_conv(ainFile.fileName().toUtf8(), conv_utf8, &err))) {
-		error(QString("Error opening .ain file: %1").arg(ain_strerror(err)));
-		goto end;
-	}
+void MainWindow::showGame(const GameCache::Entry &entry)
+{
+	loadProgress->hide();
+	cancelLoadButton->hide();
 
-	if (ain)
-		ain_free(ain);
-	ain = ainObj;
+	indexer->cancel();
+	// the old game is kept for switching back, or freed, once nothing
+	// refers to its ain anymore
+	GameCache::Entry old = current;
+	current = entry;
+	const GameLoader::Game &game = current.game;
 
 	// initialize debugger UI
 	if (!tabWidget) {
@@ -435,22 +605,34 @@ void MainWindow::openGameDir(const QString &path)
 		createDockWindows();
 	}
 
-	for (int i = 0; i < ain->nr_functions; i++) {
-		functionSelector->addItem(ain->functions[i].name);
-	}
-
-	codeViewer->setAin(ain);
-
-	if (!Debugger::getInstance().setGameDir(path)) {
-		error("setGameDir failed");
-		goto end;
+	codeViewer->setAin(game.ain, game.printer);
+	symbolFinder->setIndex(game.symbols);
+	referencesView->setPrinter(game.printer);
+	searchView->setPrinter(game.printer);
+	patternView->setPrinter(game.printer);
+	callGraphView->setPrinter(game.printer);
+	if (old.game.ain)
+		gameCache->release(old);
+	if (current.index) {
+		setCodeIndex(current.index);
+		callGraphView->setCallGraph(current.callGraph);
+		gameCache->resume(game.path);
+	} else {
+		indexer->start(game.ain, game.ainPath, game.hash);
 	}
+	status(QString("Opened %1 in %2 ms").arg(game.codeName).arg(openTimer.elapsed()));
 
 	// update window title
-	setWindowTitle(QString("xsys4dbg - %1").arg(game_name ? game_name : code_name));
+	setWindowTitle(QString("xsys4dbg - %1")
+			.arg(game.gameName.isEmpty() ? game.codeName : game.gameName));
 
-	addRecent(path);
-end:
-	free(code_name);
-	free(game_name);
+	addRecent(game.path);
+}
+
+void MainWindow::setCodeIndex(QSharedPointer<const CodeIndex> index)
+{
+	codeViewer->setCodeIndex(index);
+	referencesView->setCodeIndex(index);
+	searchView->setCodeIndex(index);
+	patternView->setCodeIndex(index);
 }
@@ -17,15 +17,23 @@
 #ifndef XSYS4DBG_MAINWINDOW_HPP
 #define XSYS4DBG_MAINWINDOW_HPP
 
+#include <QElapsedTimer>
 #include <QVector>
 #include <QMainWindow>
+#include "gamecache.hpp"
+#include "xrefindex.hpp"
 
-class QComboBox;
+class QProgressBar;
+class QToolButton;
 class QTabWidget;
+class CallGraphView;
+class CodeIndexer;
 class CodeViewer;
 class OutputLog;
-
-struct ain;
+class PatternView;
+class ReferencesView;
+class SearchView;
+class SymbolFinder;
 
 class MainWindow : public QMainWindow
 {
@@ -39,8 +47,12 @@ private slots:
 	void about();
 	void error(const QString &message);
 	void status(const QString &message);
+	void goToAddress();
 
+	void cancelOpen();
+	void startDebugger(const QString &path);
 	void onFunctionChanged(int fno);
+	void symbolActivated(const XrefIndex::Target &target);
 
 private:
 	void createLandingActions();
@@ -55,8 +67,10 @@ private:
 	void closeEvent(QCloseEvent *event) override;
 
 	void addRecent(const QString &path);
-	bool readIni(const char *ini_path, char **code_name_out, char **game_name_out);
 	void openGameDir(const QString &path);
+	void stopOpening();
+	void showGame(const GameCache::Entry &entry);
+	void setCodeIndex(QSharedPointer<const CodeIndex> index);
 
 	QMenu *fileMenu;
 	QMenu *recentMenu;
@@ -65,9 +79,16 @@ private:
 	QMenu *helpMenu;
 
 	QTabWidget *tabWidget = nullptr;
-	QComboBox *functionSelector;
+	QToolButton *functionButton;
+	SymbolFinder *symbolFinder;
 	CodeViewer *codeViewer;
 	OutputLog *outputLog;
+	ReferencesView *referencesView;
+	CallGraphView *callGraphView;
+	SearchView *searchView;
+	PatternView *patternView;
+	QProgressBar *loadProgress;
+	QToolButton *cancelLoadButton;
 
 	QAction *openAct;
 	QAction *exitAct;
@@ -82,8 +103,22 @@ private:
 	QAction *finishAct;
 
 	QAction *settingsAct;
-
-	struct ain *ain = NULL;
+	QAction *goToSymbolAct;
+	QAction *searchAct;
+	QAction *patternAct;
+	QAction *goToAddressAct;
+	QAction *graphAct;
+	QAction *callGraphAct;
+
+	// the open game, and the directory xsystem4 was last started in
+	GameCache::Entry current = {};
+	QString debuggerDir;
+	GameLoader *loader;
+	GameCache *gameCache;
+	QElapsedTimer openTimer;
+	// function shown in the code viewer
+	int currentFunction = -1;
+	CodeIndexer *indexer;
 };
 
 #endif
@@ -0,0 +1,351 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <string.h>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include "codeindex.hpp"
+#include "instructionprinter.hpp"
+#include "patternquery.hpp"
+
+extern "C" {
+#include "system4/instructions.h"
+}
+
+// number of match jobs per thread; matches are delivered a job at a time
+#define JOBS_PER_THREAD 4
+// fewest candidate instructions worth a job of their own
+#define MIN_JOB_SIZE 4096
+// check for cancellation every this many candidates
+#define CANCEL_CHECK_INTERVAL 4096
+
+// Match `s` against `pattern`, where '*' matches any run of characters and
+// '?' any single character.
+static bool glob_match(const QString &pattern, const QString &s, Qt::CaseSensitivity cs)
+{
+	int p = 0, i = 0;
+	int starP = -1, starI = 0;
+	while (i < s.size()) {
+		if (p < pattern.size() && pattern[p] == '*') {
+			// remember the star; first try matching nothing
+			starP = p++;
+			starI = i;
+		} else if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == s[i]
+					|| (cs == Qt::CaseInsensitive
+						&& pattern[p].toCaseFolded() == s[i].toCaseFolded()))) {
+			p++;
+			i++;
+		} else if (starP >= 0) {
+			// let the last star match one more character
+			p = starP + 1;
+			i = ++starI;
+		} else {
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*')
+		p++;
+	return p == pattern.size();
+}
+
+static bool is_glob(const QString &s)
+{
+	return s.contains('*') || s.contains('?');
+}
+
+// Split a step into whitespace-separated tokens; quoted text (with
+// backslash escapes) is kept together, quotes included.
+static QStringList tokenize(const QString &step, QString *error)
+{
+	QStringList tokens;
+	QString token;
+	bool quoted = false;
+	for (int i = 0; i < step.size(); i++) {
+		QChar c = step[i];
+		if (quoted) {
+			token += c;
+			if (c == '\\' && i + 1 < step.size())
+				token += step[++i];
+			else if (c == '"')
+				quoted = false;
+		} else if (c.isSpace()) {
+			if (!token.isEmpty())
+				tokens.append(token);
+			token.clear();
+		} else {
+			token += c;
+			if (c == '"')
+				quoted = true;
+		}
+	}
+	if (quoted)
+		*error = "unterminated string";
+	if (!token.isEmpty())
+		tokens.append(token);
+	return tokens;
+}
+
+// Split a pattern at ';' (outside of quotes).
+static QStringList split_steps(const QString &pattern)
+{
+	QStringList steps;
+	int start = 0;
+	bool quoted = false;
+	for (int i = 0; i < pattern.size(); i++) {
+		if (quoted && pattern[i] == '\\')
+			i++;
+		else if (pattern[i] == '"')
+			quoted = !quoted;
+		else if (!quoted && pattern[i] == ';') {
+			steps.append(pattern.mid(start, i - start));
+			start = i + 1;
+		}
+	}
+	steps.append(pattern.mid(start));
+	return steps;
+}
+
+bool PatternQuery::parse(const QString &pattern, QString *error)
+{
+	steps.clear();
+	error->clear();
+	for (const QString &text : split_steps(pattern)) {
+		QStringList tokens = tokenize(text, error);
+		if (!error->isEmpty())
+			return false;
+		if (tokens.isEmpty()) {
+			*error = "empty step";
+			return false;
+		}
+
+		Step step;
+		int maxArgs = 0;
+		if (tokens[0] == "*") {
+			maxArgs = INSTRUCTION_MAX_ARGS;
+		} else {
+			bool any = false;
+			step.opcodes.fill(false, NR_OPCODES);
+			for (int op = 0; op < NR_OPCODES; op++) {
+				if (!instructions[op].name)
+					continue;
+				if (glob_match(tokens[0], instructions[op].name, Qt::CaseInsensitive)) {
+					step.opcodes[op] = true;
+					maxArgs = qMax(maxArgs, instructions[op].nr_args);
+					any = true;
+				}
+			}
+			if (!any) {
+				*error = QString("unknown opcode: %1").arg(tokens[0]);
+				return false;
+			}
+		}
+		if (tokens.size() - 1 > maxArgs) {
+			*error = QString("too many operands for %1").arg(tokens[0]);
+			return false;
+		}
+
+		for (int i = 1; i < tokens.size(); i++) {
+			const QString &t = tokens[i];
+			Operand op = { Operand::ANY, 0, 0, QString(), false };
+			if (t != "*") {
+				bool ok;
+				if (t.startsWith("0x", Qt::CaseInsensitive))
+					op.i = (int32_t)t.mid(2).toUInt(&ok, 16);
+				else
+					op.i = t.toInt(&ok, 10);
+				if (ok) {
+					op.kind = Operand::INT;
+				} else if (t.contains('.') && (op.f = t.toFloat(&ok), ok)) {
+					op.kind = Operand::FLOAT;
+				} else {
+					op.kind = Operand::TEXT;
+					op.text = t;
+					op.glob = is_glob(t);
+				}
+			}
+			step.operands.append(op);
+		}
+		steps.append(step);
+	}
+	return true;
+}
+
+bool PatternQuery::matchOperand(const CodeIndex &index, const InstructionPrinter &printer,
+		int i, int arg, const Operand &op, QString &buffer) const
+{
+	const CodeIndex::Instruction &instr = index.instructions()[i];
+	int type = instr.instr->args[arg];
+	float f;
+	memcpy(&f, &instr.args[arg], sizeof(f));
+
+	switch (op.kind) {
+	case Operand::ANY:
+		return true;
+	case Operand::INT:
+		return type == T_FLOAT ? f == op.i : instr.args[arg] == op.i;
+	case Operand::FLOAT:
+		return type == T_FLOAT && f == op.f;
+	case Operand::TEXT: {
+		// only locals need the function
+		int fno = type == T_LOCAL ? index.functionAt(instr.address) : -1;
+		printer.operandText(fno, instr, arg, buffer);
+		return op.glob ? glob_match(op.text, buffer, Qt::CaseSensitive) : buffer == op.text;
+	}
+	}
+	return false;
+}
+
+bool PatternQuery::matchesAt(const CodeIndex &index, const InstructionPrinter &printer,
+		int i, QString &buffer) const
+{
+	const QVector<CodeIndex::Instruction> &instrs = index.instructions();
+	if (i < 0 || i > instrs.size() - steps.size())
+		return false;
+
+	// opcodes first: they are cheap and reject nearly everything
+	for (int s = 0; s < steps.size(); s++) {
+		const struct instruction *info = instrs[i+s].instr;
+		// don't run into the next function
+		if (s > 0 && info->opcode == FUNC)
+			return false;
+		if (!steps[s].opcodes.isEmpty() && !steps[s].opcodes[info->opcode])
+			return false;
+		if (steps[s].operands.size() > info->nr_args)
+			return false;
+	}
+	for (int s = 0; s < steps.size(); s++) {
+		const QVector<Operand> &operands = steps[s].operands;
+		for (int a = 0; a < operands.size(); a++) {
+			if (!matchOperand(index, printer, i + s, a, operands[a], buffer))
+				return false;
+		}
+	}
+	return true;
+}
+
+namespace {
+
+class MatchJob : public QRunnable
+{
+public:
+	MatchJob(const PatternQuery &query, const CodeIndex &index,
+			const InstructionPrinter &printer, const QVector<int> &candidates,
+			int anchor, int begin, int end, const std::atomic<bool> *cancel)
+		: query(query), index(index), printer(printer), candidates(candidates)
+		, anchor(anchor), begin(begin), end(end), cancel(cancel)
+	{
+		setAutoDelete(false);
+	}
+
+	void run() override
+	{
+		for (int c = begin; c < end; c++) {
+			if ((c - begin) % CANCEL_CHECK_INTERVAL == 0 && cancel && *cancel)
+				break;
+			int start = candidates[c] - anchor;
+			if (query.matchesAt(index, printer, start, buffer))
+				matches.append(start);
+		}
+		finished.release();
+	}
+
+	QVector<int> matches;
+	QSemaphore finished;
+
+private:
+	// operand text; literals are decoded here rather than in the symbol
+	// table's shared cache
+	QString buffer;
+	const PatternQuery &query;
+	const CodeIndex &index;
+	const InstructionPrinter &printer;
+	const QVector<int> &candidates;
+	int anchor;
+	int begin;
+	int end;
+	const std::atomic<bool> *cancel;
+};
+
+}
+
+bool PatternQuery::run(const CodeIndex &index, const InstructionPrinter &printer,
+		const std::atomic<bool> *cancel, matchHandler found) const
+{
+	if (steps.isEmpty())
+		return true;
+
+	// start from the step with the fewest candidate instructions
+	int nrInstrs = index.instructions().size();
+	int anchor = -1;
+	int fewest = nrInstrs;
+	for (int s = 0; s < steps.size(); s++) {
+		if (steps[s].opcodes.isEmpty())
+			continue;
+		int n = 0;
+		for (int op = 0; op < NR_OPCODES; op++) {
+			if (steps[s].opcodes[op])
+				n += index.withOpcode(op).size();
+		}
+		if (anchor < 0 || n < fewest) {
+			anchor = s;
+			fewest = n;
+		}
+	}
+
+	QVector<int> candidates;
+	if (anchor < 0) {
+		anchor = 0;
+		candidates.resize(nrInstrs);
+		std::iota(candidates.begin(), candidates.end(), 0);
+	} else {
+		candidates.reserve(fewest);
+		for (int op = 0; op < NR_OPCODES; op++) {
+			if (!steps[anchor].opcodes[op])
+				continue;
+			XrefIndex::Refs refs = index.withOpcode(op);
+			for (const int *r = refs.begin; r != refs.end; r++) {
+				candidates.append(*r);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+	}
+
+	// match in parallel; results are passed on in order, a job at a time
+	QThreadPool pool;
+	int nrJobs = qBound(1, candidates.size() / MIN_JOB_SIZE,
+			QThread::idealThreadCount() * JOBS_PER_THREAD);
+	QVector<MatchJob*> jobs;
+	for (int i = 0; i < nrJobs; i++) {
+		int begin = (int)((qint64)candidates.size() * i / nrJobs);
+		int end = (int)((qint64)candidates.size() * (i + 1) / nrJobs);
+		jobs.push_back(new MatchJob(*this, index, printer, candidates, anchor,
+					begin, end, cancel));
+		pool.start(jobs.last());
+	}
+	for (MatchJob *job : jobs) {
+		job->finished.acquire();
+		if (!job->matches.isEmpty() && !(cancel && *cancel))
+			found(job->matches);
+	}
+	pool.waitForDone();
+	qDeleteAll(jobs);
+	return !(cancel && *cancel);
+}
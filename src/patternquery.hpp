@@ -0,0 +1,96 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_PATTERN_QUERY_HPP
+#define XSYS4DBG_PATTERN_QUERY_HPP
+
+#include <atomic>
+#include <functional>
+#include <QString>
+#include <QVector>
+
+class CodeIndex;
+class InstructionPrinter;
+
+/*
+ * Opcode sequence patterns over the instruction table of a CodeIndex. A
+ * pattern is a list of steps separated by ';', each matching one
+ * instruction, e.g.
+ *
+ *     PUSH 1 ; CALLSYS system.Exit
+ *     CALLHLL SACT2 Sprite_*
+ *     * ; S_ASSIGN
+ *
+ * A step is an opcode followed by constraints on its operands, in order
+ * (missing operands are unconstrained). Opcodes are case-insensitive and
+ * may contain the wildcards '*' and '?'; "*" alone matches any
+ * instruction. An operand is either
+ *
+ *   - '*', which matches anything,
+ *   - an integer (decimal or 0x hex), compared with the operand's value
+ *     (or a number with a '.', compared with a float operand), or
+ *   - text, possibly with wildcards, compared with the operand as it is
+ *     displayed: a function, global, local, struct, delegate, library,
+ *     library function or syscall name, or a string or message literal
+ *     including its quotes ("..." keeps spaces and ';' in a token).
+ *
+ * Matching starts from the instructions with the opcodes of the most
+ * selective step (see CodeIndex::withOpcode()), which are split into
+ * chunks and matched in parallel. A match doesn't extend into the next
+ * function.
+ */
+class PatternQuery
+{
+public:
+	// called with the next batch of matches (indices of the first
+	// instruction of each match, in address order)
+	typedef std::function<void(const QVector<int> &)> matchHandler;
+
+	// Parse `pattern`. Returns false (and sets `error`) if it is invalid.
+	bool parse(const QString &pattern, QString *error);
+	int length() const { return steps.size(); }
+
+	// Find all matches, passing them to `found` in batches (on the calling
+	// thread). Returns false if cancelled.
+	bool run(const CodeIndex &index, const InstructionPrinter &printer,
+			const std::atomic<bool> *cancel, matchHandler found) const;
+
+	// true if the pattern matches at instruction `i` (thread-safe; each
+	// thread passes its own `buffer` for operand text)
+	bool matchesAt(const CodeIndex &index, const InstructionPrinter &printer, int i,
+			QString &buffer) const;
+
+private:
+	struct Operand {
+		enum { ANY, INT, FLOAT, TEXT } kind;
+		int32_t i;
+		float f;
+		QString text;
+		bool glob; // text contains wildcards
+	};
+
+	struct Step {
+		QVector<bool> opcodes; // indexed by opcode; empty if any
+		QVector<Operand> operands;
+	};
+
+	bool matchOperand(const CodeIndex &index, const InstructionPrinter &printer,
+			int i, int arg, const Operand &op, QString &buffer) const;
+
+	QVector<Step> steps;
+};
+
+#endif
@@ -0,0 +1,235 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QElapsedTimer>
+#include <QtWidgets>
+#include "instructionprinter.hpp"
+#include "patternquery.hpp"
+#include "patternview.hpp"
+#include "symboltable.hpp"
+
+enum {
+	COLUMN_ADDRESS,
+	COLUMN_FUNCTION,
+	COLUMN_TEXT,
+	NR_COLUMNS
+};
+
+PatternModel::PatternModel(QSharedPointer<const CodeIndex> index,
+		QSharedPointer<const InstructionPrinter> printer, int length, QObject *parent)
+	: QAbstractTableModel(parent)
+	, codeIndex(index)
+	, printer(printer)
+	, length(length)
+{
+}
+
+int PatternModel::rowCount(const QModelIndex &parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return matches.size();
+}
+
+int PatternModel::columnCount(const QModelIndex &parent) const
+{
+	return NR_COLUMNS;
+}
+
+uint32_t PatternModel::address(int row) const
+{
+	return codeIndex->instructions()[matches[row]].address;
+}
+
+QVariant PatternModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole)
+		return QVariant();
+
+	const QVector<CodeIndex::Instruction> &instrs = codeIndex->instructions();
+	int first = matches[index.row()];
+	int fno = codeIndex->functionAt(instrs[first].address);
+	switch (index.column()) {
+	case COLUMN_ADDRESS:
+		return QString("%1").arg((long)instrs[first].address, 8, 16, (QChar)'0');
+	case COLUMN_FUNCTION: {
+		const QString *name = printer->symbolTable().function(fno);
+		return name ? *name : QString("?");
+	}
+	case COLUMN_TEXT: {
+		QStringList text;
+		for (int i = first; i < first + length; i++) {
+			text.append(printer->toString(fno, instrs[i]));
+		}
+		return text.join(" ; ");
+	}
+	}
+	return QVariant();
+}
+
+QVariant PatternModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QVariant();
+	switch (section) {
+	case COLUMN_ADDRESS: return tr("Address");
+	case COLUMN_FUNCTION: return tr("Function");
+	case COLUMN_TEXT: return tr("Instructions");
+	}
+	return QVariant();
+}
+
+void PatternModel::appendMatches(const QVector<int> &batch)
+{
+	if (batch.isEmpty())
+		return;
+	beginInsertRows(QModelIndex(), matches.size(), matches.size() + batch.size() - 1);
+	matches.append(batch);
+	endInsertRows();
+}
+
+PatternView::PatternView(QWidget *parent)
+	: QDockWidget(tr("Patterns"), parent)
+{
+	QWidget *widget = new QWidget;
+	QVBoxLayout *layout = new QVBoxLayout(widget);
+	layout->setContentsMargins(0, 0, 0, 0);
+
+	input = new QLineEdit;
+	input->setPlaceholderText(tr("Opcode pattern, e.g. PUSH 1 ; CALLSYS system.Exit"));
+	input->setToolTip(tr("Instructions separated by ';', each an opcode followed by operands.\n"
+			"Opcodes and names may contain the wildcards * and ?; an operand of *\n"
+			"matches anything. Operands are numbers, names as displayed\n"
+			"(e.g. CALLHLL SACT2 Sprite_*), or quoted strings and messages."));
+	input->setClearButtonEnabled(true);
+	layout->addWidget(input);
+
+	label = new QLabel;
+	layout->addWidget(label);
+
+	view = new QTreeView;
+	view->setRootIsDecorated(false);
+	view->setUniformRowHeights(true);
+	QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+	font.setFixedPitch(true);
+	font.setPointSize(10);
+	view->setFont(font);
+	layout->addWidget(view);
+	setWidget(widget);
+
+	// queries can take a while over the whole code section, so they are
+	// only run on Return rather than as the user types
+	connect(input, &QLineEdit::returnPressed, this, &PatternView::runQuery);
+	connect(view, &QTreeView::activated, this, [this](const QModelIndex &index) {
+		if (model && index.isValid())
+			emit goToAddress(model->address(index.row()));
+	});
+}
+
+PatternView::~PatternView()
+{
+	cancelQuery();
+}
+
+void PatternView::setPrinter(QSharedPointer<const InstructionPrinter> p)
+{
+	cancelQuery();
+	printer = p;
+	codeIndex.reset();
+	view->setModel(nullptr);
+	delete model;
+	model = nullptr;
+	label->clear();
+}
+
+void PatternView::setCodeIndex(QSharedPointer<const CodeIndex> index)
+{
+	codeIndex = index;
+	if (!input->text().trimmed().isEmpty())
+		runQuery();
+}
+
+void PatternView::activate()
+{
+	show();
+	raise();
+	input->setFocus();
+	input->selectAll();
+}
+
+void PatternView::cancelQuery()
+{
+	if (!thread)
+		return;
+	cancelled = true;
+	thread->wait();
+	delete thread;
+	thread = nullptr;
+	generation++;
+}
+
+void PatternView::runQuery()
+{
+	if (input->text().trimmed().isEmpty() || !printer)
+		return;
+	if (!codeIndex) {
+		label->setText(tr("Waiting for the code index..."));
+		return;
+	}
+
+	PatternQuery query;
+	QString error;
+	if (!query.parse(input->text(), &error)) {
+		label->setText(tr("Invalid pattern: %1").arg(error));
+		return;
+	}
+
+	cancelQuery();
+	cancelled = false;
+	PatternModel *old = model;
+	model = new PatternModel(codeIndex, printer, query.length(), this);
+	view->setModel(model);
+	delete old;
+	label->setText(tr("Searching..."));
+
+	int gen = ++generation;
+	QSharedPointer<const CodeIndex> index = codeIndex;
+	QSharedPointer<const InstructionPrinter> p = printer;
+	thread = QThread::create([this, query, index, p, gen] {
+		QElapsedTimer timer;
+		timer.start();
+		// matches are added to the model as they come in; a newer query
+		// may have been started in the meantime
+		bool done = query.run(*index, *p, &cancelled, [this, gen](const QVector<int> &batch) {
+			QMetaObject::invokeMethod(this, [this, gen, batch] {
+				if (gen != generation)
+					return;
+				model->appendMatches(batch);
+				label->setText(tr("Searching... %1 matches").arg(model->rowCount()));
+			}, Qt::QueuedConnection);
+		});
+		if (!done)
+			return;
+		qint64 elapsed = timer.elapsed();
+		QMetaObject::invokeMethod(this, [this, gen, elapsed] {
+			if (gen != generation)
+				return;
+			label->setText(tr("%1 matches (%2 ms)").arg(model->rowCount()).arg(elapsed));
+			view->resizeColumnToContents(COLUMN_ADDRESS);
+		}, Qt::QueuedConnection);
+	});
+	thread->start(QThread::LowPriority);
+}
@@ -0,0 +1,96 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_PATTERN_VIEW_HPP
+#define XSYS4DBG_PATTERN_VIEW_HPP
+
+#include <atomic>
+#include <QAbstractTableModel>
+#include <QDockWidget>
+#include <QSharedPointer>
+#include "codeindex.hpp"
+
+class InstructionPrinter;
+class QLabel;
+class QLineEdit;
+class QThread;
+class QTreeView;
+
+/*
+ * Matches of a PatternQuery: one row per match, showing the matched
+ * instructions. Rows are appended as the query produces them.
+ */
+class PatternModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	PatternModel(QSharedPointer<const CodeIndex> index,
+			QSharedPointer<const InstructionPrinter> printer,
+			int length, QObject *parent = nullptr);
+
+	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation,
+			int role = Qt::DisplayRole) const override;
+
+	void appendMatches(const QVector<int> &batch);
+	// address of the first instruction of the match at `row`
+	uint32_t address(int row) const;
+
+private:
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
+	int length;
+	// index of the first instruction of each match
+	QVector<int> matches;
+};
+
+class PatternView : public QDockWidget
+{
+	Q_OBJECT
+public:
+	PatternView(QWidget *parent = nullptr);
+	~PatternView();
+
+	// Set the printer for a newly opened .ain (clears the results).
+	void setPrinter(QSharedPointer<const InstructionPrinter> printer);
+	void setCodeIndex(QSharedPointer<const CodeIndex> index);
+	// Show the panel and focus the pattern field.
+	void activate();
+	// Stop a running query and wait for it (before the ain is freed).
+	void cancelQuery();
+
+signals:
+	void goToAddress(uint32_t address);
+
+private:
+	void runQuery();
+
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
+
+	QLineEdit *input;
+	QLabel *label;
+	QTreeView *view;
+	PatternModel *model = nullptr;
+
+	QThread *thread = nullptr;
+	std::atomic<bool> cancelled { false };
+	int generation = 0;
+};
+
+#endif
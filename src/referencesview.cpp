@@ -0,0 +1,214 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QtWidgets>
+#include "instructionprinter.hpp"
+#include "referencesview.hpp"
+#include "symboltable.hpp"
+
+extern "C" {
+#include "system4/instructions.h"
+}
+
+// number of rows added to the view per fetchMore()
+#define FETCH_BATCH_SIZE 1000
+
+enum {
+	COLUMN_ADDRESS,
+	COLUMN_FUNCTION,
+	COLUMN_INSTRUCTION,
+	NR_COLUMNS
+};
+
+ReferencesModel::ReferencesModel(QSharedPointer<const CodeIndex> index,
+		QSharedPointer<const InstructionPrinter> printer,
+		const XrefIndex::Target &target, QObject *parent)
+	: QAbstractTableModel(parent)
+	, codeIndex(index)
+	, printer(printer)
+	, refs(index->xrefs().refs(target))
+{
+}
+
+int ReferencesModel::rowCount(const QModelIndex &parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return loaded;
+}
+
+int ReferencesModel::columnCount(const QModelIndex &parent) const
+{
+	return NR_COLUMNS;
+}
+
+uint32_t ReferencesModel::address(int row) const
+{
+	return codeIndex->instructions()[refs.begin[row]].address;
+}
+
+QVariant ReferencesModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole)
+		return QVariant();
+
+	const CodeIndex::Instruction &instr = codeIndex->instructions()[refs.begin[index.row()]];
+	int fno = codeIndex->functionAt(instr.address);
+	switch (index.column()) {
+	case COLUMN_ADDRESS:
+		return QString("%1").arg((long)instr.address, 8, 16, (QChar)'0');
+	case COLUMN_FUNCTION: {
+		const QString *name = printer->symbolTable().function(fno);
+		return name ? *name : QString("?");
+	}
+	case COLUMN_INSTRUCTION:
+		return printer->toString(fno, instr);
+	}
+	return QVariant();
+}
+
+QVariant ReferencesModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QVariant();
+	switch (section) {
+	case COLUMN_ADDRESS: return tr("Address");
+	case COLUMN_FUNCTION: return tr("Function");
+	case COLUMN_INSTRUCTION: return tr("Instruction");
+	}
+	return QVariant();
+}
+
+bool ReferencesModel::canFetchMore(const QModelIndex &parent) const
+{
+	return !parent.isValid() && loaded < refs.size();
+}
+
+void ReferencesModel::fetchMore(const QModelIndex &parent)
+{
+	if (parent.isValid())
+		return;
+	int n = qMin(FETCH_BATCH_SIZE, refs.size() - loaded);
+	if (n <= 0)
+		return;
+	beginInsertRows(QModelIndex(), loaded, loaded + n - 1);
+	loaded += n;
+	endInsertRows();
+}
+
+ReferencesView::ReferencesView(QWidget *parent)
+	: QDockWidget(tr("References"), parent)
+{
+	QWidget *widget = new QWidget;
+	QVBoxLayout *layout = new QVBoxLayout(widget);
+	layout->setContentsMargins(0, 0, 0, 0);
+
+	label = new QLabel(tr("Right-click an operand in the code view to find references."));
+	layout->addWidget(label);
+
+	view = new QTreeView;
+	view->setRootIsDecorated(false);
+	view->setUniformRowHeights(true);
+	QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+	font.setFixedPitch(true);
+	font.setPointSize(10);
+	view->setFont(font);
+	layout->addWidget(view);
+	setWidget(widget);
+
+	connect(view, &QTreeView::activated, this, [this](const QModelIndex &index) {
+		if (model && index.isValid())
+			emit goToAddress(model->address(index.row()));
+	});
+}
+
+void ReferencesView::setPrinter(QSharedPointer<const InstructionPrinter> p)
+{
+	printer = p;
+	codeIndex.reset();
+	pending = false;
+	view->setModel(nullptr);
+	delete model;
+	model = nullptr;
+	label->setText(tr("Right-click an operand in the code view to find references."));
+}
+
+void ReferencesView::setCodeIndex(QSharedPointer<const CodeIndex> index)
+{
+	codeIndex = index;
+	if (pending && codeIndex)
+		runQuery();
+}
+
+void ReferencesView::findReferences(const XrefIndex::Target &t)
+{
+	if (!printer)
+		return;
+	target = t;
+	pending = true;
+	if (codeIndex) {
+		runQuery();
+	} else {
+		label->setText(tr("Waiting for the code index..."));
+	}
+}
+
+void ReferencesView::runQuery()
+{
+	pending = false;
+	ReferencesModel *old = model;
+	model = new ReferencesModel(codeIndex, printer, target, this);
+	view->setModel(model);
+	delete old;
+
+	label->setText(tr("%n reference(s) to %1", "", model->totalCount()).arg(targetName(target)));
+	view->resizeColumnToContents(COLUMN_ADDRESS);
+}
+
+QString ReferencesView::targetName(const XrefIndex::Target &t) const
+{
+	const SymbolTable &symbols = printer->symbolTable();
+	const QString *name = nullptr;
+	switch (t.kind) {
+	case XrefIndex::FUNCTION: name = symbols.function(t.no); break;
+	case XrefIndex::GLOBAL: name = symbols.global(t.no); break;
+	case XrefIndex::STRING:
+		if (!symbols.string(t.no).isNull())
+			return symbols.string(t.no);
+		break;
+	case XrefIndex::MESSAGE:
+		if (!symbols.message(t.no).isNull())
+			return symbols.message(t.no);
+		break;
+	case XrefIndex::LIBRARY: name = symbols.library(t.no); break;
+	case XrefIndex::STRUCT: name = symbols.structure(t.no); break;
+	case XrefIndex::DELEGATE: name = symbols.delegate(t.no); break;
+	case XrefIndex::LIBRARY_FUNCTION: {
+		const QString *lib = symbols.library(t.lib);
+		const QString *fun = symbols.libraryFunction(t.lib, t.no);
+		if (lib && fun)
+			return *lib + "." + *fun;
+		break;
+	}
+	case XrefIndex::SYSCALL:
+		if (t.no >= 0 && t.no < NR_SYSCALLS && syscalls[t.no].name)
+			return syscalls[t.no].name;
+		break;
+	default:
+		break;
+	}
+	return name ? *name : QString::number(t.no);
+}
@@ -0,0 +1,92 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_REFERENCES_VIEW_HPP
+#define XSYS4DBG_REFERENCES_VIEW_HPP
+
+#include <QAbstractTableModel>
+#include <QDockWidget>
+#include <QSharedPointer>
+#include "codeindex.hpp"
+#include "xrefindex.hpp"
+
+class InstructionPrinter;
+class QLabel;
+class QTreeView;
+
+/*
+ * References to one target. The reference list is a slice of the xref
+ * index, so a query costs nothing up front; rows are handed to the view in
+ * batches through fetchMore() and rendered when displayed.
+ */
+class ReferencesModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	ReferencesModel(QSharedPointer<const CodeIndex> index,
+			QSharedPointer<const InstructionPrinter> printer,
+			const XrefIndex::Target &target, QObject *parent = nullptr);
+
+	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation,
+			int role = Qt::DisplayRole) const override;
+	bool canFetchMore(const QModelIndex &parent) const override;
+	void fetchMore(const QModelIndex &parent) override;
+
+	int totalCount() const { return refs.size(); }
+	uint32_t address(int row) const;
+
+private:
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
+	XrefIndex::Refs refs;
+	int loaded = 0;
+};
+
+class ReferencesView : public QDockWidget
+{
+	Q_OBJECT
+public:
+	ReferencesView(QWidget *parent = nullptr);
+
+	// Set the printer for a newly opened .ain (clears the results).
+	void setPrinter(QSharedPointer<const InstructionPrinter> printer);
+	void setCodeIndex(QSharedPointer<const CodeIndex> index);
+
+public slots:
+	void findReferences(const XrefIndex::Target &target);
+
+signals:
+	void goToAddress(uint32_t address);
+
+private:
+	QString targetName(const XrefIndex::Target &target) const;
+	void runQuery();
+
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
+	// query waiting for the code index
+	bool pending = false;
+	XrefIndex::Target target;
+
+	QLabel *label;
+	QTreeView *view;
+	ReferencesModel *model = nullptr;
+};
+
+#endif
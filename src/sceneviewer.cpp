@@ -22,55 +22,6 @@
 #include "sceneviewer.hpp"
 #include "debugger.hpp"
 
-struct SceneNode
-{
-	SceneNode() : parent(nullptr), type(ROOT) {};
-	explicit SceneNode(SceneEntity *e, SceneNode *parentNode = nullptr);
-	explicit SceneNode(Parts *p, SceneNode *parentNode);
-	~SceneNode() { qDeleteAll(children); };
-
-	int row() const {
-		if (parent)
-			return parent->children.indexOf(const_cast<SceneNode*>(this));
-		return 0;
-	}
-
-	SceneNode *parent;
-	QVector<SceneNode*> children;
-
-	enum SceneNodeType {
-		ROOT,
-		ENTITY,
-		PARTS,
-	} type;
-	union {
-		SceneEntity *entity;
-		Parts *parts;
-	} data;
-
-	QPixmap image;
-};
-
-SceneNode::SceneNode(SceneEntity *e, SceneNode *parentNode)
-	: parent(parentNode)
-	, type(ENTITY)
-{
-	data.entity = e;
-	for (Parts &p : e->parts) {
-		children.append(new SceneNode(&p, this));
-	}
-}
-
-SceneNode::SceneNode(Parts *p, SceneNode *parentNode)
-	: parent(parentNode)
-	, type(PARTS)
-{
-	data.parts = p;
-	for (Parts &child : p->children) {
-		children.append(new SceneNode(&child, this));
-	}
-}
-
 SceneViewer::SceneViewer(QWidget *parent)
 	: QSplitter(parent)
 {
@@ -118,21 +69,12 @@ void SceneViewer::onSceneReceived(const QVector<SceneEntity> &sceneEntities)
 			this, &SceneViewer::onCurrentChanged);
 }
 
-static SceneNode *getNode(const QModelIndex &index)
-{
-	if (!index.isValid())
-		return nullptr;
-	SceneNode *node = static_cast<SceneNode*>(index.internalPointer());
-	if (node->type == SceneNode::ROOT)
-		return nullptr;
-	return node;
-}
-
 void SceneViewer::onCurrentChanged(const QModelIndex &current, const QModelIndex &previous)
 {
-	SceneNode *node = getNode(current);
-	if (!node)
+	if (!current.isValid())
 		return;
+	SceneTreeModel *model = static_cast<SceneTreeModel*>(listView->model());
+	SceneNode *node = &model->sceneNode(current);
 
 	if (node->type == SceneNode::ENTITY) {
 		QAbstractItemModel *oldModel = detailView->model();
@@ -153,7 +95,10 @@ void SceneViewer::onActivated(const QModelIndex &index)
 
 	int id = sceneId;
 
-	SceneNode *node = static_cast<SceneNode*>(index.internalPointer());
+	// the scene tree isn't modified after construction, so this pointer stays
+	// valid as long as the scene is current (checked against sceneId)
+	SceneTreeModel *model = static_cast<SceneTreeModel*>(listView->model());
+	SceneNode *node = &model->sceneNode(index);
 	if (!node->image.isNull()) {
 		QLabel *imageLabel = new QLabel;
 		imageLabel->setPixmap(node->image);
@@ -197,18 +142,36 @@ void SceneViewer::onActivated(const QModelIndex &index)
 }
 
 SceneTreeModel::SceneTreeModel(const QVector<SceneEntity> &entityList, QObject *parent)
-	: QAbstractItemModel(parent)
+	: TreeModel(parent)
 	, entities(entityList)
 {
-	rootNode = new SceneNode;
 	for (SceneEntity &e : entities) {
-		rootNode->children.append(new SceneNode(&e, rootNode));
+		SceneNode node(SceneNode::ENTITY);
+		node.data.entity = &e;
+		int n = addNode(ROOT, node);
+		for (Parts &p : e.parts) {
+			addParts(n, &p);
+		}
+	}
+}
+
+void SceneTreeModel::addParts(int parent, Parts *p)
+{
+	SceneNode node(SceneNode::PARTS);
+	node.data.parts = p;
+	int n = addNode(parent, node);
+	for (Parts &child : p->children) {
+		addParts(n, &child);
 	}
 }
 
 SceneTreeModel::~SceneTreeModel()
 {
-	delete rootNode;
+}
+
+SceneNode &SceneTreeModel::sceneNode(const QModelIndex &index)
+{
+	return node(nodeId(index));
 }
 
 QVariant SceneTreeModel::data(const QModelIndex &index, int role) const
@@ -218,13 +181,13 @@ QVariant SceneTreeModel::data(const QModelIndex &index, int role) const
 	if (role != Qt::DisplayRole)
 		return QVariant();
 
-	SceneNode *node = static_cast<SceneNode*>(index.internalPointer());
-	if (node->type == SceneNode::ENTITY) {
-		return node->data.entity->name;
-	} else if (node->type == SceneNode::PARTS) {
+	const SceneNode &n = node(nodeId(index));
+	if (n.type == SceneNode::ENTITY) {
+		return n.data.entity->name;
+	} else if (n.type == SceneNode::PARTS) {
 		return QString("parts %1 (%2)")
-			.arg(node->data.parts->no)
-			.arg(node->data.parts->description());
+			.arg(n.data.parts->no)
+			.arg(n.data.parts->description());
 	}
 	return QVariant();
 }
@@ -245,332 +208,247 @@ QVariant SceneTreeModel::headerData(int section, Qt::Orientation orientation,
 	return QVariant();
 }
 
-QModelIndex SceneTreeModel::index(int row, int column, const QModelIndex &parent) const
-{
-	if (!hasIndex(row, column, parent))
-		return QModelIndex();
-
-	SceneNode *parentNode;
-	if (!parent.isValid())
-		parentNode = rootNode;
-	else
-		parentNode = static_cast<SceneNode*>(parent.internalPointer());
-
-	if (row < 0 || row >= parentNode->children.count())
-		return QModelIndex();
-	return createIndex(row, column, parentNode->children.at(row));
-}
-
-QModelIndex SceneTreeModel::parent(const QModelIndex &index) const
-{
-	if (!index.isValid())
-		return QModelIndex();
-
-	SceneNode *childNode = static_cast<SceneNode*>(index.internalPointer());
-	SceneNode *parentNode = childNode->parent;
-
-	if (parentNode == rootNode)
-		return QModelIndex();
-
-	return createIndex(parentNode->row(), 0, parentNode);
-}
-
-int SceneTreeModel::rowCount(const QModelIndex &parent) const
-{
-	if (parent.column() > 0)
-		return 0;
-
-	SceneNode *parentNode;
-	if (!parent.isValid())
-		parentNode = rootNode;
-	else
-		parentNode = static_cast<SceneNode*>(parent.internalPointer());
-
-	return parentNode->children.count();
-}
-
 int SceneTreeModel::columnCount(const QModelIndex &parent) const
 {
 	return 1;
 }
 
-struct EntityNode
+void EntityModel::loadSpriteParams(int n, const struct Sprite &sp)
 {
-	explicit EntityNode(const SceneEntity &e);
-	explicit EntityNode(const Parts &p);
-	explicit EntityNode(QString name, const PartsState &s, EntityNode *parentNode);
-	explicit EntityNode(QString name, const PartsTextLine &line, EntityNode *parentNode);
-	explicit EntityNode(QString name, const TextStyle &ts, EntityNode *parentNode);
-	explicit EntityNode(QString name, const PartsCpOp &op, EntityNode *parentNode);
-	explicit EntityNode(QString name, const PartsParams &p, EntityNode *parentNode);
-	explicit EntityNode(QString name, const PartsMotion &m, EntityNode *parentNode);
-	explicit EntityNode(QString name, QVariant value, EntityNode *parentNode);
-	~EntityNode() { qDeleteAll(children); }
-
-	int row() const {
-		if (parent)
-			return parent->children.indexOf(const_cast<EntityNode*>(this));
-		return 0;
-	}
-
-	void loadSpriteParams(const struct Sprite &sp);
-	void loadPartsParams(const Parts &p);
-
-	EntityNode *parent;
-	QVector<EntityNode*> children;
-
-	QString name;
-	QVariant value;
-};
-
-void EntityNode::loadSpriteParams(const struct Sprite &sp)
-{
-	children.append(new EntityNode("Color", sp.color.toString(), this));
-	children.append(new EntityNode("Multiply Color", sp.multiply_color.toString(), this));
-	children.append(new EntityNode("Add Color", sp.add_color.toString(), this));
-	children.append(new EntityNode("Blend Rate", sp.blend_rate, this));
-	children.append(new EntityNode("Bounding Rect", sp.rect.toString(), this));
-	children.append(new EntityNode("CG No", sp.cg_no, this));
+	add(n, "Color", sp.color.toString());
+	add(n, "Multiply Color", sp.multiply_color.toString());
+	add(n, "Add Color", sp.add_color.toString());
+	add(n, "Blend Rate", sp.blend_rate);
+	add(n, "Bounding Rect", sp.rect.toString());
+	add(n, "CG No", sp.cg_no);
 }
 
-void EntityNode::loadPartsParams(const Parts &p)
+void EntityModel::loadPartsParams(int n, const Parts &p)
 {
-	children.append(new EntityNode("State", p.state, this));
-	children.append(new EntityNode("Default", p.deflt, this));
-	children.append(new EntityNode("Hovered", p.hovered, this));
-	children.append(new EntityNode("Clicked", p.clicked, this));
-	children.append(new EntityNode("Local", p.local, this));
-	children.append(new EntityNode("Global", p.global, this));
-	children.append(new EntityNode("Delegate Index", p.delegateIndex, this));
-	children.append(new EntityNode("Sprite Deform", p.spriteDeform, this));
-	children.append(new EntityNode("Clickable", p.clickable, this));
-	children.append(new EntityNode("OnCursor Sound", p.onCursorSound, this));
-	children.append(new EntityNode("OnClick Sound", p.onClickSound, this));
-	children.append(new EntityNode("Origin Mode", p.originMode, this));
-	children.append(new EntityNode("Linked To", p.linkedTo, this));
-	children.append(new EntityNode("Linked From", p.linkedFrom, this));
-	children.append(new EntityNode("Draw Filter", p.drawFilter, this));
-	children.append(new EntityNode("Message Window", p.messageWindow, this));
+	add(n, "State", p.state);
+	add(n, "Default", p.deflt);
+	add(n, "Hovered", p.hovered);
+	add(n, "Clicked", p.clicked);
+	add(n, "Local", p.local);
+	add(n, "Global", p.global);
+	add(n, "Delegate Index", p.delegateIndex);
+	add(n, "Sprite Deform", p.spriteDeform);
+	add(n, "Clickable", p.clickable);
+	add(n, "OnCursor Sound", p.onCursorSound);
+	add(n, "OnClick Sound", p.onClickSound);
+	add(n, "Origin Mode", p.originMode);
+	add(n, "Linked To", p.linkedTo);
+	add(n, "Linked From", p.linkedFrom);
+	add(n, "Draw Filter", p.drawFilter);
+	add(n, "Message Window", p.messageWindow);
 
 	int i = 0;
-	EntityNode *motions;
-	children.append(motions = new EntityNode("Motions", QVariant(), this));
+	int motions = add(n, "Motions", QVariant());
 	for (const PartsMotion &m : p.motions) {
-		motions->children.append(new EntityNode(QString("[%1]").arg(i++), m, this));
+		add(motions, QString("[%1]").arg(i++), m);
 	}
 }
 
-EntityNode::EntityNode(const SceneEntity &e)
-	: parent(nullptr)
+void EntityModel::loadEntity(const SceneEntity &e)
 {
-	children.append(new EntityNode("Z", e.z, this));
+	int n = ROOT;
+	add(n, "Z", e.z);
 
 	if (e.sprite.has_value()) {
-		loadSpriteParams(*e.sprite);
+		loadSpriteParams(n, *e.sprite);
 	} else if (e.part.has_value()) {
-		loadPartsParams(*e.part);
+		loadPartsParams(n, *e.part);
 	}
 }
 
-EntityNode::EntityNode(const Parts &p)
-{
-	loadPartsParams(p);
-}
-
-EntityNode::EntityNode(QString name, const PartsState &s, EntityNode *parentNode)
-	: parent(parentNode)
-	, name(name)
+void EntityModel::add(int parent, QString name, const PartsState &s)
 {
+	int n = addNode(parent, EntityNode { name, QVariant() });
 	if (s.type != PARTS_UNINITIALIZED) {
-		children.append(new EntityNode("Size", s.size.toString(), this));
-		children.append(new EntityNode("Origin Offset", s.originOffset.toString(), this));
-		children.append(new EntityNode("Hitbox", s.hitbox.toString(), this));
-		children.append(new EntityNode("Surface Area", s.surfaceArea.toString(), this));
+		add(n, "Size", s.size.toString());
+		add(n, "Origin Offset", s.originOffset.toString());
+		add(n, "Hitbox", s.hitbox.toString());
+		add(n, "Surface Area", s.surfaceArea.toString());
 	}
 
 	int i = 0;
-	EntityNode *child;
+	int child;
 	switch (s.type) {
 	case PARTS_CG:
-		value = "CG";
-		children.append(new EntityNode("No", s.data.cg.no, this));
+		node(n).value = "CG";
+		add(n, "No", s.data.cg.no);
 		break;
 	case PARTS_TEXT:
-		value = "Text";
-		children.append(child = new EntityNode("Lines", QVariant(), this));
+		node(n).value = "Text";
+		child = add(n, "Lines", QVariant());
 		for (const PartsTextLine &line : s.data.text.lines) {
-			child->children.append(new EntityNode(QString("[%1]").arg(i++), line, this));
+			add(child, QString("[%1]").arg(i++), line);
 		}
-		children.append(new EntityNode("Line Space", s.data.text.lineSpace, this));
-		children.append(new EntityNode("Cursor", s.data.text.cursor.toString(), this));
-		children.append(new EntityNode("Style", s.data.text.textStyle, this));
+		add(n, "Line Space", s.data.text.lineSpace);
+		add(n, "Cursor", s.data.text.cursor.toString());
+		add(n, "Style", s.data.text.textStyle);
 		break;
 	case PARTS_ANIMATION:
-		value = "Animation";
-		children.append(new EntityNode("Start No", s.data.anim.startNo, this));
-		children.append(new EntityNode("Frame Time", s.data.anim.frameTime, this));
-		children.append(new EntityNode("Elapsed", s.data.anim.elapsed, this));
-		children.append(new EntityNode("Current Frame", s.data.anim.currentFrame, this));
+		node(n).value = "Animation";
+		add(n, "Start No", s.data.anim.startNo);
+		add(n, "Frame Time", s.data.anim.frameTime);
+		add(n, "Elapsed", s.data.anim.elapsed);
+		add(n, "Current Frame", s.data.anim.currentFrame);
 		break;
 	case PARTS_NUMERAL:
-		value = "Numeral";
+		node(n).value = "Numeral";
 		if (s.data.num.haveNum)
-			children.append(new EntityNode("Number", s.data.num.num, this));
-		children.append(new EntityNode("Space", s.data.num.space, this));
-		children.append(new EntityNode("Show Comma", s.data.num.showComma, this));
-		children.append(new EntityNode("Length", s.data.num.length, this));
-		children.append(new EntityNode("CG No", s.data.num.cgNo, this));
+			add(n, "Number", s.data.num.num);
+		add(n, "Space", s.data.num.space);
+		add(n, "Show Comma", s.data.num.showComma);
+		add(n, "Length", s.data.num.length);
+		add(n, "CG No", s.data.num.cgNo);
 		break;
 	case PARTS_HGAUGE:
-		value = "HGauge";
+		node(n).value = "HGauge";
 		break;
 	case PARTS_VGAUGE:
-		value = "VGauge";
+		node(n).value = "VGauge";
 		break;
 	case PARTS_CONSTRUCTION_PROCESS:
-		value = "Construction Process";
+		node(n).value = "Construction Process";
 		for (const PartsCpOp &op : s.data.cproc.operations) {
-			children.append(new EntityNode(QString("[%1]").arg(i++), op, this));
+			add(n, QString("[%1]").arg(i++), op);
 		}
 		break;
 	case PARTS_FLASH:
-		value = "Flash";
-		children.append(new EntityNode("Filename", s.data.flash.filename, this));
-		children.append(new EntityNode("Frame Count", s.data.flash.frame_count, this));
-		children.append(new EntityNode("Current Frame", s.data.flash.current_frame, this));
+		node(n).value = "Flash";
+		add(n, "Filename", s.data.flash.filename);
+		add(n, "Frame Count", s.data.flash.frame_count);
+		add(n, "Current Frame", s.data.flash.current_frame);
 		break;
 	case PARTS_UNINITIALIZED:
-		value = "<uninitialized>";
+		node(n).value = "<uninitialized>";
 		break;
 	case PARTS_INVALID:
-		value = "<invalid>";
+		node(n).value = "<invalid>";
 		break;
 	}
 }
 
-EntityNode::EntityNode(QString name, const TextStyle &ts, EntityNode *parentNode)
-	: parent(parentNode)
-	, name(name)
+void EntityModel::add(int parent, QString name, const TextStyle &ts)
 {
-	children.append(new EntityNode("Face", ts.face, this));
-	children.append(new EntityNode("Size", ts.size, this));
-	children.append(new EntityNode("Bold Width", ts.bold_width, this));
-	children.append(new EntityNode("Weight", ts.weight, this));
-	children.append(new EntityNode("Edge Top", ts.edge_up, this));
-	children.append(new EntityNode("Edge Bottom", ts.edge_down, this));
-	children.append(new EntityNode("Edge Left", ts.edge_left, this));
-	children.append(new EntityNode("Edge Right", ts.edge_right, this));
-	children.append(new EntityNode("Color", ts.color.toString(), this));
-	children.append(new EntityNode("Edge Color", ts.edge_color.toString(), this));
-	children.append(new EntityNode("Scale X", ts.scale_x, this));
-	children.append(new EntityNode("Space Scale X", ts.space_scale_x, this));
-	children.append(new EntityNode("Font Spacing", ts.font_spacing, this));
+	int n = addNode(parent, EntityNode { name, QVariant() });
+	add(n, "Face", ts.face);
+	add(n, "Size", ts.size);
+	add(n, "Bold Width", ts.bold_width);
+	add(n, "Weight", ts.weight);
+	add(n, "Edge Top", ts.edge_up);
+	add(n, "Edge Bottom", ts.edge_down);
+	add(n, "Edge Left", ts.edge_left);
+	add(n, "Edge Right", ts.edge_right);
+	add(n, "Color", ts.color.toString());
+	add(n, "Edge Color", ts.edge_color.toString());
+	add(n, "Scale X", ts.scale_x);
+	add(n, "Space Scale X", ts.space_scale_x);
+	add(n, "Font Spacing", ts.font_spacing);
 }
 
-EntityNode::EntityNode(QString name, const PartsTextLine &line, EntityNode *parentNode)
-	: parent(parentNode)
-	, name(name)
+void EntityModel::add(int parent, QString name, const PartsTextLine &line)
 {
-	children.append(new EntityNode("Contents", line.contents, this));
-	children.append(new EntityNode("Width", line.width, this));
-	children.append(new EntityNode("Height", line.height, this));
+	int n = addNode(parent, EntityNode { name, QVariant() });
+	add(n, "Contents", line.contents);
+	add(n, "Width", line.width);
+	add(n, "Height", line.height);
 }
 
-EntityNode::EntityNode(QString name, const PartsCpOp &op, EntityNode *parentNode)
-	: parent(parentNode)
-	, name(name)
+void EntityModel::add(int parent, QString name, const PartsCpOp &op)
 {
+	int n = addNode(parent, EntityNode { name, QVariant() });
 	switch (op.type) {
-	case PARTS_CP_CREATE: value = "Create"; break;
-	case PARTS_CP_CREATE_PIXEL_ONLY: value = "Create (Pixel Only)"; break;
-	case PARTS_CP_CG: value = "CG"; break;
-	case PARTS_CP_FILL: value = "Fill"; break;
-	case PARTS_CP_FILL_ALPHA_COLOR: value = "Fill Alpha Color"; break;
-	case PARTS_CP_FILL_AMAP: value = "Fill Alpha Map"; break;
-	case PARTS_CP_DRAW_CUT_CG: value = "Draw Cut CG"; break;
-	case PARTS_CP_COPY_CUT_CG: value = "Copy Cut CG"; break;
-	case PARTS_CP_DRAW_TEXT: value = "Draw Text"; break;
-	case PARTS_CP_COPY_TEXT: value = "Copy Text"; break;
-	case PARTS_CP_INVALID: value = "<invalid>"; break;
+	case PARTS_CP_CREATE: node(n).value = "Create"; break;
+	case PARTS_CP_CREATE_PIXEL_ONLY: node(n).value = "Create (Pixel Only)"; break;
+	case PARTS_CP_CG: node(n).value = "CG"; break;
+	case PARTS_CP_FILL: node(n).value = "Fill"; break;
+	case PARTS_CP_FILL_ALPHA_COLOR: node(n).value = "Fill Alpha Color"; break;
+	case PARTS_CP_FILL_AMAP: node(n).value = "Fill Alpha Map"; break;
+	case PARTS_CP_DRAW_CUT_CG: node(n).value = "Draw Cut CG"; break;
+	case PARTS_CP_COPY_CUT_CG: node(n).value = "Copy Cut CG"; break;
+	case PARTS_CP_DRAW_TEXT: node(n).value = "Draw Text"; break;
+	case PARTS_CP_COPY_TEXT: node(n).value = "Copy Text"; break;
+	case PARTS_CP_INVALID: node(n).value = "<invalid>"; break;
 	}
 	switch (op.type) {
 	case PARTS_CP_CREATE:
 	case PARTS_CP_CREATE_PIXEL_ONLY:
-		children.append(new EntityNode("Width", op.data.create.width, this));
-		children.append(new EntityNode("Height", op.data.create.height, this));
+		add(n, "Width", op.data.create.width);
+		add(n, "Height", op.data.create.height);
 		break;
 	case PARTS_CP_CG:
-		children.append(new EntityNode("No", op.data.cg.no, this));
+		add(n, "No", op.data.cg.no);
 		break;
 	case PARTS_CP_FILL:
 	case PARTS_CP_FILL_ALPHA_COLOR:
 	case PARTS_CP_FILL_AMAP:
-		children.append(new EntityNode("Rectangle", op.data.fill.rect.toString(), this));
-		children.append(new EntityNode("Color", op.data.fill.color.toString(), this));
+		add(n, "Rectangle", op.data.fill.rect.toString());
+		add(n, "Color", op.data.fill.color.toString());
 		break;
 	case PARTS_CP_DRAW_CUT_CG:
 	case PARTS_CP_COPY_CUT_CG:
-		children.append(new EntityNode("CG No", op.data.cutCg.cgNo, this));
-		children.append(new EntityNode("Destination", op.data.cutCg.dst.toString(), this));
-		children.append(new EntityNode("Source", op.data.cutCg.src.toString(), this));
-		children.append(new EntityNode("Interpolation Type", op.data.cutCg.interpType, this));
+		add(n, "CG No", op.data.cutCg.cgNo);
+		add(n, "Destination", op.data.cutCg.dst.toString());
+		add(n, "Source", op.data.cutCg.src.toString());
+		add(n, "Interpolation Type", op.data.cutCg.interpType);
 		break;
 	case PARTS_CP_DRAW_TEXT:
 	case PARTS_CP_COPY_TEXT:
-		children.append(new EntityNode("Text", op.data.text.text, this));
-		children.append(new EntityNode("Position", op.data.text.pos.toString(), this));
-		children.append(new EntityNode("Line Space", op.data.text.lineSpace, this));
-		children.append(new EntityNode("Style", op.data.text.style, this));
+		add(n, "Text", op.data.text.text);
+		add(n, "Position", op.data.text.pos.toString());
+		add(n, "Line Space", op.data.text.lineSpace);
+		add(n, "Style", op.data.text.style);
 		break;
 	case PARTS_CP_INVALID:
 		break;
 	}
 }
 
-EntityNode::EntityNode(QString name, const PartsParams &p, EntityNode *parentNode)
-	: parent(parentNode)
-	, name(name)
+void EntityModel::add(int parent, QString name, const PartsParams &p)
 {
-	children.append(new EntityNode("Z", p.z, this));
-	children.append(new EntityNode("Position", p.pos.toString(), this));
-	children.append(new EntityNode("Show", p.show, this));
-	children.append(new EntityNode("Alpha", p.alpha, this));
-	children.append(new EntityNode("Scale", p.scale.toString(), this));
-	children.append(new EntityNode("Rotation", p.rotation.toString(), this));
-	children.append(new EntityNode("Add Color", p.addColor.toString(), this));
-	children.append(new EntityNode("Multiply Color", p.mulColor.toString(), this));
+	int n = addNode(parent, EntityNode { name, QVariant() });
+	add(n, "Z", p.z);
+	add(n, "Position", p.pos.toString());
+	add(n, "Show", p.show);
+	add(n, "Alpha", p.alpha);
+	add(n, "Scale", p.scale.toString());
+	add(n, "Rotation", p.rotation.toString());
+	add(n, "Add Color", p.addColor.toString());
+	add(n, "Multiply Color", p.mulColor.toString());
 }
 
-EntityNode::EntityNode(QString name, const PartsMotion &m, EntityNode *parentNode)
-	: parent(parentNode)
-	, name(name)
+void EntityModel::add(int parent, QString name, const PartsMotion &m)
 {
+	int n = addNode(parent, EntityNode { name, QVariant() });
 	switch (m.type) {
-	case PARTS_MOTION_POS: value = "Position"; break;
-	case PARTS_MOTION_VIBRATION_SIZE: value = "Vibration Size"; break;
-	case PARTS_MOTION_ALPHA: value = "Alpha"; break;
-	case PARTS_MOTION_CG: value = "CG"; break;
-	case PARTS_MOTION_NUMERAL_NUMBER: value = "Numeral Number"; break;
-	case PARTS_MOTION_HGAUGE_RATE: value = "HGauge Rate"; break;
-	case PARTS_MOTION_VGAUGE_RATE: value = "VGauge Rate"; break;
-	case PARTS_MOTION_MAG_X: value = "X-Magnitude"; break;
-	case PARTS_MOTION_MAG_Y: value = "Y-Magnitude"; break;
-	case PARTS_MOTION_ROTATE_X: value = "X-Rotation"; break;
-	case PARTS_MOTION_ROTATE_Y: value = "Y-Rotation"; break;
-	case PARTS_MOTION_ROTATE_Z: value = "Z-Rotation"; break;
-	case PARTS_MOTION_INVALID: value = "<invalid>"; return;
+	case PARTS_MOTION_POS: node(n).value = "Position"; break;
+	case PARTS_MOTION_VIBRATION_SIZE: node(n).value = "Vibration Size"; break;
+	case PARTS_MOTION_ALPHA: node(n).value = "Alpha"; break;
+	case PARTS_MOTION_CG: node(n).value = "CG"; break;
+	case PARTS_MOTION_NUMERAL_NUMBER: node(n).value = "Numeral Number"; break;
+	case PARTS_MOTION_HGAUGE_RATE: node(n).value = "HGauge Rate"; break;
+	case PARTS_MOTION_VGAUGE_RATE: node(n).value = "VGauge Rate"; break;
+	case PARTS_MOTION_MAG_X: node(n).value = "X-Magnitude"; break;
+	case PARTS_MOTION_MAG_Y: node(n).value = "Y-Magnitude"; break;
+	case PARTS_MOTION_ROTATE_X: node(n).value = "X-Rotation"; break;
+	case PARTS_MOTION_ROTATE_Y: node(n).value = "Y-Rotation"; break;
+	case PARTS_MOTION_ROTATE_Z: node(n).value = "Z-Rotation"; break;
+	case PARTS_MOTION_INVALID: node(n).value = "<invalid>"; return;
 	}
 	switch (m.type) {
 	case PARTS_MOTION_POS:
 	case PARTS_MOTION_VIBRATION_SIZE:
-		children.append(new EntityNode("Begin", m.begin.pos.toString(), this));
-		children.append(new EntityNode("End", m.end.pos.toString(), this));
+		add(n, "Begin", m.begin.pos.toString());
+		add(n, "End", m.end.pos.toString());
 		break;
 	case PARTS_MOTION_ALPHA:
 	case PARTS_MOTION_CG:
 	case PARTS_MOTION_NUMERAL_NUMBER:
-		children.append(new EntityNode("Begin", m.begin.i, this));
-		children.append(new EntityNode("End", m.end.i, this));
+		add(n, "Begin", m.begin.i);
+		add(n, "End", m.end.i);
 		break;
 	case PARTS_MOTION_HGAUGE_RATE:
 	case PARTS_MOTION_VGAUGE_RATE:
@@ -579,38 +457,35 @@ EntityNode::EntityNode(QString name, const PartsMotion &m, EntityNode *parentNod
 	case PARTS_MOTION_ROTATE_X:
 	case PARTS_MOTION_ROTATE_Y:
 	case PARTS_MOTION_ROTATE_Z:
-		children.append(new EntityNode("Begin", m.begin.f, this));
-		children.append(new EntityNode("End", m.end.f, this));
+		add(n, "Begin", m.begin.f);
+		add(n, "End", m.end.f);
 		break;
 	case PARTS_MOTION_INVALID:
 		break;
 	}
-	children.append(new EntityNode("Begin Time", m.beginTime, this));
-	children.append(new EntityNode("End Time", m.endTime, this));
+	add(n, "Begin Time", m.beginTime);
+	add(n, "End Time", m.endTime);
 }
 
-EntityNode::EntityNode(QString name, QVariant value, EntityNode *parentNode)
-	: parent(parentNode)
-	, name(name)
-	, value(value)
+int EntityModel::add(int parent, QString name, QVariant value)
 {
+	return addNode(parent, EntityNode { name, value });
 }
 
 EntityModel::EntityModel(const SceneEntity &e, QObject *parent)
-	: QAbstractItemModel(parent)
+	: TreeModel(parent)
 {
-	rootNode = new EntityNode(e);
+	loadEntity(e);
 }
 
 EntityModel::EntityModel(const Parts &p, QObject *parent)
-	: QAbstractItemModel(parent)
+	: TreeModel(parent)
 {
-	rootNode = new EntityNode(p);
+	loadPartsParams(ROOT, p);
 }
 
 EntityModel::~EntityModel()
 {
-	delete rootNode;
 }
 
 QVariant EntityModel::data(const QModelIndex &index, int role) const
@@ -620,10 +495,10 @@ QVariant EntityModel::data(const QModelIndex &index, int role) const
 	if (role != Qt::DisplayRole)
 		return QVariant();
 
-	EntityNode *node = static_cast<EntityNode*>(index.internalPointer());
+	const EntityNode &n = node(nodeId(index));
 	switch (index.column()) {
-	case 0: return node->name;
-	case 1: return node->value;
+	case 0: return n.name;
+	case 1: return n.value;
 	}
 	return QVariant();
 }
@@ -644,50 +519,6 @@ QVariant EntityModel::headerData(int section, Qt::Orientation orientation,
 	return QVariant();
 }
 
-QModelIndex EntityModel::index(int row, int column, const QModelIndex &parent) const
-{
-	if (!hasIndex(row, column, parent))
-		return QModelIndex();
-
-	EntityNode *parentNode;
-	if (!parent.isValid())
-		parentNode = rootNode;
-	else
-		parentNode = static_cast<EntityNode*>(parent.internalPointer());
-
-	if (row < 0 || row >= parentNode->children.count())
-		return QModelIndex();
-	return createIndex(row, column, parentNode->children.at(row));
-}
-
-QModelIndex EntityModel::parent(const QModelIndex &index) const
-{
-	if (!index.isValid())
-		return QModelIndex();
-
-	EntityNode *childNode = static_cast<EntityNode*>(index.internalPointer());
-	EntityNode *parentNode = childNode->parent;
-
-	if (parentNode == rootNode)
-		return QModelIndex();
-
-	return createIndex(parentNode->row(), 0, parentNode);
-}
-
-int EntityModel::rowCount(const QModelIndex &parent) const
-{
-	if (parent.column() > 0)
-		return 0;
-
-	EntityNode *parentNode;
-	if (!parent.isValid())
-		parentNode = rootNode;
-	else
-		parentNode = static_cast<EntityNode*>(parent.internalPointer());
-
-	return parentNode->children.count();
-}
-
 int EntityModel::columnCount(const QModelIndex &parent) const
 {
 	return 2;
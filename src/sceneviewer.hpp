@@ -17,16 +17,16 @@
 #ifndef XSYS4DBG_SCENEVIEWER_HPP
 #define XSYS4DBG_SCENEVIEWER_HPP
 
-#include <QAbstractTableModel>
+#include <QPixmap>
 #include <QSplitter>
 #include <QVector>
 
+#include "treemodel.hpp"
 #include "xsystem4.hpp"
 
 class QScrollArea;
 class QTableView;
 class QTreeView;
-class QPixmap;
 
 class SceneViewer : public QSplitter
 {
@@ -47,32 +47,50 @@ private:
 	int sceneId = 0;
 };
 
-struct SceneNode;
+struct SceneNode
+{
+	enum SceneNodeType {
+		ROOT,
+		ENTITY,
+		PARTS,
+	} type;
+	union {
+		SceneEntity *entity;
+		Parts *parts;
+	} data;
+
+	QPixmap image;
+
+	explicit SceneNode(SceneNodeType t = ROOT) : type(t) { data.entity = nullptr; }
+};
 
-class SceneTreeModel : public QAbstractItemModel
+class SceneTreeModel : public TreeModel<SceneNode>
 {
 	Q_OBJECT
 public:
 	explicit SceneTreeModel(const QVector<SceneEntity> &entityList, QObject *parent = nullptr);
 	~SceneTreeModel();
 
+	SceneNode &sceneNode(const QModelIndex &index);
+
 	QVariant data(const QModelIndex &index, int role) const override;
 	Qt::ItemFlags flags(const QModelIndex &index) const override;
 	QVariant headerData(int section, Qt::Orientation orientation,
 			int role = Qt::DisplayRole) const override;
-	QModelIndex index(int row, int column,
-			const QModelIndex &parent = QModelIndex()) const override;
-	QModelIndex parent(const QModelIndex &index) const override;
-	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
 private:
+	void addParts(int parent, Parts *p);
+
 	QVector<SceneEntity> entities;
-	SceneNode *rootNode;
 };
 
-struct EntityNode;
+struct EntityNode
+{
+	QString name;
+	QVariant value;
+};
 
-class EntityModel : public QAbstractItemModel
+class EntityModel : public TreeModel<EntityNode>
 {
 	Q_OBJECT
 public:
@@ -84,13 +102,18 @@ public:
 	Qt::ItemFlags flags(const QModelIndex &index) const override;
 	QVariant headerData(int section, Qt::Orientation orientation,
 			int role = Qt::DisplayRole) const override;
-	QModelIndex index(int row, int column,
-			const QModelIndex &parent = QModelIndex()) const override;
-	QModelIndex parent(const QModelIndex &index) const override;
-	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
 private:
-	EntityNode *rootNode;
+	void loadEntity(const SceneEntity &e);
+	void loadSpriteParams(int n, const struct Sprite &sp);
+	void loadPartsParams(int n, const Parts &p);
+	void add(int parent, QString name, const PartsState &s);
+	void add(int parent, QString name, const PartsTextLine &line);
+	void add(int parent, QString name, const TextStyle &ts);
+	void add(int parent, QString name, const PartsCpOp &op);
+	void add(int parent, QString name, const PartsParams &p);
+	void add(int parent, QString name, const PartsMotion &m);
+	int add(int parent, QString name, QVariant value);
 };
 
 #endif
@@ -0,0 +1,467 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <ctype.h>
+#include <iterator>
+#include <string.h>
+#include <QHash>
+#include <QRegularExpression>
+
+#include "aintext.hpp"
+#include "cachefile.hpp"
+#include "searchindex.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+#include "system4/instructions.h"
+#include "system4/string.h"
+}
+
+static inline quint32 fold(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return (quint32)(c - 'A' + 'a');
+	return (quint32)(uchar)c;
+}
+
+// distinct (case-folded) trigrams of `len` bytes at `s`, sorted
+static void extract_trigrams(const char *s, int len, QVector<quint32> &out)
+{
+	out.clear();
+	for (int i = 0; i + 2 < len; i++) {
+		out.append(fold(s[i]) << 16 | fold(s[i+1]) << 8 | fold(s[i+2]));
+	}
+	std::sort(out.begin(), out.end());
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+const char *SearchIndex::documentText(int doc, int *len) const
+{
+	const XrefIndex::Target &t = targets[doc];
+	const char *text = "";
+	switch (t.kind) {
+	case XrefIndex::FUNCTION: text = ain->functions[t.no].name; break;
+	case XrefIndex::GLOBAL: text = ain->globals[t.no].name; break;
+	case XrefIndex::STRUCT: text = ain->structures[t.no].name; break;
+	case XrefIndex::DELEGATE: text = ain->delegates[t.no].name; break;
+	case XrefIndex::LIBRARY: text = ain->libraries[t.no].name; break;
+	case XrefIndex::LIBRARY_FUNCTION:
+		text = ain->libraries[t.lib].functions[t.no].name;
+		break;
+	case XrefIndex::SYSCALL: text = syscalls[t.no].name; break;
+	case XrefIndex::STRING:
+		*len = ain->strings[t.no]->size;
+		return ain->strings[t.no]->text;
+	case XrefIndex::MESSAGE:
+		*len = ain->messages[t.no]->size;
+		return ain->messages[t.no]->text;
+	default: break;
+	}
+	*len = strlen(text);
+	return text;
+}
+
+static inline bool sjis_lead(uchar c)
+{
+	return (c >= 0x81 && c <= 0x9f) || (c >= 0xe0 && c <= 0xfc);
+}
+
+// true if SJIS `text` contains `needle` starting at a character boundary
+static bool sjis_contains(const char *text, int len, const QByteArray &needle)
+{
+	int n = needle.size();
+	for (int i = 0; i + n <= len; i += sjis_lead(text[i]) ? 2 : 1) {
+		if (text[i] == needle[0] && !memcmp(text + i, needle.constData(), n))
+			return true;
+	}
+	return false;
+}
+
+QString SearchIndex::text(int doc) const
+{
+	int len;
+	return sjis_decode(documentText(doc, &len));
+}
+
+bool SearchIndex::build(struct ain *ain, const std::atomic<bool> *cancel)
+{
+	this->ain = ain;
+	for (int i = 0; i < ain->nr_functions; i++) {
+		targets.append({ XrefIndex::FUNCTION, i, -1 });
+	}
+	for (int i = 0; i < ain->nr_globals; i++) {
+		targets.append({ XrefIndex::GLOBAL, i, -1 });
+	}
+	for (int i = 0; i < ain->nr_structures; i++) {
+		targets.append({ XrefIndex::STRUCT, i, -1 });
+	}
+	for (int i = 0; i < ain->nr_delegates; i++) {
+		targets.append({ XrefIndex::DELEGATE, i, -1 });
+	}
+	for (int i = 0; i < ain->nr_libraries; i++) {
+		targets.append({ XrefIndex::LIBRARY, i, -1 });
+		for (int f = 0; f < ain->libraries[i].nr_functions; f++) {
+			targets.append({ XrefIndex::LIBRARY_FUNCTION, f, i });
+		}
+	}
+	for (int i = 0; i < NR_SYSCALLS; i++) {
+		if (syscalls[i].name)
+			targets.append({ XrefIndex::SYSCALL, i, -1 });
+	}
+	for (int i = 0; i < ain->nr_strings; i++) {
+		targets.append({ XrefIndex::STRING, i, -1 });
+	}
+	for (int i = 0; i < ain->nr_messages; i++) {
+		targets.append({ XrefIndex::MESSAGE, i, -1 });
+	}
+
+	// count documents per trigram
+	QHash<quint32, int> count;
+	QVector<quint32> docTrigrams;
+	for (int doc = 0; doc < targets.size(); doc++) {
+		int len;
+		const char *text = documentText(doc, &len);
+		extract_trigrams(text, len, docTrigrams);
+		for (quint32 t : docTrigrams) {
+			count[t]++;
+		}
+	}
+	if (cancel && *cancel)
+		return false;
+
+	trigrams = count.keys().toVector();
+	std::sort(trigrams.begin(), trigrams.end());
+	offsets.resize(trigrams.size() + 1);
+	offsets[0] = 0;
+	for (int i = 0; i < trigrams.size(); i++) {
+		offsets[i+1] = offsets[i] + count[trigrams[i]];
+		// reuse the table to map trigrams to their slot
+		count[trigrams[i]] = offsets[i];
+	}
+
+	// fill posting lists (documents are visited in order, so each list is
+	// sorted)
+	postings.resize(offsets.last());
+	for (int doc = 0; doc < targets.size(); doc++) {
+		int len;
+		const char *text = documentText(doc, &len);
+		extract_trigrams(text, len, docTrigrams);
+		for (quint32 t : docTrigrams) {
+			postings[count[t]++] = doc;
+		}
+	}
+	return !(cancel && *cancel);
+}
+
+qint64 SearchIndex::memoryUsage() const
+{
+	return (qint64)(offsets.size() + postings.size()) * sizeof(int)
+		+ (qint64)targets.size() * sizeof(XrefIndex::Target)
+		+ (qint64)trigrams.size() * sizeof(quint32);
+}
+
+void SearchIndex::save(CacheWriter &out) const
+{
+	out.writeArray(targets);
+	out.writeArray(trigrams);
+	out.writeArray(offsets);
+	out.writeArray(postings);
+}
+
+// true if `offsets` are a valid CSR index into an array of `size` elements
+static bool valid_offsets(const QVector<int> &offsets, int size)
+{
+	if (offsets.isEmpty() || offsets.first() != 0 || offsets.last() != size)
+		return false;
+	for (int i = 1; i < offsets.size(); i++) {
+		if (offsets[i-1] > offsets[i])
+			return false;
+	}
+	return true;
+}
+
+// true if `t` is a document that build() could have produced for `ain`
+static bool valid_target(struct ain *ain, const XrefIndex::Target &t)
+{
+	if (t.no < 0)
+		return false;
+	switch (t.kind) {
+	case XrefIndex::FUNCTION: return t.no < ain->nr_functions;
+	case XrefIndex::GLOBAL: return t.no < ain->nr_globals;
+	case XrefIndex::STRUCT: return t.no < ain->nr_structures;
+	case XrefIndex::DELEGATE: return t.no < ain->nr_delegates;
+	case XrefIndex::LIBRARY: return t.no < ain->nr_libraries;
+	case XrefIndex::LIBRARY_FUNCTION:
+		return t.lib >= 0 && t.lib < ain->nr_libraries
+			&& t.no < ain->libraries[t.lib].nr_functions;
+	case XrefIndex::SYSCALL: return t.no < NR_SYSCALLS && syscalls[t.no].name;
+	case XrefIndex::STRING: return t.no < ain->nr_strings;
+	case XrefIndex::MESSAGE: return t.no < ain->nr_messages;
+	default: return false;
+	}
+}
+
+bool SearchIndex::load(CacheReader &in, struct ain *ain)
+{
+	this->ain = ain;
+	if (!in.readArray(&targets) || !in.readArray(&trigrams) || !in.readArray(&offsets)
+			|| !in.readArray(&postings))
+		return false;
+	if (offsets.size() != trigrams.size() + 1 || !valid_offsets(offsets, postings.size()))
+		return false;
+	// candidates() binary searches the trigrams
+	for (int i = 1; i < trigrams.size(); i++) {
+		if (trigrams[i-1] >= trigrams[i])
+			return false;
+	}
+	for (const XrefIndex::Target &t : targets) {
+		if (!valid_target(ain, t))
+			return false;
+	}
+	for (int doc : postings) {
+		if (doc < 0 || doc >= targets.size())
+			return false;
+	}
+	return true;
+}
+
+// Documents that contain all trigrams of `literal` (all documents if it is
+// too short to have any).
+QVector<int> SearchIndex::candidates(const QByteArray &literal) const
+{
+	QVector<quint32> queryTrigrams;
+	extract_trigrams(literal.constData(), literal.size(), queryTrigrams);
+	if (queryTrigrams.isEmpty()) {
+		QVector<int> all(targets.size());
+		for (int i = 0; i < all.size(); i++)
+			all[i] = i;
+		return all;
+	}
+
+	// posting lists, shortest first
+	struct List { const int *begin; const int *end; };
+	QVector<List> lists;
+	for (quint32 t : queryTrigrams) {
+		auto it = std::lower_bound(trigrams.begin(), trigrams.end(), t);
+		if (it == trigrams.end() || *it != t)
+			return QVector<int>();
+		int i = it - trigrams.begin();
+		lists.append({ postings.constData() + offsets[i], postings.constData() + offsets[i+1] });
+	}
+	std::sort(lists.begin(), lists.end(), [](const List &a, const List &b) {
+		return a.end - a.begin < b.end - b.begin;
+	});
+
+	QVector<int> result;
+	result.reserve(lists[0].end - lists[0].begin);
+	for (const int *p = lists[0].begin; p != lists[0].end; p++)
+		result.append(*p);
+	for (int i = 1; i < lists.size() && !result.isEmpty(); i++) {
+		QVector<int> next;
+		std::set_intersection(result.begin(), result.end(), lists[i].begin, lists[i].end,
+				std::back_inserter(next));
+		result = next;
+	}
+	return result;
+}
+
+// Index just past the `close` that ends the group opened at `i`, or -1.
+static int skip_to(const QString &pattern, int i, QChar close)
+{
+	int end = pattern.indexOf(close, i);
+	return end < 0 ? -1 : end + 1;
+}
+
+/*
+ * Index just past the escape sequence whose letter or digit is at `i`
+ * (following the backslash), or -1 if it isn't understood.
+ */
+static int skip_escape(const QString &pattern, int i)
+{
+	auto at = [&pattern](int j) { return j < pattern.size() ? pattern[j] : QChar(); };
+	QChar c = pattern[i++];
+	switch (c.unicode()) {
+	case 'x':
+		// \x{...} or up to two hex digits
+		if (at(i) == '{')
+			return skip_to(pattern, i, '}');
+		for (int n = 0; n < 2 && isxdigit((uchar)at(i).toLatin1()); n++)
+			i++;
+		return i;
+	case 'o':
+		return at(i) == '{' ? skip_to(pattern, i, '}') : -1;
+	case 'p':
+	case 'P':
+		if (at(i) == '{')
+			return skip_to(pattern, i, '}');
+		return i < pattern.size() ? i + 1 : -1;
+	case 'c':
+		return i < pattern.size() ? i + 1 : -1;
+	case 'g':
+	case 'k':
+	case 'N':
+	case 'Q':
+	case 'E':
+		// references, names and quoting: too many forms
+		return -1;
+	}
+	if (c.isDigit()) {
+		// octal (\0nn) or a backreference
+		while (at(i).isDigit())
+			i++;
+		return i;
+	}
+	// \w, \d, \b, \n, ...
+	return i;
+}
+
+// Index just past the character class opened at `i`, or -1.
+static int skip_class(const QString &pattern, int i)
+{
+	i++;
+	if (i < pattern.size() && pattern[i] == '^')
+		i++;
+	// a leading ']' is a member
+	if (i < pattern.size() && pattern[i] == ']')
+		i++;
+	while (i < pattern.size()) {
+		QChar c = pattern[i];
+		if (c == ']')
+			return i + 1;
+		// POSIX classes ([:alpha:]) would need their own parsing
+		if (c == '[')
+			return -1;
+		i += c == '\\' ? 2 : 1;
+	}
+	return -1;
+}
+
+/*
+ * A substring that every match of `pattern` must contain (or an empty
+ * string if none can be determined cheaply). Anything not understood gives
+ * up rather than guess: a wrong literal would hide matches.
+ */
+static QString required_literal(const QString &pattern)
+{
+	// alternation and groups could make any part optional
+	if (pattern.contains('|') || pattern.contains('('))
+		return QString();
+
+	QString best, run;
+	auto flush = [&best, &run] {
+		if (run.size() > best.size())
+			best = run;
+		run.clear();
+	};
+	for (int i = 0; i < pattern.size(); i++) {
+		QChar c = pattern[i];
+		if (c == '\\') {
+			if (i + 1 >= pattern.size())
+				return QString();
+			QChar next = pattern[i+1];
+			if (!next.isLetterOrNumber()) {
+				// escaped punctuation is literal
+				run += next;
+				i++;
+				continue;
+			}
+			flush();
+			int end = skip_escape(pattern, i + 1);
+			if (end < 0)
+				return QString();
+			i = end - 1;
+			continue;
+		}
+		if (c == '?' || c == '*' || c == '{') {
+			// the preceding character is optional
+			if (!run.isEmpty())
+				run.chop(1);
+			flush();
+			if (c == '{') {
+				while (i < pattern.size() && pattern[i] != '}')
+					i++;
+			}
+			continue;
+		}
+		if (c == '[') {
+			flush();
+			int end = skip_class(pattern, i);
+			if (end < 0)
+				return QString();
+			i = end - 1;
+			continue;
+		}
+		if (QStringLiteral(".^$+").contains(c)) {
+			flush();
+			continue;
+		}
+		run += c;
+	}
+	flush();
+	return best;
+}
+
+// true if trigrams (which only fold ASCII) can't be used to filter `s`
+// case-insensitively
+static bool has_non_ascii_case(const QString &s)
+{
+	for (QChar c : s) {
+		if (c.unicode() >= 0x80 && c.toLower() != c.toUpper())
+			return true;
+	}
+	return false;
+}
+
+QVector<int> SearchIndex::search(const Query &query, QString *error) const
+{
+	QRegularExpression re;
+	QString literal = query.text;
+	if (query.regex) {
+		re.setPattern(query.text);
+		if (!query.caseSensitive)
+			re.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+		if (!re.isValid()) {
+			if (error)
+				*error = re.errorString();
+			return QVector<int>();
+		}
+		literal = required_literal(query.text);
+	}
+
+	QByteArray filter = sjis_encode(literal);
+	if (!query.caseSensitive && has_non_ascii_case(literal))
+		filter.clear();
+
+	Qt::CaseSensitivity cs = query.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+	QVector<int> result;
+	if (!query.regex && query.caseSensitive && !filter.isEmpty()) {
+		// compare the raw SJIS text; nothing needs decoding
+		for (int doc : candidates(filter)) {
+			int len;
+			const char *text = documentText(doc, &len);
+			if (sjis_contains(text, len, filter))
+				result.append(doc);
+		}
+		return result;
+	}
+	for (int doc : candidates(filter)) {
+		QString t = text(doc);
+		if (query.regex ? re.match(t).hasMatch() : t.contains(query.text, cs))
+			result.append(doc);
+	}
+	return result;
+}
@@ -0,0 +1,86 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_SEARCH_INDEX_HPP
+#define XSYS4DBG_SEARCH_INDEX_HPP
+
+#include <atomic>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "xrefindex.hpp"
+
+struct ain;
+class CacheReader;
+class CacheWriter;
+
+/*
+ * Trigram index over the text that operands refer to: the string and
+ * message pools and the names of functions, globals, structs, delegates,
+ * libraries, library functions and syscalls. Each of these is a document,
+ * identified by its xref target, so a match maps to the instructions using
+ * it through the XrefIndex.
+ *
+ * Documents are indexed in place, as the SJIS bytes stored in the .ain
+ * (see ain_open_lazy()), so the index holds no copy of the text. Trigrams
+ * are taken over those bytes with ASCII case folded; the query is encoded
+ * to SJIS to look up candidates, which are verified against it after
+ * intersecting the posting lists: case-sensitive substrings on the raw
+ * SJIS bytes, anything else (case folding, regular expressions) on the
+ * decoded text.
+ */
+class SearchIndex
+{
+public:
+	struct Query {
+		QString text;
+		bool regex;
+		bool caseSensitive;
+	};
+
+	// Returns false if cancelled.
+	bool build(struct ain *ain, const std::atomic<bool> *cancel);
+	void save(CacheWriter &out) const;
+	// Load what save() wrote for `ain`. Returns false if the data is
+	// invalid.
+	bool load(CacheReader &in, struct ain *ain);
+
+	// Documents matching `query`, in document order. Sets `error` if the
+	// query is an invalid regular expression.
+	QVector<int> search(const Query &query, QString *error = nullptr) const;
+
+	int nrDocuments() const { return targets.size(); }
+	const XrefIndex::Target &target(int doc) const { return targets[doc]; }
+	QString text(int doc) const;
+	// approximate size in bytes
+	qint64 memoryUsage() const;
+
+private:
+	// SJIS text of a document, in the .ain
+	const char *documentText(int doc, int *len) const;
+	QVector<int> candidates(const QByteArray &literal) const;
+
+	struct ain *ain = nullptr;
+	QVector<XrefIndex::Target> targets;
+
+	// posting lists in CSR form: documents containing trigrams[i] are
+	// postings[offsets[i] .. offsets[i+1])
+	QVector<quint32> trigrams;
+	QVector<int> offsets;
+	QVector<int> postings;
+};
+
+#endif
@@ -0,0 +1,256 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QElapsedTimer>
+#include <QtWidgets>
+#include "instructionprinter.hpp"
+#include "searchview.hpp"
+#include "symboltable.hpp"
+
+// number of rows added to the view per fetchMore()
+#define FETCH_BATCH_SIZE 1000
+
+// delay after typing before a search is run (ms)
+#define SEARCH_DELAY 250
+
+enum {
+	COLUMN_ADDRESS,
+	COLUMN_FUNCTION,
+	COLUMN_TEXT,
+	NR_COLUMNS
+};
+
+SearchModel::SearchModel(QSharedPointer<const CodeIndex> index,
+		QSharedPointer<const InstructionPrinter> printer,
+		const QVector<int> &documents, QObject *parent)
+	: QAbstractTableModel(parent)
+	, codeIndex(index)
+	, printer(printer)
+	, documents(documents)
+{
+	const SearchIndex &search = codeIndex->search();
+	rowStart.reserve(documents.size() + 1);
+	rowStart.append(0);
+	for (int doc : documents) {
+		int n = codeIndex->xrefs().refs(search.target(doc)).size();
+		rowStart.append(rowStart.last() + qMax(1, n));
+	}
+}
+
+int SearchModel::rowCount(const QModelIndex &parent) const
+{
+	if (parent.isValid())
+		return 0;
+	return loaded;
+}
+
+int SearchModel::columnCount(const QModelIndex &parent) const
+{
+	return NR_COLUMNS;
+}
+
+int SearchModel::instructionAt(int row, int *doc) const
+{
+	int i = std::upper_bound(rowStart.begin(), rowStart.end(), row) - rowStart.begin() - 1;
+	*doc = documents[i];
+	XrefIndex::Refs refs = codeIndex->xrefs().refs(codeIndex->search().target(*doc));
+	if (refs.size() == 0)
+		return -1;
+	return refs.begin[row - rowStart[i]];
+}
+
+qint64 SearchModel::address(int row) const
+{
+	int doc;
+	int i = instructionAt(row, &doc);
+	if (i < 0)
+		return -1;
+	return codeIndex->instructions()[i].address;
+}
+
+QVariant SearchModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid() || role != Qt::DisplayRole)
+		return QVariant();
+
+	int doc;
+	int i = instructionAt(index.row(), &doc);
+	if (i < 0) {
+		// unreferenced: show the matching text itself
+		if (index.column() == COLUMN_TEXT)
+			return codeIndex->search().text(doc);
+		if (index.column() == COLUMN_FUNCTION)
+			return tr("(unreferenced)");
+		return QVariant();
+	}
+
+	const CodeIndex::Instruction &instr = codeIndex->instructions()[i];
+	int fno = codeIndex->functionAt(instr.address);
+	switch (index.column()) {
+	case COLUMN_ADDRESS:
+		return QString("%1").arg((long)instr.address, 8, 16, (QChar)'0');
+	case COLUMN_FUNCTION: {
+		const QString *name = printer->symbolTable().function(fno);
+		return name ? *name : QString("?");
+	}
+	case COLUMN_TEXT:
+		return printer->toString(fno, instr);
+	}
+	return QVariant();
+}
+
+QVariant SearchModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QVariant();
+	switch (section) {
+	case COLUMN_ADDRESS: return tr("Address");
+	case COLUMN_FUNCTION: return tr("Function");
+	case COLUMN_TEXT: return tr("Instruction");
+	}
+	return QVariant();
+}
+
+bool SearchModel::canFetchMore(const QModelIndex &parent) const
+{
+	return !parent.isValid() && loaded < totalCount();
+}
+
+void SearchModel::fetchMore(const QModelIndex &parent)
+{
+	if (parent.isValid())
+		return;
+	int n = qMin(FETCH_BATCH_SIZE, totalCount() - loaded);
+	if (n <= 0)
+		return;
+	beginInsertRows(QModelIndex(), loaded, loaded + n - 1);
+	loaded += n;
+	endInsertRows();
+}
+
+SearchView::SearchView(QWidget *parent)
+	: QDockWidget(tr("Search"), parent)
+{
+	QWidget *widget = new QWidget;
+	QVBoxLayout *layout = new QVBoxLayout(widget);
+	layout->setContentsMargins(0, 0, 0, 0);
+
+	QHBoxLayout *inputLayout = new QHBoxLayout;
+	input = new QLineEdit;
+	input->setPlaceholderText(tr("Search strings, messages and names"));
+	input->setClearButtonEnabled(true);
+	regexCheck = new QCheckBox(tr("Regex"));
+	caseCheck = new QCheckBox(tr("Match case"));
+	inputLayout->addWidget(input);
+	inputLayout->addWidget(regexCheck);
+	inputLayout->addWidget(caseCheck);
+	layout->addLayout(inputLayout);
+
+	label = new QLabel;
+	layout->addWidget(label);
+
+	view = new QTreeView;
+	view->setRootIsDecorated(false);
+	view->setUniformRowHeights(true);
+	QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+	font.setFixedPitch(true);
+	font.setPointSize(10);
+	view->setFont(font);
+	layout->addWidget(view);
+	setWidget(widget);
+
+	// search as the user types (after a short pause)
+	timer = new QTimer(this);
+	timer->setSingleShot(true);
+	timer->setInterval(SEARCH_DELAY);
+	connect(timer, &QTimer::timeout, this, &SearchView::runQuery);
+	connect(input, &QLineEdit::textChanged, timer, QOverload<>::of(&QTimer::start));
+	connect(input, &QLineEdit::returnPressed, this, &SearchView::runQuery);
+	connect(regexCheck, &QCheckBox::toggled, this, &SearchView::runQuery);
+	connect(caseCheck, &QCheckBox::toggled, this, &SearchView::runQuery);
+
+	connect(view, &QTreeView::activated, this, [this](const QModelIndex &index) {
+		if (!model || !index.isValid())
+			return;
+		qint64 address = model->address(index.row());
+		if (address >= 0)
+			emit goToAddress(address);
+	});
+}
+
+void SearchView::setPrinter(QSharedPointer<const InstructionPrinter> p)
+{
+	printer = p;
+	codeIndex.reset();
+	clearResults();
+}
+
+void SearchView::clearResults()
+{
+	view->setModel(nullptr);
+	delete model;
+	model = nullptr;
+	label->clear();
+}
+
+void SearchView::setCodeIndex(QSharedPointer<const CodeIndex> index)
+{
+	codeIndex = index;
+	if (!input->text().isEmpty())
+		runQuery();
+}
+
+void SearchView::activate()
+{
+	show();
+	raise();
+	input->setFocus();
+	input->selectAll();
+}
+
+void SearchView::runQuery()
+{
+	timer->stop();
+	if (input->text().isEmpty()) {
+		clearResults();
+		return;
+	}
+	if (!printer)
+		return;
+	if (!codeIndex) {
+		label->setText(tr("Waiting for the code index..."));
+		return;
+	}
+
+	QElapsedTimer elapsed;
+	elapsed.start();
+	SearchIndex::Query query = { input->text(), regexCheck->isChecked(), caseCheck->isChecked() };
+	QString error;
+	QVector<int> documents = codeIndex->search().search(query, &error);
+	if (!error.isEmpty()) {
+		label->setText(tr("Invalid regular expression: %1").arg(error));
+		return;
+	}
+
+	SearchModel *old = model;
+	model = new SearchModel(codeIndex, printer, documents, this);
+	view->setModel(model);
+	delete old;
+
+	label->setText(tr("%1 results for %2 matching items (%3 ms)")
+			.arg(model->totalCount()).arg(documents.size()).arg(elapsed.elapsed()));
+	view->resizeColumnToContents(COLUMN_ADDRESS);
+}
@@ -0,0 +1,101 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_SEARCH_VIEW_HPP
+#define XSYS4DBG_SEARCH_VIEW_HPP
+
+#include <QAbstractTableModel>
+#include <QDockWidget>
+#include <QSharedPointer>
+#include "codeindex.hpp"
+
+class InstructionPrinter;
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QTimer;
+class QTreeView;
+
+/*
+ * Search results: one row per instruction referring to a matching
+ * document (or one row for a document that isn't referenced anywhere).
+ * Rows are handed to the view in batches through fetchMore().
+ */
+class SearchModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	SearchModel(QSharedPointer<const CodeIndex> index,
+			QSharedPointer<const InstructionPrinter> printer,
+			const QVector<int> &documents, QObject *parent = nullptr);
+
+	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation,
+			int role = Qt::DisplayRole) const override;
+	bool canFetchMore(const QModelIndex &parent) const override;
+	void fetchMore(const QModelIndex &parent) override;
+
+	int totalCount() const { return rowStart.last(); }
+	// address of the instruction at `row`, or -1 if the row is an
+	// unreferenced document
+	qint64 address(int row) const;
+
+private:
+	// instruction index of `row`, or -1; sets `doc` to the row's document
+	int instructionAt(int row, int *doc) const;
+
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
+	QVector<int> documents;
+	// first row of documents[i]
+	QVector<int> rowStart;
+	int loaded = 0;
+};
+
+class SearchView : public QDockWidget
+{
+	Q_OBJECT
+public:
+	SearchView(QWidget *parent = nullptr);
+
+	// Set the printer for a newly opened .ain (clears the results).
+	void setPrinter(QSharedPointer<const InstructionPrinter> printer);
+	void setCodeIndex(QSharedPointer<const CodeIndex> index);
+	// Show the panel and focus the search field.
+	void activate();
+
+signals:
+	void goToAddress(uint32_t address);
+
+private:
+	void runQuery();
+	void clearResults();
+
+	QSharedPointer<const CodeIndex> codeIndex;
+	QSharedPointer<const InstructionPrinter> printer;
+
+	QLineEdit *input;
+	QCheckBox *regexCheck;
+	QCheckBox *caseCheck;
+	QLabel *label;
+	QTreeView *view;
+	QTimer *timer;
+	SearchModel *model = nullptr;
+};
+
+#endif
@@ -16,6 +16,7 @@
 
 #include <QtWidgets>
 
+#include "gamecache.hpp"
 #include "settingsdialog.hpp"
 
 SettingsDialog::SettingsDialog(QWidget *parent)
@@ -46,8 +47,22 @@ GeneralTab::GeneralTab(QWidget *parent)
 	QSettings settings;
 	xsysPathEdit = new QLineEdit(settings.value("xsystem4/path", "xsystem4").toString());
 
+	// recent games are loaded and indexed in the background (see GameCache)
+	preloadCheck = new QCheckBox(tr("Preload recent games"));
+	preloadCheck->setChecked(settings.value("preload/enabled", false).toBool());
+	preloadBudgetSpin = new QSpinBox;
+	preloadBudgetSpin->setRange(64, 65536);
+	preloadBudgetSpin->setSingleStep(64);
+	preloadBudgetSpin->setSuffix(tr(" MiB"));
+	preloadBudgetSpin->setValue(settings.value("preload/budget",
+			GameCache::DEFAULT_BUDGET_MB).toInt());
+	preloadBudgetSpin->setEnabled(preloadCheck->isChecked());
+	connect(preloadCheck, &QCheckBox::toggled, preloadBudgetSpin, &QWidget::setEnabled);
+
 	QFormLayout *layout = new QFormLayout;
 	layout->addRow(tr("xsystem4 Path:"), xsysPathEdit);
+	layout->addRow(preloadCheck);
+	layout->addRow(tr("Preload Memory:"), preloadBudgetSpin);
 	setLayout(layout);
 }
 
@@ -57,4 +72,6 @@ void GeneralTab::writeSettings()
 	QSettings settings;
 	QString xsysPath = xsysPathEdit->text();
 	settings.setValue("xsystem4/path", xsysPath.isEmpty() ? "xsystem4" : xsysPath);
+	settings.setValue("preload/enabled", preloadCheck->isChecked());
+	settings.setValue("preload/budget", preloadBudgetSpin->value());
 }
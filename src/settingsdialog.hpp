@@ -19,8 +19,10 @@
 
 #include <QDialog>
 
+class QCheckBox;
 class QDialogButtonBox;
 class QLineEdit;
+class QSpinBox;
 class QTabWidget;
 
 class GeneralTab : public QWidget
@@ -32,6 +34,8 @@ public slots:
 	void writeSettings();
 private:
 	QLineEdit *xsysPathEdit;
+	QCheckBox *preloadCheck;
+	QSpinBox *preloadBudgetSpin;
 };
 
 class SettingsDialog : public QDialog
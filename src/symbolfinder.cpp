@@ -0,0 +1,131 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QtWidgets>
+#include "symbolfinder.hpp"
+#include "symbolindex.hpp"
+
+// number of results shown
+#define MAX_RESULTS 200
+
+static QString kind_name(XrefIndex::Kind kind)
+{
+	switch (kind) {
+	case XrefIndex::FUNCTION: return QObject::tr("function");
+	case XrefIndex::STRUCT: return QObject::tr("struct");
+	case XrefIndex::GLOBAL: return QObject::tr("global");
+	case XrefIndex::LIBRARY: return QObject::tr("library");
+	case XrefIndex::LIBRARY_FUNCTION: return QObject::tr("library function");
+	default: return QString();
+	}
+}
+
+SymbolFinder::SymbolFinder(QWidget *parent)
+	: QFrame(parent, Qt::Popup)
+{
+	setFrameStyle(QFrame::StyledPanel | QFrame::Raised);
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+	layout->setContentsMargins(4, 4, 4, 4);
+
+	input = new QLineEdit;
+	input->setPlaceholderText(tr("Go to function, struct, global or library"));
+	layout->addWidget(input);
+
+	list = new QTreeWidget;
+	list->setColumnCount(2);
+	list->setHeaderHidden(true);
+	list->setRootIsDecorated(false);
+	list->setUniformRowHeights(true);
+	list->setFocusPolicy(Qt::NoFocus);
+	list->header()->setStretchLastSection(false);
+	list->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+	list->header()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+	layout->addWidget(list);
+
+	connect(input, &QLineEdit::textChanged, this, &SymbolFinder::search);
+	connect(input, &QLineEdit::returnPressed, this, &SymbolFinder::activate);
+	connect(list, &QTreeWidget::itemActivated, this, &SymbolFinder::activate);
+	// arrow keys move through the results while typing
+	input->installEventFilter(this);
+}
+
+void SymbolFinder::setIndex(QSharedPointer<const SymbolIndex> i)
+{
+	index = i;
+	input->clear();
+	list->clear();
+}
+
+void SymbolFinder::popup(QWidget *over)
+{
+	if (!index)
+		return;
+	int width = qMin(over->width() * 2 / 3, 800);
+	resize(width, over->height() / 2);
+	QPoint pos = over->mapToGlobal(QPoint((over->width() - width) / 2, 0));
+	move(pos);
+
+	input->selectAll();
+	search(input->text());
+	show();
+	input->setFocus();
+}
+
+bool SymbolFinder::eventFilter(QObject *obj, QEvent *event)
+{
+	if (obj == input && event->type() == QEvent::KeyPress) {
+		QKeyEvent *key = static_cast<QKeyEvent*>(event);
+		switch (key->key()) {
+		case Qt::Key_Up:
+		case Qt::Key_Down:
+		case Qt::Key_PageUp:
+		case Qt::Key_PageDown:
+			QApplication::sendEvent(list, event);
+			return true;
+		}
+	}
+	return QFrame::eventFilter(obj, event);
+}
+
+void SymbolFinder::search(const QString &text)
+{
+	list->clear();
+	if (!index)
+		return;
+
+	QList<QTreeWidgetItem*> items;
+	for (const SymbolIndex::Match &m : index->find(text, MAX_RESULTS)) {
+		QTreeWidgetItem *item = new QTreeWidgetItem({ index->name(m.entry),
+				kind_name(index->target(m.entry).kind) });
+		item->setData(0, Qt::UserRole, m.entry);
+		item->setForeground(1, Qt::gray);
+		items.append(item);
+	}
+	list->addTopLevelItems(items);
+	if (!items.isEmpty())
+		list->setCurrentItem(items.first());
+}
+
+void SymbolFinder::activate()
+{
+	QTreeWidgetItem *item = list->currentItem();
+	if (!item || !index)
+		return;
+	int entry = item->data(0, Qt::UserRole).toInt();
+	hide();
+	emit symbolActivated(index->target(entry));
+}
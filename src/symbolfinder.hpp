@@ -0,0 +1,57 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_SYMBOL_FINDER_HPP
+#define XSYS4DBG_SYMBOL_FINDER_HPP
+
+#include <QFrame>
+#include <QSharedPointer>
+#include "xrefindex.hpp"
+
+class QLineEdit;
+class QTreeWidget;
+class SymbolIndex;
+
+/*
+ * Popup for jumping to a symbol by (fuzzy) name. Results are updated on
+ * every keystroke.
+ */
+class SymbolFinder : public QFrame
+{
+	Q_OBJECT
+public:
+	SymbolFinder(QWidget *parent = nullptr);
+
+	void setIndex(QSharedPointer<const SymbolIndex> index);
+	// Show the popup centered near the top of `over`.
+	void popup(QWidget *over);
+
+signals:
+	void symbolActivated(const XrefIndex::Target &target);
+
+protected:
+	bool eventFilter(QObject *obj, QEvent *event) override;
+
+private:
+	void search(const QString &text);
+	void activate();
+
+	QSharedPointer<const SymbolIndex> index;
+	QLineEdit *input;
+	QTreeWidget *list;
+};
+
+#endif
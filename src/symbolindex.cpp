@@ -0,0 +1,258 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <QScopedPointer>
+
+#include "cachefile.hpp"
+#include "symbolindex.hpp"
+#include "symboltable.hpp"
+
+// score components
+#define SCORE_MATCH        16
+#define SCORE_CONSECUTIVE  16
+#define SCORE_WORD_START   24
+#define PENALTY_GAP         1
+#define PENALTY_GAP_MAX    16
+
+// start positions tried per name when scoring
+#define MAX_STARTS 8
+
+// bit for character `c` (lower case) in a name mask
+static inline quint64 char_bit(QChar c)
+{
+	ushort u = c.unicode();
+	if (u >= 'a' && u <= 'z')
+		return 1ULL << (u - 'a');
+	if (u >= '0' && u <= '9')
+		return 1ULL << (26 + u - '0');
+	if (u == '_')
+		return 1ULL << 36;
+	if (u == '@')
+		return 1ULL << 37;
+	if (u == '.')
+		return 1ULL << 38;
+	if (u < 0x80)
+		return 1ULL << 39;
+	// everything else shares the remaining bits
+	return 1ULL << (40 + u % 24);
+}
+
+static quint64 char_mask(const QChar *s, int len)
+{
+	quint64 mask = 0;
+	for (int i = 0; i < len; i++) {
+		mask |= char_bit(s[i]);
+	}
+	return mask;
+}
+
+SymbolIndex::SymbolIndex(const SymbolTable &symbols)
+{
+	offsets.append(0);
+	for (int i = 0; i < symbols.nrFunctions(); i++) {
+		add(*symbols.function(i), { XrefIndex::FUNCTION, i, -1 });
+	}
+	for (int i = 0; i < symbols.nrStructures(); i++) {
+		add(*symbols.structure(i), { XrefIndex::STRUCT, i, -1 });
+	}
+	for (int i = 0; i < symbols.nrGlobals(); i++) {
+		add(*symbols.global(i), { XrefIndex::GLOBAL, i, -1 });
+	}
+	for (int i = 0; i < symbols.nrLibraries(); i++) {
+		const QString &lib = *symbols.library(i);
+		add(lib, { XrefIndex::LIBRARY, i, -1 });
+		for (int f = 0; f < symbols.nrLibraryFunctions(i); f++) {
+			add(lib + "." + *symbols.libraryFunction(i, f), { XrefIndex::LIBRARY_FUNCTION, f, i });
+		}
+	}
+}
+
+QString SymbolIndex::nameOf(const SymbolTable &symbols, const XrefIndex::Target &target)
+{
+	const QString *name = nullptr;
+	switch (target.kind) {
+	case XrefIndex::FUNCTION: name = symbols.function(target.no); break;
+	case XrefIndex::STRUCT: name = symbols.structure(target.no); break;
+	case XrefIndex::GLOBAL: name = symbols.global(target.no); break;
+	case XrefIndex::LIBRARY: name = symbols.library(target.no); break;
+	case XrefIndex::LIBRARY_FUNCTION: {
+		const QString *lib = symbols.library(target.lib);
+		const QString *f = symbols.libraryFunction(target.lib, target.no);
+		if (!lib || !f)
+			return QString();
+		return *lib + "." + *f;
+	}
+	default: break;
+	}
+	return name ? *name : QString();
+}
+
+void SymbolIndex::save(CacheWriter &out) const
+{
+	out.writeArray(targets);
+	out.writeStrings({ packed });
+	out.writeArray(offsets);
+	out.writeArray(masks);
+}
+
+SymbolIndex *SymbolIndex::load(CacheReader &in, const SymbolTable &symbols)
+{
+	QScopedPointer<SymbolIndex> index(new SymbolIndex);
+	QVector<QString> text;
+	if (!in.readArray(&index->targets) || !in.readStrings(&text)
+			|| !in.readArray(&index->offsets) || !in.readArray(&index->masks))
+		return nullptr;
+	int n = index->targets.size();
+	if (text.size() != 1 || index->offsets.size() != n + 1 || index->masks.size() != n)
+		return nullptr;
+	index->packed = text[0];
+	if (index->offsets[0] != 0 || index->offsets[n] != index->packed.size())
+		return nullptr;
+
+	// the names themselves are shared with the symbol table
+	index->names.reserve(n);
+	for (int i = 0; i < n; i++) {
+		if (index->offsets[i] > index->offsets[i+1])
+			return nullptr;
+		QString name = nameOf(symbols, index->targets[i]);
+		if (name.isNull())
+			return nullptr;
+		index->names.append(name);
+	}
+	return index.take();
+}
+
+void SymbolIndex::add(const QString &name, const XrefIndex::Target &target)
+{
+	names.append(name);
+	targets.append(target);
+	QString lower = name.toLower();
+	packed.append(lower);
+	offsets.append(packed.size());
+	masks.append(char_mask(lower.constData(), lower.size()));
+}
+
+static bool is_separator(QChar c)
+{
+	return c == '_' || c == '@' || c == '.' || c == ':' || c == '#' || c == ' ';
+}
+
+/*
+ * Score `entry` against the (lower-cased) query, or INT_MIN if the query
+ * isn't a subsequence of the name. Matches at word starts and runs of
+ * consecutive characters score higher; gaps and long names lower. A few
+ * start positions are tried, each matched greedily.
+ */
+int SymbolIndex::score(int entry, const QString &query) const
+{
+	const QChar *s = packed.constData() + offsets[entry];
+	int len = offsets[entry+1] - offsets[entry];
+	const QString &name = names[entry];
+	const QChar *q = query.constData();
+	int qlen = query.size();
+
+	// camelCase boundaries need the original case (lower-casing can
+	// change the length of some strings)
+	bool haveCase = name.size() == len;
+	auto wordStart = [s, &name, haveCase](int i) {
+		return i == 0 || is_separator(s[i-1])
+			|| (haveCase && name[i].isUpper() && name[i-1].isLower());
+	};
+
+	int best = INT_MIN;
+	int starts = 0;
+	for (int start = 0; start < len && starts < MAX_STARTS; start++) {
+		if (s[start] != q[0])
+			continue;
+		starts++;
+
+		int total = 0;
+		int qi = 0;
+		int prev = -1;
+		for (int i = start; i < len && qi < qlen; i++) {
+			if (s[i] != q[qi])
+				continue;
+			total += SCORE_MATCH;
+			if (prev >= 0 && i == prev + 1)
+				total += SCORE_CONSECUTIVE;
+			else if (prev >= 0)
+				total -= qMin(PENALTY_GAP * (i - prev - 1), PENALTY_GAP_MAX);
+			if (wordStart(i))
+				total += SCORE_WORD_START;
+			prev = i;
+			qi++;
+		}
+		if (qi < qlen)
+			break; // later starts can't match either
+		total -= len / 4;
+		best = qMax(best, total);
+	}
+	return best;
+}
+
+QVector<SymbolIndex::Match> SymbolIndex::find(const QString &text, int limit) const
+{
+	QString query = text.toLower();
+	query.remove(' ');
+
+	QVector<Match> matches;
+	if (query.isEmpty()) {
+		for (int i = 0; i < qMin(limit, names.size()); i++) {
+			matches.append({ i, 0 });
+		}
+		return matches;
+	}
+
+	// cheap rejection: names must contain every character of the query
+	quint64 qmask = char_mask(query.constData(), query.size());
+	const quint64 *m = masks.constData();
+	QVector<int> candidates;
+	for (int i = 0; i < masks.size(); i++) {
+		if ((m[i] & qmask) == qmask)
+			candidates.append(i);
+	}
+
+	for (int i : candidates) {
+		int sc = score(i, query);
+		if (sc != INT_MIN)
+			matches.append({ i, sc });
+	}
+
+	auto better = [](const Match &a, const Match &b) {
+		if (a.score != b.score)
+			return a.score > b.score;
+		return a.entry < b.entry;
+	};
+	if (matches.size() > limit) {
+		std::partial_sort(matches.begin(), matches.begin() + limit, matches.end(), better);
+		matches.resize(limit);
+	} else {
+		std::sort(matches.begin(), matches.end(), better);
+	}
+	return matches;
+}
+
+qint64 SymbolIndex::memoryUsage() const
+{
+	// names share their data with the symbol table
+	return (qint64)names.size() * sizeof(QString)
+		+ (qint64)targets.size() * sizeof(XrefIndex::Target)
+		+ (qint64)packed.size() * sizeof(QChar)
+		+ (qint64)offsets.size() * sizeof(int)
+		+ (qint64)masks.size() * sizeof(quint64);
+}
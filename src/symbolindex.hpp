@@ -0,0 +1,74 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_SYMBOL_INDEX_HPP
+#define XSYS4DBG_SYMBOL_INDEX_HPP
+
+#include <QString>
+#include <QVector>
+#include "xrefindex.hpp"
+
+class CacheReader;
+class CacheWriter;
+class SymbolTable;
+
+/*
+ * Fuzzy (subsequence) finder over function, struct, global, library and
+ * library function names. Lower-cased names are packed into one buffer,
+ * with a 64-bit mask of the characters each name contains; a query first
+ * rejects names missing any of its characters with a single AND per name,
+ * and only the survivors are matched and scored.
+ */
+class SymbolIndex
+{
+public:
+	SymbolIndex(const SymbolTable &symbols);
+
+	// Load what save() wrote for `symbols`. Returns nullptr if the data is
+	// invalid.
+	static SymbolIndex *load(CacheReader &in, const SymbolTable &symbols);
+	void save(CacheWriter &out) const;
+
+	struct Match {
+		int entry;
+		int score;
+	};
+
+	// Best `limit` matches for `query`, best first.
+	QVector<Match> find(const QString &query, int limit) const;
+
+	int size() const { return names.size(); }
+	const QString &name(int entry) const { return names[entry]; }
+	const XrefIndex::Target &target(int entry) const { return targets[entry]; }
+	// approximate size in bytes
+	qint64 memoryUsage() const;
+
+private:
+	SymbolIndex() {}
+	void add(const QString &name, const XrefIndex::Target &target);
+	// display name of `target`, or a null string if it doesn't exist
+	static QString nameOf(const SymbolTable &symbols, const XrefIndex::Target &target);
+	int score(int entry, const QString &query) const;
+
+	QVector<QString> names;
+	QVector<XrefIndex::Target> targets;
+	// lower-cased names, concatenated; entry i is [offsets[i], offsets[i+1])
+	QString packed;
+	QVector<int> offsets;
+	QVector<quint64> masks;
+};
+
+#endif
@@ -0,0 +1,378 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include <QHash>
+#include <QMutexLocker>
+#include <QScopedPointer>
+#include <QSet>
+#include <string.h>
+
+#include "aintext.hpp"
+#include "cachefile.hpp"
+#include "symboltable.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+#include "system4/string.h"
+}
+
+namespace {
+
+/*
+ * Interns names while building the tables: identifiers repeat a lot (every
+ * function has its own "this", loop counters, etc.), so equal names share
+ * one QString.
+ */
+class Interner
+{
+public:
+	QString get(const char *str)
+	{
+		QByteArray key = QByteArray::fromRawData(str, strlen(str));
+		auto it = pool.constFind(key);
+		if (it != pool.constEnd())
+			return it.value();
+		QString s = sjis_decode(str);
+		// fromRawData doesn't own str; store a deep copy as the key
+		pool.insert(QByteArray(str), s);
+		return s;
+	}
+
+private:
+	QHash<QByteArray, QString> pool;
+};
+
+// Adds "#n" suffixes to names that are repeated within one namespace.
+class Disambiguator
+{
+public:
+	QString get(Interner &interner, const char *name)
+	{
+		int dup_no = seen[name]++;
+		if (!dup_no)
+			return interner.get(name);
+		return QString("%1#%2").arg(sjis_decode(name)).arg(dup_no);
+	}
+
+private:
+	QHash<QByteArray, int> seen;
+};
+
+}
+
+// number of decoded string/message literals kept in memory
+#define LITERAL_CACHE_SIZE 4096
+
+static char escape_char(QChar c)
+{
+	switch (c.unicode()) {
+	case '\\': return '\\';
+	case '\"': return '\"';
+	case '\n': return 'n';
+	case '\r': return 'r';
+	default:   return 0;
+	}
+}
+
+// Escape after decoding: the second byte of an SJIS character can be a backslash.
+static void append_escaped(QString &out, const char *sjis)
+{
+	QString str = sjis_decode(sjis);
+	out.reserve(out.size() + str.size());
+	for (QChar ch : str) {
+		char c = escape_char(ch);
+		if (c) {
+			out.append('\\');
+			out.append(c);
+		} else {
+			out.append(ch);
+		}
+	}
+}
+
+static QString escape_string(const char *sjis)
+{
+	QString out;
+	append_escaped(out, sjis);
+	return out;
+}
+
+// quote and escape into `out`, reusing its buffer
+static void string_literal_to(const char *str, QString &out)
+{
+	out.clear();
+	out.append('"');
+	append_escaped(out, str);
+	out.append('"');
+}
+
+static QString string_literal(const char *str)
+{
+	QString out;
+	string_literal_to(str, out);
+	return out;
+}
+
+static QString identifier(Interner &interner, const char *str)
+{
+	if (strchr(str, ' '))
+		return escape_string(str);
+	return interner.get(str);
+}
+
+SymbolTable::SymbolTable(struct ain *ain)
+	: ain(ain), literals(LITERAL_CACHE_SIZE)
+{
+	Interner interner;
+
+	Disambiguator functionNames;
+	functions.reserve(ain->nr_functions);
+	locals.resize(ain->nr_functions);
+	for (int i = 0; i < ain->nr_functions; i++) {
+		struct ain_function *f = &ain->functions[i];
+		functions.append(functionNames.get(interner, f->name));
+		QString name = interner.get(f->name);
+		if (!functionNumbers.contains(name))
+			functionNumbers.insert(name, i);
+
+		Disambiguator localNames;
+		locals[i].reserve(f->nr_vars);
+		for (int v = 0; v < f->nr_vars; v++) {
+			locals[i].append(localNames.get(interner, f->vars[v].name));
+		}
+	}
+
+	libraries.reserve(ain->nr_libraries);
+	libraryFunctions.resize(ain->nr_libraries);
+	for (int i = 0; i < ain->nr_libraries; i++) {
+		struct ain_library *lib = &ain->libraries[i];
+		libraries.append(identifier(interner, lib->name));
+
+		Disambiguator names;
+		libraryFunctions[i].reserve(lib->nr_functions);
+		for (int f = 0; f < lib->nr_functions; f++) {
+			libraryFunctions[i].append(names.get(interner, lib->functions[f].name));
+		}
+	}
+
+	globals.reserve(ain->nr_globals);
+	for (int i = 0; i < ain->nr_globals; i++) {
+		globals.append(identifier(interner, ain->globals[i].name));
+	}
+	structures.reserve(ain->nr_structures);
+	for (int i = 0; i < ain->nr_structures; i++) {
+		structures.append(identifier(interner, ain->structures[i].name));
+	}
+	delegates.reserve(ain->nr_delegates);
+	for (int i = 0; i < ain->nr_delegates; i++) {
+		delegates.append(identifier(interner, ain->delegates[i].name));
+	}
+
+	filenames.reserve(ain->nr_filenames);
+	for (int i = 0; i < ain->nr_filenames; i++) {
+		filenames.append(string_literal(ain->filenames[i]));
+	}
+}
+
+QString SymbolTable::string(int no) const
+{
+	if (no < 0 || no >= ain->nr_strings)
+		return QString();
+	QMutexLocker lock(&literalMutex);
+	QString *s = literals.object(no * 2);
+	if (!s) {
+		s = new QString(string_literal(ain->strings[no]->text));
+		literals.insert(no * 2, s);
+	}
+	return *s;
+}
+
+QString SymbolTable::message(int no) const
+{
+	if (no < 0 || no >= ain->nr_messages)
+		return QString();
+	QMutexLocker lock(&literalMutex);
+	QString *s = literals.object(no * 2 + 1);
+	if (!s) {
+		s = new QString(string_literal(ain->messages[no]->text));
+		literals.insert(no * 2 + 1, s);
+	}
+	return *s;
+}
+
+SymbolTable::SymbolTable(struct ain *ain, Empty)
+	: ain(ain), literals(LITERAL_CACHE_SIZE)
+{
+}
+
+// tables of tables, stored flattened with the size of each
+static void write_nested(CacheWriter &out, const QVector<QVector<QString>> &tables)
+{
+	QVector<int> sizes;
+	QVector<QString> all;
+	for (const QVector<QString> &t : tables) {
+		sizes.append(t.size());
+		all.append(t);
+	}
+	out.writeArray(sizes);
+	out.writeStrings(all);
+}
+
+static bool read_nested(CacheReader &in, QVector<QVector<QString>> *tables)
+{
+	QVector<int> sizes;
+	QVector<QString> all;
+	if (!in.readArray(&sizes) || !in.readStrings(&all))
+		return false;
+	tables->resize(sizes.size());
+	int next = 0;
+	for (int i = 0; i < sizes.size(); i++) {
+		if (sizes[i] < 0 || sizes[i] > all.size() - next)
+			return false;
+		(*tables)[i] = all.mid(next, sizes[i]);
+		next += sizes[i];
+	}
+	return next == all.size();
+}
+
+// share equal names again, as the Interner did when building
+static void intern(QSet<QString> &pool, QVector<QString> &table)
+{
+	for (QString &s : table) {
+		auto it = pool.constFind(s);
+		if (it != pool.constEnd())
+			s = *it;
+		else
+			pool.insert(s);
+	}
+}
+
+void SymbolTable::save(CacheWriter &out) const
+{
+	out.writeStrings(functions);
+	write_nested(out, locals);
+	out.writeStrings(libraries);
+	write_nested(out, libraryFunctions);
+	out.writeStrings(globals);
+	out.writeStrings(structures);
+	out.writeStrings(delegates);
+	out.writeStrings(filenames);
+	out.writeStrings(functionNumbers.keys().toVector());
+	out.writeArray(functionNumbers.values().toVector());
+}
+
+SymbolTable *SymbolTable::load(CacheReader &in, struct ain *ain)
+{
+	QScopedPointer<SymbolTable> t(new SymbolTable(ain, EMPTY));
+	QVector<QString> names;
+	QVector<int> numbers;
+	if (!in.readStrings(&t->functions) || !read_nested(in, &t->locals)
+			|| !in.readStrings(&t->libraries) || !read_nested(in, &t->libraryFunctions)
+			|| !in.readStrings(&t->globals) || !in.readStrings(&t->structures)
+			|| !in.readStrings(&t->delegates) || !in.readStrings(&t->filenames)
+			|| !in.readStrings(&names) || !in.readArray(&numbers))
+		return nullptr;
+
+	// the tables must have been built for this ain
+	if (t->functions.size() != ain->nr_functions || t->locals.size() != ain->nr_functions
+			|| t->libraries.size() != ain->nr_libraries
+			|| t->libraryFunctions.size() != ain->nr_libraries
+			|| t->globals.size() != ain->nr_globals
+			|| t->structures.size() != ain->nr_structures
+			|| t->delegates.size() != ain->nr_delegates
+			|| t->filenames.size() != ain->nr_filenames
+			|| names.size() != numbers.size())
+		return nullptr;
+	for (int i = 0; i < ain->nr_functions; i++) {
+		if (t->locals[i].size() != ain->functions[i].nr_vars)
+			return nullptr;
+	}
+	for (int i = 0; i < ain->nr_libraries; i++) {
+		if (t->libraryFunctions[i].size() != ain->libraries[i].nr_functions)
+			return nullptr;
+	}
+	for (int i = 0; i < names.size(); i++) {
+		if (numbers[i] < 0 || numbers[i] >= ain->nr_functions)
+			return nullptr;
+		t->functionNumbers.insert(names[i], numbers[i]);
+	}
+
+	QSet<QString> pool;
+	intern(pool, t->functions);
+	for (QVector<QString> &table : t->locals) {
+		intern(pool, table);
+	}
+	return t.take();
+}
+
+static qint64 strings_size(const QVector<QString> &table)
+{
+	qint64 size = (qint64)table.size() * sizeof(QString);
+	for (const QString &s : table) {
+		size += (qint64)s.size() * sizeof(QChar);
+	}
+	return size;
+}
+
+qint64 SymbolTable::memoryUsage() const
+{
+	qint64 size = strings_size(functions) + strings_size(libraries) + strings_size(globals)
+		+ strings_size(structures) + strings_size(delegates) + strings_size(filenames);
+	for (const QVector<QString> &names : locals) {
+		size += strings_size(names);
+	}
+	for (const QVector<QString> &names : libraryFunctions) {
+		size += strings_size(names);
+	}
+	// keys share their data with the function names
+	size += (qint64)functionNumbers.size() * (sizeof(QString) + sizeof(int));
+
+	QMutexLocker lock(&literalMutex);
+	for (int key : literals.keys()) {
+		size += sizeof(QString) + (qint64)literals.object(key)->size() * sizeof(QChar);
+	}
+	return size;
+}
+
+bool SymbolTable::stringTo(int no, QString &out) const
+{
+	if (no < 0 || no >= ain->nr_strings)
+		return false;
+	string_literal_to(ain->strings[no]->text, out);
+	return true;
+}
+
+bool SymbolTable::messageTo(int no, QString &out) const
+{
+	if (no < 0 || no >= ain->nr_messages)
+		return false;
+	string_literal_to(ain->messages[no]->text, out);
+	return true;
+}
+
+const QString *SymbolTable::local(int fno, int varno) const
+{
+	if (fno < 0 || fno >= locals.size())
+		return nullptr;
+	return lookup(locals[fno], varno);
+}
+
+const QString *SymbolTable::libraryFunction(int lib, int fno) const
+{
+	if (lib < 0 || lib >= libraryFunctions.size())
+		return nullptr;
+	return lookup(libraryFunctions[lib], fno);
+}
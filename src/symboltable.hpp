@@ -0,0 +1,114 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_SYMBOL_TABLE_HPP
+#define XSYS4DBG_SYMBOL_TABLE_HPP
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+struct ain;
+class CacheReader;
+class CacheWriter;
+
+/*
+ * Display names for everything a disassembly operand can refer to, built
+ * once per .ain. Ambiguous names (functions, locals and library functions
+ * sharing a name with an earlier one) get a "#n" suffix, so rendering an
+ * operand is an array lookup.
+ *
+ * String and message literals are the bulk of the text in an .ain and only
+ * a few are ever displayed, so they are decoded (from the SJIS left in the
+ * ain by ain_open_lazy()) and escaped on first use and kept in a small
+ * cache. The ain must outlive the table.
+ *
+ * The names can be saved to the game's cache file and loaded instead of
+ * being decoded and disambiguated again.
+ */
+class SymbolTable
+{
+public:
+	SymbolTable(struct ain *ain);
+
+	// Load the tables that save() wrote for `ain`. Returns nullptr if the
+	// data is invalid.
+	static SymbolTable *load(CacheReader &in, struct ain *ain);
+	void save(CacheWriter &out) const;
+
+	// Each accessor returns nullptr if the index is out of range.
+	const QString *function(int fno) const { return lookup(functions, fno); }
+	const QString *local(int fno, int varno) const;
+	const QString *library(int lib) const { return lookup(libraries, lib); }
+	const QString *libraryFunction(int lib, int fno) const;
+	const QString *global(int no) const { return lookup(globals, no); }
+	const QString *structure(int no) const { return lookup(structures, no); }
+	const QString *delegate(int no) const { return lookup(delegates, no); }
+	const QString *filename(int no) const { return lookup(filenames, no); }
+	// quoted and escaped literals; null if the index is out of range
+	// (thread-safe)
+	QString string(int no) const;
+	QString message(int no) const;
+	// The same literals written to `out` without the cache or its lock, for
+	// scans that visit many of them once. Return false if the index is out
+	// of range (thread-safe).
+	bool stringTo(int no, QString &out) const;
+	bool messageTo(int no, QString &out) const;
+	bool hasFilenames() const { return !filenames.isEmpty(); }
+
+	int nrFunctions() const { return functions.size(); }
+	int nrLibraries() const { return libraries.size(); }
+	int nrLibraryFunctions(int lib) const { return libraryFunctions.value(lib).size(); }
+	int nrGlobals() const { return globals.size(); }
+	int nrStructures() const { return structures.size(); }
+
+	// number of the first function named `name` (undisambiguated), or -1
+	int functionNumber(const QString &name) const { return functionNumbers.value(name, -1); }
+
+	// approximate size in bytes, including the literals cached so far
+	qint64 memoryUsage() const;
+
+private:
+	// empty tables, for load()
+	enum Empty { EMPTY };
+	SymbolTable(struct ain *ain, Empty);
+
+	static const QString *lookup(const QVector<QString> &table, int i)
+	{
+		if (i < 0 || i >= table.size())
+			return nullptr;
+		return &table[i];
+	}
+
+	QVector<QString> functions;
+	QVector<QVector<QString>> locals;
+	QVector<QString> libraries;
+	QVector<QVector<QString>> libraryFunctions;
+	QVector<QString> globals;
+	QVector<QString> structures;
+	QVector<QString> delegates;
+	QVector<QString> filenames;
+	QHash<QString, int> functionNumbers;
+
+	struct ain *ain;
+	mutable QMutex literalMutex;
+	// key: string number * 2, or message number * 2 + 1
+	mutable QCache<int, QString> literals;
+};
+
+#endif
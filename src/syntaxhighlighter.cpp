@@ -1,41 +0,0 @@
-/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
- *
- * This program is free software; you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation; either version 2 of the License, or
- * (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program; if not, see <http://gnu.org/licenses/>.
- */
-
-#include "syntaxhighlighter.hpp"
-
-SyntaxHighlighter::SyntaxHighlighter(QTextDocument *parent)
-	: QSyntaxHighlighter(parent)
-{
-}
-
-void SyntaxHighlighter::addRule(const QRegularExpression &pattern, const QTextCharFormat &format)
-{
-	HighlightingRule rule;
-	rule.pattern = pattern;
-	rule.format = format;
-	rules.append(rule);
-}
-
-void SyntaxHighlighter::highlightBlock(const QString &text)
-{
-	for (const HighlightingRule &rule : qAsConst(rules)) {
-		QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
-		while (matchIterator.hasNext()) {
-			QRegularExpressionMatch match = matchIterator.next();
-			setFormat(match.capturedStart(), match.capturedLength(), rule.format);
-		}
-	}
-}
@@ -0,0 +1,185 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_TREE_MODEL_HPP
+#define XSYS4DBG_TREE_MODEL_HPP
+
+#include <QAbstractItemModel>
+#include <QVector>
+
+/*
+ * Base class for tree models. Nodes are stored contiguously in a single
+ * vector and refer to each other by index; each node records its parent and
+ * its row within the parent, so index() and parent() are O(1) regardless of
+ * how wide the tree is. Model indices carry the node index as internalId, so
+ * they stay valid when nodes are appended.
+ *
+ * Subclasses provide columnCount() and data(), and build the tree with
+ * addNode(). Removed subtrees are put on a free list, and their slots are
+ * reused by later additions, so a model that changes for a long time doesn't
+ * grow. Subclasses are responsible for emitting the appropriate signals when
+ * the structure changes, and for recognizing a reused id if they keep ids
+ * across removals.
+ */
+template<typename T>
+class TreeModel : public QAbstractItemModel
+{
+public:
+	explicit TreeModel(QObject *parent = nullptr)
+		: QAbstractItemModel(parent)
+	{
+		clearNodes();
+	}
+
+	QModelIndex index(int row, int column,
+			const QModelIndex &parent = QModelIndex()) const override
+	{
+		if (!hasIndex(row, column, parent))
+			return QModelIndex();
+		const Node &p = nodes[nodeId(parent)];
+		return createIndex(row, column, (quintptr)p.children[row]);
+	}
+
+	QModelIndex parent(const QModelIndex &index) const override
+	{
+		if (!index.isValid())
+			return QModelIndex();
+		return nodeIndex(nodes[nodeId(index)].parent);
+	}
+
+	int rowCount(const QModelIndex &parent = QModelIndex()) const override
+	{
+		if (parent.column() > 0)
+			return 0;
+		return nodes[nodeId(parent)].children.size();
+	}
+
+protected:
+	static const int ROOT = 0;
+
+	int nodeId(const QModelIndex &index) const
+	{
+		return index.isValid() ? (int)index.internalId() : ROOT;
+	}
+
+	QModelIndex nodeIndex(int id, int column = 0) const
+	{
+		if (id == ROOT)
+			return QModelIndex();
+		return createIndex(nodes[id].row, column, (quintptr)id);
+	}
+
+	// Append a child to `parent` and return its id. References returned by
+	// node() are invalidated.
+	int addNode(int parent, const T &data)
+	{
+		int id = allocNode(Node { data, parent, nodes[parent].children.size(), {} });
+		nodes[parent].children.append(id);
+		return id;
+	}
+
+	// Insert a child at `row` of `parent` and return its id.
+	int insertNode(int parent, int row, const T &data)
+	{
+		int id = allocNode(Node { data, parent, row, {} });
+		QVector<int> &siblings = nodes[parent].children;
+		siblings.insert(row, id);
+		for (int i = row + 1; i < siblings.size(); i++) {
+			nodes[siblings[i]].row = i;
+		}
+		return id;
+	}
+
+	// Remove `count` children of `parent` starting at `row`, freeing their
+	// subtrees.
+	void removeNodes(int parent, int row, int count)
+	{
+		QVector<int> &siblings = nodes[parent].children;
+		for (int i = row; i < row + count; i++) {
+			freeNode(siblings[i]);
+		}
+		siblings.remove(row, count);
+		for (int i = row; i < siblings.size(); i++) {
+			nodes[siblings[i]].row = i;
+		}
+	}
+
+	T &node(int id) { return nodes[id].data; }
+	const T &node(int id) const { return nodes[id].data; }
+	int parentNode(int id) const { return nodes[id].parent; }
+	int childCount(int id) const { return nodes[id].children.size(); }
+	int childNode(int id, int row) const { return nodes[id].children[row]; }
+	int nodeCount() const { return nodes.size(); }
+
+	// false if `id` is in a removed subtree
+	bool isAttached(int id) const
+	{
+		while (id != ROOT) {
+			const Node &n = nodes[id];
+			if (n.parent < 0)
+				return false;
+			const QVector<int> &siblings = nodes[n.parent].children;
+			if (n.row >= siblings.size() || siblings[n.row] != id)
+				return false;
+			id = n.parent;
+		}
+		return true;
+	}
+
+	void reserveNodes(int n) { nodes.reserve(n); }
+
+	void clearNodes()
+	{
+		nodes.clear();
+		nodes.append(Node { T(), -1, 0, {} });
+		freeIds.clear();
+	}
+
+private:
+	struct Node {
+		T data;
+		int parent;
+		int row;
+		QVector<int> children;
+	};
+
+	int allocNode(const Node &n)
+	{
+		if (freeIds.isEmpty()) {
+			nodes.append(n);
+			return nodes.size() - 1;
+		}
+		int id = freeIds.takeLast();
+		nodes[id] = n;
+		return id;
+	}
+
+	void freeNode(int id)
+	{
+		for (int child : nodes[id].children) {
+			freeNode(child);
+		}
+		// detached (see isAttached())
+		nodes[id] = Node { T(), -1, 0, {} };
+		freeIds.append(id);
+	}
+
+	QVector<Node> nodes;
+	// slots of removed nodes
+	QVector<int> freeIds;
+};
+
+#endif
@@ -14,132 +14,225 @@
  * along with this program; if not, see <http://gnu.org/licenses/>.
  */
 
+#include <QColor>
+#include <QPointer>
 #include "variablesmodel.hpp"
 
-VariableItem::VariableItem(const QVector<QVariant> &data, VariableItem *parent)
-	: m_itemData(data), m_parentItem(parent)
-{
-}
+// number of indexed children requested at a time when expanding an array
+#define VARIABLES_PAGE_SIZE 1000
 
-VariableItem::~VariableItem()
+bool VariableNode::canFetchMore() const
 {
-	qDeleteAll(m_childItems);
+	if (variablesReference <= 0 || fetching)
+		return false;
+	// adapter didn't report child counts: everything is fetched at once
+	if (indexedVariables == 0 && namedVariables == 0)
+		return !namedFetched;
+	if (namedVariables > 0 && !namedFetched)
+		return true;
+	return indexedFetched < indexedVariables;
 }
 
-void VariableItem::appendChild(VariableItem *item)
+VariablesModel::VariablesModel(const QVector<Debugger::Scope> &scopes, QObject *parent)
+	: TreeModel(parent)
 {
-	m_childItems.append(item);
-}
+	int nrNodes = 1 + scopes.size();
+	for (const Debugger::Scope &scope : scopes) {
+		nrNodes += scope.variables.size();
+	}
+	reserveNodes(nrNodes);
 
-VariableItem *VariableItem::child(int row)
-{
-	if (row < 0 || row >= m_childItems.size())
-		return nullptr;
-	return m_childItems.at(row);
+	for (const Debugger::Scope &scope : scopes) {
+		VariableNode node;
+		node.name = scope.name;
+		node.epoch = ++lastEpoch;
+		int scopeNode = addNode(ROOT, node);
+		for (const DAPClient::Variable &var : scope.variables) {
+			addNode(scopeNode, makeNode(var));
+		}
+	}
 }
 
-int VariableItem::childCount() const
+VariablesModel::~VariablesModel()
 {
-	return m_childItems.count();
 }
 
-int VariableItem::row() const
+VariableNode VariablesModel::makeNode(const DAPClient::Variable &var)
 {
-	if (m_parentItem)
-		return m_parentItem->m_childItems.indexOf(const_cast<VariableItem*>(this));
-	return 0;
+	VariableNode node;
+	node.name = var.name;
+	node.value = var.value;
+	node.variablesReference = var.variablesReference;
+	node.indexedVariables = var.indexedVariables;
+	node.namedVariables = var.namedVariables;
+	node.epoch = ++lastEpoch;
+	return node;
 }
 
-int VariableItem::columnCount() const
+void VariablesModel::update(const QVector<Debugger::Scope> &scopes)
 {
-	return m_itemData.count();
-}
+	// outstanding requests were for the previous stop
+	generation++;
+
+	int nrScopes = childCount(ROOT);
+	for (int i = 0; i < qMin(nrScopes, scopes.size()); i++) {
+		int id = childNode(ROOT, i);
+		if (node(id).name != scopes[i].name) {
+			clearChildren(id);
+			node(id).name = scopes[i].name;
+			emit dataChanged(nodeIndex(id, 0), nodeIndex(id, 1));
+		}
+		replaceVariables(id, 0, childCount(id), scopes[i].variables);
+	}
 
-QVariant VariableItem::data(int column) const
-{
-	if (column < 0 || column >= m_itemData.size())
-		return QVariant();
-	return m_itemData.at(column);
+	if (scopes.size() > nrScopes) {
+		beginInsertRows(QModelIndex(), nrScopes, scopes.size() - 1);
+		for (int i = nrScopes; i < scopes.size(); i++) {
+			VariableNode node;
+			node.name = scopes[i].name;
+			node.epoch = ++lastEpoch;
+			int id = addNode(ROOT, node);
+			for (const DAPClient::Variable &var : scopes[i].variables) {
+				addNode(id, makeNode(var));
+			}
+		}
+		endInsertRows();
+	} else if (scopes.size() < nrScopes) {
+		beginRemoveRows(QModelIndex(), scopes.size(), nrScopes - 1);
+		removeNodes(ROOT, scopes.size(), nrScopes - scopes.size());
+		endRemoveRows();
+	}
 }
 
-VariableItem *VariableItem::parentItem()
+// Update the children [first, first + count) of `parent` to `variables`.
+void VariablesModel::replaceVariables(int parent, int first, int count,
+		const QVector<DAPClient::Variable> &variables)
 {
-	return m_parentItem;
+	int common = qMin(count, variables.size());
+	for (int i = 0; i < common; i++) {
+		updateVariable(childNode(parent, first + i), variables[i]);
+	}
+
+	if (variables.size() > count) {
+		insertVariables(parent, first + count, variables.mid(count));
+	} else if (variables.size() < count) {
+		beginRemoveRows(nodeIndex(parent), first + variables.size(), first + count - 1);
+		removeNodes(parent, first + variables.size(), count - variables.size());
+		endRemoveRows();
+	}
 }
 
-VariablesModel::VariablesModel(const QVector<Debugger::Scope> &scopes, QObject *parent)
-	: QAbstractItemModel(parent)
+void VariablesModel::insertVariables(int parent, int row,
+		const QVector<DAPClient::Variable> &variables)
 {
-	rootItem = new VariableItem({tr("name"), tr("value")});
-	for (const Debugger::Scope &scope : scopes) {
-		QVector<QVariant> nodeData { scope.name, "" };
-		VariableItem *node = new VariableItem(nodeData, rootItem);
-		rootItem->appendChild(node);
-		for (const DAPClient::Variable &var : scope.variables) {
-			QVector<QVariant> varData = { var.name, var.value };
-			VariableItem *varItem = new VariableItem(varData, node);
-			node->appendChild(varItem);
-		}
+	if (variables.isEmpty())
+		return;
+	beginInsertRows(nodeIndex(parent), row, row + variables.size() - 1);
+	for (int i = 0; i < variables.size(); i++) {
+		insertNode(parent, row + i, makeNode(variables[i]));
 	}
+	endInsertRows();
 }
 
-VariablesModel::~VariablesModel()
+void VariablesModel::updateVariable(int id, const DAPClient::Variable &var)
 {
-	delete rootItem;
+	VariableNode &n = node(id);
+	bool renamed = n.name != var.name;
+	bool changed = !renamed && n.value != var.value;
+	bool wasChanged = n.changed;
+	bool hadChildren = childCount(id) > 0 || n.fetching;
+
+	n.name = var.name;
+	n.value = var.value;
+	n.changed = changed;
+	n.variablesReference = var.variablesReference;
+	n.indexedVariables = var.indexedVariables;
+	n.namedVariables = var.namedVariables;
+	// a fetch made since this stop is still valid (and will insert the
+	// children); one from an earlier stop is dropped when it returns
+	if (n.fetchGeneration != generation)
+		n.fetching = false;
+	if (renamed || changed || wasChanged)
+		emit dataChanged(nodeIndex(id, 0), nodeIndex(id, 1));
+
+	// a different variable, or no longer structured: children are invalid
+	if (renamed || var.variablesReference <= 0) {
+		clearChildren(id);
+	} else if (hadChildren) {
+		refresh(id);
+	}
 }
 
-QModelIndex VariablesModel::index(int row, int column, const QModelIndex &parent) const
+void VariablesModel::clearChildren(int id)
 {
-	if (!hasIndex(row, column, parent)) {
-		return QModelIndex();
+	int count = childCount(id);
+	if (count > 0) {
+		beginRemoveRows(nodeIndex(id), 0, count - 1);
+		removeNodes(id, 0, count);
+		endRemoveRows();
 	}
-
-	VariableItem *parentItem;
-
-	if (!parent.isValid())
-		parentItem = rootItem;
-	else
-		parentItem = static_cast<VariableItem*>(parent.internalPointer());
-
-	VariableItem *childItem = parentItem->child(row);
-	if (childItem)
-		return createIndex(row, column, childItem);
-	return QModelIndex();
+	VariableNode &n = node(id);
+	n.namedCount = 0;
+	n.indexedFetched = 0;
+	n.namedFetched = false;
+	n.fetching = false;
+	n.epoch = ++lastEpoch;
 }
 
-QModelIndex VariablesModel::parent(const QModelIndex &index) const
+// Re-fetch the children that were loaded at the previous stop (the node is
+// presumably expanded) and diff them into the tree.
+void VariablesModel::refresh(int id)
 {
-	if (!index.isValid())
-		return QModelIndex();
-
-	VariableItem *childItem = static_cast<VariableItem*>(index.internalPointer());
-	VariableItem *parentItem = childItem->parentItem();
-
-	if (parentItem == rootItem)
-		return QModelIndex();
+	VariableNode &n = node(id);
+	// the first fetch is in flight, made since this stop
+	if (n.fetching)
+		return;
+	if (!n.namedFetched && n.indexedFetched == 0) {
+		// the first fetch was made before this stop; start over
+		if (n.canFetchMore())
+			fetchMore(nodeIndex(id));
+		return;
+	}
 
-	return createIndex(parentItem->row(), 0, parentItem);
+	if (n.namedFetched) {
+		bool unfiltered = n.indexedVariables == 0 && n.namedVariables == 0;
+		fetch(id, unfiltered ? "" : "named", 0, 0,
+				[this, id](const QVector<DAPClient::Variable> &vars) {
+			replaceVariables(id, 0, node(id).namedCount, vars);
+			node(id).namedCount = vars.size();
+		});
+	}
+	if (n.indexedFetched > 0) {
+		int count = qMin(n.indexedFetched, n.indexedVariables);
+		n.indexedFetched = count;
+		fetch(id, "indexed", 0, count, [this, id](const QVector<DAPClient::Variable> &vars) {
+			int first = node(id).namedCount;
+			replaceVariables(id, first, childCount(id) - first, vars);
+		});
+	}
 }
 
-int VariablesModel::rowCount(const QModelIndex &parent) const
+void VariablesModel::fetch(int id, const QString &filter, int start, int count,
+		fetchHandler handler)
 {
-	VariableItem *parentItem;
-	if (parent.column() > 0)
-		return 0;
-
-	if (!parent.isValid())
-		parentItem = rootItem;
-	else
-		parentItem = static_cast<VariableItem*>(parent.internalPointer());
-
-	return parentItem->childCount();
+	// the model may be deleted (e.g. when the frame goes away) or updated,
+	// or the node removed or its children invalidated, before the response
+	// arrives
+	QPointer<VariablesModel> self(this);
+	int gen = generation;
+	int epoch = node(id).epoch;
+	Debugger::getInstance().requestVariables(node(id).variablesReference, filter, start, count,
+			[self, gen, id, epoch, handler](const QVector<DAPClient::Variable> &vars) {
+		if (!self || self->generation != gen || !self->isAttached(id)
+				|| self->node(id).epoch != epoch)
+			return;
+		handler(vars);
+	});
 }
 
 int VariablesModel::columnCount(const QModelIndex &parent) const
 {
-	if (parent.isValid())
-		return static_cast<VariableItem*>(parent.internalPointer())->columnCount();
-	return rootItem->columnCount();
+	return 2;
 }
 
 QVariant VariablesModel::data(const QModelIndex &index, int role) const
@@ -147,12 +240,96 @@ QVariant VariablesModel::data(const QModelIndex &index, int role) const
 	if (!index.isValid())
 		return QVariant();
 
+	int id = nodeId(index);
+	if (role == Qt::ForegroundRole) {
+		if (index.column() == 1 && node(id).changed)
+			return QColor(Qt::red);
+		return QVariant();
+	}
 	if (role != Qt::DisplayRole)
 		return QVariant();
 
-	VariableItem *item = static_cast<VariableItem*>(index.internalPointer());
+	switch (index.column()) {
+	case 0: return node(id).name;
+	case 1: return node(id).value;
+	}
+	return QVariant();
+}
+
+void VariablesModel::fetchNextPage(const QModelIndex &index)
+{
+	if (!index.isValid())
+		return;
+	int id = nodeId(index);
+	int parentId = parentNode(id);
+	if (parentId == ROOT || index.row() != childCount(parentId) - 1)
+		return;
+	// only arrays that are already being paged in
+	if (node(parentId).indexedFetched > 0 && node(parentId).canFetchMore())
+		fetchMore(index.parent());
+}
+
+bool VariablesModel::hasChildren(const QModelIndex &parent) const
+{
+	if (parent.column() > 0)
+		return false;
+	int id = nodeId(parent);
+	return childCount(id) > 0 || node(id).variablesReference > 0;
+}
+
+bool VariablesModel::canFetchMore(const QModelIndex &parent) const
+{
+	if (!parent.isValid())
+		return false;
+	return node(nodeId(parent)).canFetchMore();
+}
 
-	return item->data(index.column());
+/*
+ * Children of structured variables are requested from the adapter when the
+ * node is expanded. Named children (struct members) are fetched in one
+ * request; indexed children (array elements) are fetched in pages of
+ * VARIABLES_PAGE_SIZE.
+ */
+void VariablesModel::fetchMore(const QModelIndex &parent)
+{
+	if (!canFetchMore(parent))
+		return;
+
+	int id = nodeId(parent);
+	VariableNode &item = node(id);
+	item.fetching = true;
+	item.fetchGeneration = generation;
+
+	if (item.indexedVariables == 0 && item.namedVariables == 0) {
+		// unfiltered
+		fetch(id, "", 0, 0, [this, id](const QVector<DAPClient::Variable> &vars) {
+			node(id).fetching = false;
+			node(id).namedFetched = true;
+			insertVariables(id, node(id).namedCount, vars);
+			node(id).namedCount += vars.size();
+		});
+	} else if (item.namedVariables > 0 && !item.namedFetched) {
+		fetch(id, "named", 0, 0, [this, id](const QVector<DAPClient::Variable> &vars) {
+			node(id).fetching = false;
+			node(id).namedFetched = true;
+			insertVariables(id, node(id).namedCount, vars);
+			node(id).namedCount += vars.size();
+		});
+	} else {
+		int start = item.indexedFetched;
+		int count = qMin(VARIABLES_PAGE_SIZE, item.indexedVariables - start);
+		fetch(id, "indexed", start, count,
+				[this, id, count](const QVector<DAPClient::Variable> &vars) {
+			VariableNode &item = node(id);
+			item.fetching = false;
+			// don't keep asking if the adapter has fewer elements than it claimed
+			if (vars.isEmpty())
+				item.indexedFetched = item.indexedVariables;
+			else
+				item.indexedFetched += count;
+			insertVariables(id, childCount(id), vars);
+		});
+	}
 }
 
 Qt::ItemFlags VariablesModel::flags(const QModelIndex &index) const
@@ -166,8 +343,12 @@ Qt::ItemFlags VariablesModel::flags(const QModelIndex &index) const
 QVariant VariablesModel::headerData(int section, Qt::Orientation orientation,
 		int role) const
 {
-	if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
-		return rootItem->data(section);
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+		return QVariant();
 
+	switch (section) {
+	case 0: return tr("name");
+	case 1: return tr("value");
+	}
 	return QVariant();
 }
@@ -17,51 +17,75 @@
 #ifndef XSYS4DBG_VARIABLES_MODEL_HPP
 #define XSYS4DBG_VARIABLES_MODEL_HPP
 
-#include <QAbstractItemModel>
 #include <QVector>
 #include "debugger.hpp"
+#include "treemodel.hpp"
 
-class VariableItem
+struct VariableNode
 {
-public:
-	explicit VariableItem(const QVector<QVariant> &data, VariableItem *parentItem = nullptr);
-	~VariableItem();
-
-	void appendChild(VariableItem *child);
+	QString name;
+	QString value;
+	bool changed = false; // value differs from the previous stop
 
-	VariableItem *child(int row);
-	int childCount() const;
-	int columnCount() const;
-	QVariant data(int column) const;
-	int row() const;
-	VariableItem *parentItem();
+	// lazy loading of children (structured variables)
+	int variablesReference = 0;
+	int indexedVariables = 0;
+	int namedVariables = 0;
+	int namedCount = 0; // named (or unfiltered) children come first
+	int indexedFetched = 0;
+	bool namedFetched = false;
+	bool fetching = false;
+	int fetchGeneration = 0; // of the fetch in flight
+	// replaced whenever the children are invalidated; responses carry the
+	// value they were requested with
+	int epoch = 0;
 
-private:
-	QVector<VariableItem*> m_childItems;
-	QVector<QVariant> m_itemData;
-	VariableItem *m_parentItem;
+	bool canFetchMore() const;
 };
 
-class VariablesModel : public QAbstractItemModel
+/*
+ * Model for the variables of a stack frame. When execution stops again in
+ * the same frame, update() diffs the new variables against the current
+ * ones (by position and name) so that views keep their expansion and scroll
+ * state; expanded structs and arrays are re-fetched and diffed the same way.
+ * Values that changed since the previous stop are highlighted.
+ */
+class VariablesModel : public TreeModel<VariableNode>
 {
 	Q_OBJECT
 public:
 	explicit VariablesModel(const QVector<Debugger::Scope> &scopes, QObject *parent = nullptr);
 	~VariablesModel();
 
+	void update(const QVector<Debugger::Scope> &scopes);
+
 	QVariant data(const QModelIndex &index, int role) const override;
 	Qt::ItemFlags flags(const QModelIndex &index) const override;
 	QVariant headerData(int section, Qt::Orientation orientation,
 			int role = Qt::DisplayRole) const override;
-	QModelIndex index(int row, int column,
-			const QModelIndex &parent = QModelIndex()) const override;
-	QModelIndex parent(const QModelIndex &index) const override;
-	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+	bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+	bool canFetchMore(const QModelIndex &parent) const override;
+	void fetchMore(const QModelIndex &parent) override;
+	// Load the next page of a paged array if `index` is its last loaded
+	// element (called by the view as elements scroll into view).
+	void fetchNextPage(const QModelIndex &index);
 
 private:
+	typedef std::function<void(const QVector<DAPClient::Variable>&)> fetchHandler;
+
+	VariableNode makeNode(const DAPClient::Variable &var);
+	void fetch(int id, const QString &filter, int start, int count, fetchHandler handler);
+	void refresh(int id);
+	void insertVariables(int parent, int row, const QVector<DAPClient::Variable> &variables);
+	void replaceVariables(int parent, int first, int count,
+			const QVector<DAPClient::Variable> &variables);
+	void updateVariable(int id, const DAPClient::Variable &var);
+	void clearChildren(int id);
 
-	VariableItem *rootItem;
+	// incremented on every update; responses to older requests are dropped
+	int generation = 0;
+	int lastEpoch = 0;
 };
 
 #endif
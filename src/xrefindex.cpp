@@ -0,0 +1,181 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#include "cachefile.hpp"
+#include "codeindex.hpp"
+#include "xrefindex.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+#include "system4/instructions.h"
+}
+
+// check for cancellation every this many instructions
+#define CANCEL_CHECK_INTERVAL 65536
+
+int XrefIndex::kindOf(int argtype)
+{
+	switch (argtype) {
+	case T_FUNC:    return FUNCTION;
+	case T_GLOBAL:  return GLOBAL;
+	case T_STRING:  return STRING;
+	case T_MSG:     return MESSAGE;
+	case T_HLL:     return LIBRARY;
+	case T_HLLFUNC: return LIBRARY_FUNCTION;
+	case T_STRUCT:  return STRUCT;
+	case T_DLG:     return DELEGATE;
+	case T_SYSCALL: return SYSCALL;
+	default:        return -1;
+	}
+}
+
+void XrefIndex::init(struct ain *ain)
+{
+	int count[NR_KINDS] = {};
+	count[FUNCTION] = ain->nr_functions;
+	count[GLOBAL] = ain->nr_globals;
+	count[STRING] = ain->nr_strings;
+	count[MESSAGE] = ain->nr_messages;
+	count[LIBRARY] = ain->nr_libraries;
+	count[STRUCT] = ain->nr_structures;
+	count[DELEGATE] = ain->nr_delegates;
+	count[SYSCALL] = NR_SYSCALLS;
+
+	libBase.resize(ain->nr_libraries + 1);
+	libBase[0] = 0;
+	for (int i = 0; i < ain->nr_libraries; i++) {
+		libBase[i+1] = libBase[i] + ain->libraries[i].nr_functions;
+	}
+	count[LIBRARY_FUNCTION] = libBase[ain->nr_libraries];
+
+	base[0] = 0;
+	for (int i = 0; i < NR_KINDS; i++) {
+		base[i+1] = base[i] + count[i];
+	}
+}
+
+int XrefIndex::libraryFunction(int lib, int fno) const
+{
+	if (lib < 0 || lib + 1 >= libBase.size())
+		return -1;
+	if (fno < 0 || fno >= libBase[lib+1] - libBase[lib])
+		return -1;
+	return libBase[lib] + fno;
+}
+
+int XrefIndex::target(int argtype, int32_t arg, int32_t prevArg) const
+{
+	int kind = kindOf(argtype);
+	if (kind < 0)
+		return -1;
+	// T_HLLFUNC is only meaningful following its T_HLL operand
+	if (kind == LIBRARY_FUNCTION)
+		arg = libraryFunction(prevArg, arg);
+	if (arg < 0 || arg >= nrTargets((Kind)kind))
+		return -1;
+	return base[kind] + arg;
+}
+
+bool XrefIndex::build(struct ain *ain, const CodeIndex &index, const std::atomic<bool> *cancel)
+{
+	init(ain);
+	const QVector<CodeIndex::Instruction> &instrs = index.instructions();
+
+	// Calls `fn(target, instruction index)` for each reference. The operands
+	// of FUNC/ENDFUNC identify the function being defined; they aren't
+	// references.
+	auto scan = [this, &instrs, cancel](auto fn) {
+		for (int i = 0; i < instrs.size(); i++) {
+			if (i % CANCEL_CHECK_INTERVAL == 0 && cancel && *cancel)
+				return false;
+			const struct instruction *info = instrs[i].instr;
+			if (info->opcode == FUNC || info->opcode == ENDFUNC)
+				continue;
+			for (int a = 0; a < info->nr_args; a++) {
+				if (info->args[a] == T_HLLFUNC && (a == 0 || info->args[a-1] != T_HLL))
+					continue;
+				int t = target(info->args[a], instrs[i].args[a],
+						a > 0 ? instrs[i].args[a-1] : 0);
+				if (t >= 0)
+					fn(t, i);
+			}
+		}
+		return true;
+	};
+
+	// counting sort by target
+	offsets.fill(0, base[NR_KINDS] + 1);
+	if (!scan([this](int t, int) { offsets[t+1]++; }))
+		return false;
+	for (int t = 0; t < base[NR_KINDS]; t++) {
+		offsets[t+1] += offsets[t];
+	}
+
+	QVector<int> next = offsets;
+	refIndex.resize(offsets[base[NR_KINDS]]);
+	return scan([this, &next](int t, int i) { refIndex[next[t]++] = i; });
+}
+
+void XrefIndex::save(CacheWriter &out) const
+{
+	out.writeArray(offsets);
+	out.writeArray(refIndex);
+}
+
+bool XrefIndex::load(CacheReader &in, struct ain *ain, int nrInstrs)
+{
+	// the target numbering only depends on the ain; recompute it
+	init(ain);
+	if (!in.readArray(&offsets) || !in.readArray(&refIndex))
+		return false;
+	if (offsets.size() != base[NR_KINDS] + 1 || offsets[0] != 0
+			|| offsets[base[NR_KINDS]] != refIndex.size())
+		return false;
+	for (int t = 0; t < base[NR_KINDS]; t++) {
+		if (offsets[t] > offsets[t+1])
+			return false;
+	}
+	for (int i : refIndex) {
+		if (i < 0 || i >= nrInstrs)
+			return false;
+	}
+	return true;
+}
+
+qint64 XrefIndex::memoryUsage() const
+{
+	return (qint64)(libBase.size() + offsets.size() + refIndex.size()) * sizeof(int);
+}
+
+bool XrefIndex::targetOf(int argtype, int32_t value, int32_t prev, Target *out)
+{
+	int kind = kindOf(argtype);
+	if (kind < 0)
+		return false;
+	*out = { (Kind)kind, value, kind == LIBRARY_FUNCTION ? prev : -1 };
+	return true;
+}
+
+XrefIndex::Refs XrefIndex::refs(const Target &target) const
+{
+	int no = target.no;
+	if (target.kind == LIBRARY_FUNCTION)
+		no = libraryFunction(target.lib, target.no);
+	if (target.kind < 0 || target.kind >= NR_KINDS || no < 0 || no >= nrTargets(target.kind))
+		return { nullptr, nullptr };
+	int t = base[target.kind] + no;
+	return { refIndex.constData() + offsets[t], refIndex.constData() + offsets[t+1] };
+}
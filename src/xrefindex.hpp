@@ -0,0 +1,97 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+#ifndef XSYS4DBG_XREF_INDEX_HPP
+#define XSYS4DBG_XREF_INDEX_HPP
+
+#include <atomic>
+#include <QVector>
+
+struct ain;
+class CacheReader;
+class CacheWriter;
+class CodeIndex;
+
+/*
+ * Cross references: for each function, global, string, message, library,
+ * library function, struct, delegate and syscall, the instructions whose
+ * operands refer to it. Stored in CSR form: the references to target t are
+ * refs[offsets[t] .. offsets[t+1]), as indices into the instruction table,
+ * in address order. Targets of all kinds share one numbering (see
+ * target()).
+ */
+class XrefIndex
+{
+public:
+	enum Kind {
+		FUNCTION,
+		GLOBAL,
+		STRING,
+		MESSAGE,
+		LIBRARY,
+		LIBRARY_FUNCTION,
+		STRUCT,
+		DELEGATE,
+		SYSCALL,
+		NR_KINDS
+	};
+
+	// a function, global, ...; library functions are identified by library
+	// and function number
+	struct Target {
+		Kind kind;
+		int no;
+		int lib;
+	};
+
+	struct Refs {
+		const int *begin;
+		const int *end;
+		int size() const { return end - begin; }
+	};
+
+	// Kind of the operand type `argtype` (T_FUNC, T_GLOBAL, ...), or -1.
+	static int kindOf(int argtype);
+	// Target of an operand (see InstructionPrinter::Operand). Returns false
+	// if the operand type doesn't refer to anything.
+	static bool targetOf(int argtype, int32_t value, int32_t prev, Target *out);
+
+	// Build from the instruction table of `index`. Returns false if
+	// cancelled.
+	bool build(struct ain *ain, const CodeIndex &index, const std::atomic<bool> *cancel);
+	void save(CacheWriter &out) const;
+	// Load what save() wrote for `ain`. Returns false if the data is invalid.
+	bool load(CacheReader &in, struct ain *ain, int nrInstrs);
+
+	Refs refs(const Target &target) const;
+	int nrTargets(Kind kind) const { return base[kind+1] - base[kind]; }
+	int nrRefs() const { return refIndex.size(); }
+	// approximate size in bytes
+	qint64 memoryUsage() const;
+
+private:
+	void init(struct ain *ain);
+	int libraryFunction(int lib, int fno) const;
+	// global target number of operand `arg` of type `argtype`, or -1
+	int target(int argtype, int32_t arg, int32_t prevArg) const;
+
+	int base[NR_KINDS+1] = {};
+	QVector<int> libBase;
+	QVector<int> offsets;
+	QVector<int> refIndex;
+};
+
+#endif
@@ -23,6 +23,15 @@
 
 #include "xsystem4.hpp"
 
+#ifdef XSYS4DBG_SHM_TEXTURES
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 Color::Color(const QJsonValue &val)
 {
 	if (val.isObject()) {
@@ -731,23 +740,130 @@ SceneEntity::SceneEntity(const QJsonValue &val)
 	*/
 }
 
-QPixmap parseTexture(const QJsonValue &val)
+static void freeTexturePixels(void *data)
+{
+	delete static_cast<QByteArray*>(data);
+}
+
+static QImage decodeBase64Texture(const QJsonObject &obj, int width, int height)
+{
+	QByteArray b64 = obj["pixels"].toString().toLatin1();
+	QByteArray *pixels = new QByteArray(QByteArray::fromBase64(b64, QByteArray::Base64Encoding));
+	if (pixels->size() < width * height * 4) {
+		qDebug() << "pixel data truncated?";
+		delete pixels;
+		return QImage();
+	}
+
+	// the image takes ownership of the decoded buffer
+	return QImage((const uchar*)pixels->constData(), width, height, width * 4,
+			QImage::Format_RGBA8888, freeTexturePixels, pixels);
+}
+
+#ifdef XSYS4DBG_SHM_TEXTURES
+
+bool textureSharedMemorySupported()
+{
+	return true;
+}
+
+struct SharedTexture {
+	void *addr;
+	size_t size;
+};
+
+static void unmapSharedTexture(void *data)
+{
+	SharedTexture *tex = static_cast<SharedTexture*>(data);
+	munmap(tex->addr, tex->size);
+	delete tex;
+}
+
+// Read a non-negative integer that a double represents exactly (JSON
+// numbers are doubles).
+static bool json_size(const QJsonValue &v, size_t *out)
+{
+	if (!v.isDouble())
+		return false;
+	double d = v.toDouble();
+	// 2^53: above this, not every integer is representable
+	if (!(d >= 0 && d <= 9007199254740992.0) || d != floor(d) || d > (double)SIZE_MAX)
+		return false;
+	*out = (size_t)d;
+	return true;
+}
+
+static QImage mapSharedTexture(const QJsonObject &shm, int width, int height, int stride)
+{
+	QByteArray name = shm["name"].toString().toUtf8();
+	size_t offset, size;
+	if (!json_size(shm["offset"], &offset) || !json_size(shm["size"], &size)
+			|| size > SIZE_MAX - offset) {
+		qDebug() << "invalid shared texture offset/size";
+		return QImage();
+	}
+	if (width <= 0 || height <= 0 || stride <= 0 || (qint64)stride < (qint64)width * 4
+			|| (quint64)stride * (quint64)height > size) {
+		qDebug() << "invalid shared texture dimensions";
+		return QImage();
+	}
+
+	int fd = shm_open(name.constData(), O_RDONLY, 0);
+	if (fd < 0) {
+		qDebug() << "shm_open failed:" << name;
+		return QImage();
+	}
+	// ownership of the object is handed over with the response; unlinking
+	// now means it is freed once the mapping goes away
+	shm_unlink(name.constData());
+
+	struct stat st;
+	size_t mapSize = offset + size;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < mapSize) {
+		qDebug() << "shared texture truncated?";
+		close(fd);
+		return QImage();
+	}
+
+	void *addr = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		qDebug() << "mmap failed:" << name;
+		return QImage();
+	}
+
+	SharedTexture *tex = new SharedTexture { addr, mapSize };
+	return QImage((const uchar*)addr + offset, width, height, stride,
+			QImage::Format_RGBA8888, unmapSharedTexture, tex);
+}
+
+#else
+
+bool textureSharedMemorySupported()
+{
+	return false;
+}
+
+static QImage mapSharedTexture(const QJsonObject &shm, int width, int height, int stride)
+{
+	qDebug() << "shared memory textures not supported on this platform";
+	return QImage();
+}
+
+#endif
+
+QImage parseTexture(const QJsonValue &val)
 {
 	if (!val.isObject()) {
 		qDebug() << "invalid texture object";
-		return QPixmap();
+		return QImage();
 	}
 	QJsonObject obj = val.toObject();
 	int width = obj["width"].toInt();
 	int height = obj["height"].toInt();
-	QByteArray b64 = obj["pixels"].toString().toLatin1();
-	QByteArray pixels = QByteArray::fromBase64(b64, QByteArray::Base64Encoding);
-	if (pixels.size() < width * height * 4) {
-		qDebug() << "pixel data truncated?";
-		return QPixmap();
+	if (obj.contains("shm")) {
+		int stride = obj["stride"].toInt(width * 4);
+		return mapSharedTexture(obj["shm"].toObject(), width, height, stride);
 	}
-
-	QImage image((uchar*)pixels.data(), width, height, width * 4,
-			QImage::Format_RGBA8888);
-	return QPixmap::fromImage(image);
+	return decodeBase64Texture(obj, width, height);
 }
@@ -19,6 +19,7 @@
 
 #include <optional>
 #include <QVector>
+#include <QImage>
 #include <QPixmap>
 
 class QJsonObject;
@@ -318,6 +319,11 @@ struct SceneEntity {
 	QVector<Parts> parts;
 };
 
-QPixmap parseTexture(const QJsonValue &val);
+/*
+ * Parse a texture object. Pixel data is either inline as base64 ("pixels") or
+ * in a shared memory object ("shm") which is mapped directly into the image.
+ */
+QImage parseTexture(const QJsonValue &val);
+bool textureSharedMemorySupported();
 
 #endif
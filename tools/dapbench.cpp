@@ -0,0 +1,178 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+/*
+ * Protocol throughput benchmark. Drives Debugger against the mock adapter:
+ * each iteration steps once and waits for the full stack trace (and
+ * optionally a rendered texture), then reports message/byte throughput and
+ * pause-to-stack-trace latency.
+ */
+
+#include <algorithm>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QSettings>
+#include <stdio.h>
+
+#include "debugger.hpp"
+
+struct Bench {
+	int iterations;
+	bool render;
+
+	int done = 0;
+	bool haveStack = false;
+	bool haveTexture = false;
+	QElapsedTimer timer;
+	qint64 startTime;
+	qint64 pauseTime;
+	QVector<qint64> stackLatency;
+	QVector<qint64> renderLatency;
+};
+
+static double percentile(QVector<qint64> samples, double p)
+{
+	if (samples.isEmpty())
+		return 0;
+	std::sort(samples.begin(), samples.end());
+	int i = qBound(0, (int)(p * (samples.size() - 1) + 0.5), samples.size() - 1);
+	return samples[i] / 1000.0;
+}
+
+static void printLatency(const char *name, const QVector<qint64> &samples)
+{
+	printf("%-22s p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  max %8.1f us\n", name,
+			percentile(samples, 0.5), percentile(samples, 0.9),
+			percentile(samples, 0.99), percentile(samples, 1.0));
+}
+
+static void report(Bench &b)
+{
+	DAPClient::Stats st = Debugger::getInstance().ioStats();
+	double secs = (b.timer.nsecsElapsed() - b.startTime) / 1e9;
+
+	printf("iterations:            %d\n", b.done);
+	printf("elapsed:               %.3f s\n", secs);
+	printf("messages:              %llu (%.0f msg/s)\n",
+			(unsigned long long)st.messages, st.messages / secs);
+	printf("bytes:                 %llu (%.2f MiB/s)\n",
+			(unsigned long long)st.bytes, st.bytes / secs / (1024 * 1024));
+	printf("wakeups:               %llu (%.2f msg/wakeup avg, %d max)\n",
+			(unsigned long long)st.wakeups,
+			st.wakeups ? (double)st.messages / st.wakeups : 0.0, st.maxMessages);
+	printLatency("pause->stack trace:", b.stackLatency);
+	if (b.render)
+		printLatency("render round trip:", b.renderLatency);
+}
+
+int main(int argc, char *argv[])
+{
+	// QPixmap needs a GUI platform, but we don't want any windows
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+
+	QGuiApplication app(argc, argv);
+	QCoreApplication::setOrganizationName("nunuhara");
+	QCoreApplication::setApplicationName("xsys4dbg-bench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("xsys4dbg protocol benchmark");
+	parser.addHelpOption();
+	QCommandLineOption adapterOpt("adapter", "Path to the debug adapter.", "path",
+			QDir(QCoreApplication::applicationDirPath()).filePath("xsys4dbg-mockadapter"));
+	QCommandLineOption iterOpt("iterations", "Number of steps.", "N", "200");
+	QCommandLineOption renderOpt("render", "Render a parts texture on every stop.");
+	QCommandLineOption mockOpt("mock-options", "Options passed to the mock adapter.", "options");
+	parser.addOption(adapterOpt);
+	parser.addOption(iterOpt);
+	parser.addOption(renderOpt);
+	parser.addOption(mockOpt);
+	parser.process(app);
+
+	if (parser.isSet(mockOpt))
+		qputenv("XSYS4DBG_MOCK_OPTIONS", parser.value(mockOpt).toUtf8());
+
+	// Debugger reads the adapter path from the settings
+	QSettings settings;
+	settings.setValue("xsystem4/path", parser.value(adapterOpt));
+
+	Bench b;
+	b.iterations = parser.value(iterOpt).toInt();
+	b.render = parser.isSet(renderOpt);
+	b.timer.start();
+
+	Debugger &dbg = Debugger::getInstance();
+
+	auto step = [&b, &dbg] {
+		if (b.done == b.iterations) {
+			report(b);
+			dbg.kill();
+			QCoreApplication::quit();
+			return;
+		}
+		b.haveStack = false;
+		b.haveTexture = !b.render;
+		dbg.next();
+	};
+
+	auto stepFinished = [&b, &step] {
+		if (!b.haveStack || !b.haveTexture)
+			return;
+		b.done++;
+		step();
+	};
+
+	QObject::connect(&dbg, &Debugger::errorOccurred, [](const QString &message) {
+		fprintf(stderr, "error: %s\n", message.toUtf8().constData());
+		QCoreApplication::exit(1);
+	});
+	QObject::connect(&dbg, &Debugger::initialized, [&dbg] {
+		dbg.launch();
+	});
+	QObject::connect(&dbg, &Debugger::launched, [&b, &dbg] {
+		b.startTime = b.timer.nsecsElapsed();
+		dbg.pause();
+	});
+	QObject::connect(&dbg, &Debugger::paused, [&b, &dbg, &stepFinished](const QString &) {
+		b.pauseTime = b.timer.nsecsElapsed();
+		if (!b.render)
+			return;
+		qint64 renderStart = b.pauseTime;
+		dbg.renderParts(1, [&b, &stepFinished, renderStart](const QPixmap &) {
+			b.renderLatency.append(b.timer.nsecsElapsed() - renderStart);
+			b.haveTexture = true;
+			stepFinished();
+		});
+	});
+	QObject::connect(&dbg, &Debugger::stackTraceReceived,
+			[&b, &stepFinished](QVector<Debugger::StackFrame> &) {
+		b.stackLatency.append(b.timer.nsecsElapsed() - b.pauseTime);
+		b.haveStack = true;
+		stepFinished();
+	});
+
+	// the first stop comes from the pause request sent after launch
+	b.haveStack = false;
+	b.haveTexture = !b.render;
+
+	if (!dbg.setGameDir(QDir::tempPath())) {
+		fprintf(stderr, "failed to start debug adapter\n");
+		return 1;
+	}
+	return app.exec();
+}
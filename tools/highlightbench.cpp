@@ -0,0 +1,189 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+/*
+ * Highlighting benchmark: renders a long function (the largest function in
+ * an .ain, repeated up to the requested number of lines) with the
+ * type-driven InstructionPrinter, and with the regex rules the code view
+ * used previously, applied to the same text.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QTextLayout>
+#include <stdio.h>
+
+#include "aintext.hpp"
+#include "codeindex.hpp"
+#include "instructionprinter.hpp"
+#include "symboltable.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+}
+
+struct Rule {
+	QRegularExpression pattern;
+	QTextCharFormat format;
+};
+
+// the rules of the former regex-based SyntaxHighlighter
+static QVector<Rule> regexRules()
+{
+	QVector<Rule> rules;
+	QTextCharFormat fmt;
+
+	fmt.setForeground(Qt::blue);
+	fmt.setFontWeight(QFont::Bold);
+	rules.append({ QRegularExpression(QStringLiteral("\\bFUNC\\b")), fmt });
+	rules.append({ QRegularExpression(QStringLiteral("\\bENDFUNC\\b")), fmt });
+	fmt.setFontWeight(QFont::Normal);
+
+	fmt.setForeground(Qt::darkCyan);
+	rules.append({ QRegularExpression(QStringLiteral("\\b0x[a-fA-F0-9]+\\b")), fmt });
+	rules.append({ QRegularExpression(QStringLiteral("\\b[1-9][0-9]*\\b")), fmt });
+	rules.append({ QRegularExpression(QStringLiteral("\\b0[0-7]*\\b")), fmt });
+	rules.append({ QRegularExpression(QStringLiteral("\\b[0-9]+\\.[0-9]+\\b")), fmt });
+
+	fmt.setForeground(Qt::darkGray);
+	rules.append({ QRegularExpression(QStringLiteral("^\\S+:")), fmt });
+	rules.append({ QRegularExpression(QStringLiteral("^\\.CASE\\b")), fmt });
+
+	fmt.setForeground(Qt::red);
+	rules.append({ QRegularExpression(QStringLiteral("\"(\\\\.|[^\"\\\\])*\"")), fmt });
+
+	fmt.setForeground(Qt::darkGreen);
+	rules.append({ QRegularExpression(QStringLiteral(";[^\n]*")), fmt });
+	return rules;
+}
+
+static QVector<QTextLayout::FormatRange> regexHighlight(const QVector<Rule> &rules,
+		const QString &text)
+{
+	QVector<QTextLayout::FormatRange> formats;
+	for (const Rule &rule : rules) {
+		QRegularExpressionMatchIterator it = rule.pattern.globalMatch(text);
+		while (it.hasNext()) {
+			QRegularExpressionMatch match = it.next();
+			formats.append({ match.capturedStart(), match.capturedLength(), rule.format });
+		}
+	}
+	return formats;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("xsys4dbg-highlightbench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("xsys4dbg highlighting benchmark");
+	parser.addHelpOption();
+	parser.addPositionalArgument("ain", "The .ain file to take the code from.");
+	QCommandLineOption linesOpt("lines", "Number of lines to render.", "N", "20000");
+	QCommandLineOption iterOpt("iterations", "Number of passes (best is reported).", "N", "5");
+	parser.addOption(linesOpt);
+	parser.addOption(iterOpt);
+	parser.process(app);
+
+	if (parser.positionalArguments().size() != 1)
+		parser.showHelp(1);
+
+	int err;
+	struct ain *ain = ain_open_lazy(parser.positionalArguments()[0], &err);
+	if (!ain) {
+		fprintf(stderr, "Error opening .ain file: %s\n", ain_strerror(err));
+		return 1;
+	}
+
+	CodeIndex *index = CodeIndex::build(ain);
+	int largest = -1;
+	for (int i = 0; i < index->nrFunctions(); i++) {
+		if (largest < 0 || index->functionRange(i).count > index->functionRange(largest).count)
+			largest = i;
+	}
+	CodeIndex::Range range = largest < 0 ? CodeIndex::Range { 0, 0 } : index->functionRange(largest);
+	if (range.count == 0) {
+		fprintf(stderr, "No code in .ain file\n");
+		return 1;
+	}
+
+	// repeat the function to get the requested number of lines
+	int nrLines = qMax(1, parser.value(linesOpt).toInt());
+	QVector<CodeIndex::Instruction> lines;
+	lines.reserve(nrLines);
+	for (int i = 0; lines.size() < nrLines; i = (i + 1) % range.count) {
+		lines.append(index->instructions()[range.first + i]);
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	InstructionPrinter printer(QSharedPointer<const SymbolTable>::create(ain));
+	printf("symbol tables:  %8lld ms\n", (long long)timer.elapsed());
+	printf("function:       %s (%d instructions, %d lines rendered)\n",
+			printer.symbolTable().function(largest)->toUtf8().constData(),
+			range.count, nrLines);
+
+	QVector<Rule> rules = regexRules();
+	int iterations = qMax(1, parser.value(iterOpt).toInt());
+	qint64 bestText = -1, bestRegex = -1, bestTyped = -1;
+	qint64 regexFormats = 0, typedFormats = 0;
+	for (int n = 0; n < iterations; n++) {
+		// text only
+		timer.restart();
+		QVector<QString> texts(nrLines);
+		for (int i = 0; i < nrLines; i++) {
+			texts[i] = printer.toString(largest, lines[i]);
+		}
+		qint64 text = timer.nsecsElapsed();
+
+		// regex rules on top of the text
+		timer.restart();
+		regexFormats = 0;
+		for (int i = 0; i < nrLines; i++) {
+			regexFormats += regexHighlight(rules, texts[i]).size();
+		}
+		qint64 regex = text + timer.nsecsElapsed();
+
+		// text and formats in one pass
+		timer.restart();
+		typedFormats = 0;
+		for (int i = 0; i < nrLines; i++) {
+			typedFormats += printer.print(largest, lines[i]).formats.size();
+		}
+		qint64 typed = timer.nsecsElapsed();
+
+		if (bestText < 0 || text < bestText)
+			bestText = text;
+		if (bestRegex < 0 || regex < bestRegex)
+			bestRegex = regex;
+		if (bestTyped < 0 || typed < bestTyped)
+			bestTyped = typed;
+	}
+
+	printf("text only:      %8.2f ms (%6.2f us/line)\n",
+			bestText / 1e6, bestText / 1e3 / nrLines);
+	printf("text + regex:   %8.2f ms (%6.2f us/line, %lld format ranges)\n",
+			bestRegex / 1e6, bestRegex / 1e3 / nrLines, (long long)regexFormats);
+	printf("text + typed:   %8.2f ms (%6.2f us/line, %lld format ranges)\n",
+			bestTyped / 1e6, bestTyped / 1e3 / nrLines, (long long)typedFormats);
+
+	delete index;
+	ain_free(ain);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+
+/*
+ * Bytecode index benchmark: builds a CodeIndex for an .ain file and reports
+ * how long it takes, along with the cost of the on-disk cache and lookup
+ * throughput.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QThread>
+#include <stdio.h>
+
+#include "aintext.hpp"
+#include "callgraph.hpp"
+#include "codeindex.hpp"
+
+extern "C" {
+#include "system4/ain.h"
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("xsys4dbg-indexbench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("xsys4dbg bytecode index benchmark");
+	parser.addHelpOption();
+	parser.addPositionalArgument("ain", "The .ain file to index.");
+	QCommandLineOption iterOpt("iterations", "Number of times to build the index.", "N", "5");
+	QCommandLineOption searchOpt("search", "Time a text search for PATTERN.", "pattern");
+	QCommandLineOption regexOpt("regex", "Treat the search pattern as a regular expression.");
+	parser.addOption(iterOpt);
+	parser.addOption(searchOpt);
+	parser.addOption(regexOpt);
+	parser.process(app);
+
+	if (parser.positionalArguments().size() != 1)
+		parser.showHelp(1);
+
+	QElapsedTimer timer;
+	timer.start();
+	int err;
+	struct ain *ain = ain_open_lazy(parser.positionalArguments()[0], &err);
+	if (!ain) {
+		fprintf(stderr, "Error opening .ain file: %s\n", ain_strerror(err));
+		return 1;
+	}
+	printf("ain load:      %8lld ms\n", (long long)timer.elapsed());
+
+	int iterations = qMax(1, parser.value(iterOpt).toInt());
+	qint64 best = -1;
+	CodeIndex *index = nullptr;
+	for (int i = 0; i < iterations; i++) {
+		delete index;
+		index = CodeIndex::build(ain);
+		if (best < 0 || index->buildTime() < best)
+			best = index->buildTime();
+	}
+	printf("functions:     %8d\n", index->nrFunctions());
+	printf("instructions:  %8d\n", index->instructions().size());
+	printf("code size:     %8zu bytes\n", (size_t)ain->code_size);
+	printf("xrefs:         %8d\n", index->xrefs().nrRefs());
+	printf("search docs:   %8d\n", index->search().nrDocuments());
+	printf("index build:   %8lld ms (best of %d, %d threads)\n", (long long)best,
+			iterations, QThread::idealThreadCount());
+
+	// round trip through the on-disk cache format
+	QTemporaryDir tmp;
+	QString cachePath = tmp.filePath("index.bin");
+	timer.restart();
+	bool saved = index->save(cachePath);
+	qint64 saveTime = timer.elapsed();
+	CodeIndex *cached = saved ? CodeIndex::load(cachePath, ain) : nullptr;
+	if (cached) {
+		printf("cache size:    %8lld bytes\n", (long long)QFileInfo(cachePath).size());
+		printf("cache save:    %8lld ms\n", (long long)saveTime);
+		printf("cache load:    %8lld ms\n", (long long)cached->buildTime());
+	} else {
+		fprintf(stderr, "cache round trip failed\n");
+	}
+	delete cached;
+
+	timer.restart();
+	CallGraph *calls = CallGraph::build(ain, *index);
+	printf("call graph:    %8lld ms (%d edges)\n", (long long)timer.elapsed(), calls->nrEdges());
+	delete calls;
+
+	// random lookups
+	const int nrLookups = 1000000;
+	QRandomGenerator rng(1);
+	timer.restart();
+	int found = 0;
+	for (int i = 0; i < nrLookups; i++) {
+		uint32_t addr = rng.bounded((quint32)ain->code_size);
+		if (index->functionAt(addr) >= 0)
+			found++;
+		if (index->instructionAt(addr) >= 0)
+			found++;
+	}
+	qint64 ns = timer.nsecsElapsed();
+	printf("lookups:       %8.1f ns/lookup (%d hits)\n", (double)ns / (nrLookups * 2), found);
+
+	if (parser.isSet(searchOpt)) {
+		SearchIndex::Query query = { parser.value(searchOpt), parser.isSet(regexOpt), false };
+		timer.restart();
+		QString error;
+		QVector<int> docs = index->search().search(query, &error);
+		ns = timer.nsecsElapsed();
+		if (!error.isEmpty()) {
+			fprintf(stderr, "invalid pattern: %s\n", error.toUtf8().constData());
+		} else {
+			printf("search:        %8.3f ms (%d documents)\n", ns / 1e6, docs.size());
+		}
+	}
+
+	delete index;
+	ain_free(ain);
+	return 0;
+}
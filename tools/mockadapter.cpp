@@ -0,0 +1,520 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+/*
+ * Stand-in for `xsystem4 --debug-api`. Speaks the DAP dialect DAPClient
+ * expects over stdin/stdout so that the client can be exercised without a
+ * game.
+ *
+ * The shape of the generated data (stack depth, number of variables, scene
+ * size, output spam) is controlled by command line options. Options can also
+ * be passed through the XSYS4DBG_MOCK_OPTIONS environment variable, since
+ * the debugger controls the adapter's command line.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef XSYS4DBG_SHM_TEXTURES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct Options {
+	bool shm = true;
+	int textureWidth = 1024;
+	int textureHeight = 768;
+	int frames = 8;
+	int variables = 16;
+	int arrayLength = 100000;
+	int entities = 32;
+	int partsChildren = 4;
+	int outputBurst = 0;
+	bool snapshot = true;
+};
+
+static Options opts;
+static int seq = 1;
+static bool clientWantsShm = false;
+
+static bool readMessage(QJsonObject &msg)
+{
+	char line[512];
+	int length = -1;
+	while (fgets(line, sizeof(line), stdin)) {
+		if (!strcmp(line, "\r\n") || !strcmp(line, "\n"))
+			break;
+		sscanf(line, "Content-Length: %d", &length);
+	}
+	if (length < 1)
+		return false;
+
+	QByteArray content(length, '\0');
+	if (fread(content.data(), 1, length, stdin) != (size_t)length)
+		return false;
+
+	QJsonDocument doc = QJsonDocument::fromJson(content);
+	if (!doc.isObject())
+		return false;
+	msg = doc.object();
+	return true;
+}
+
+static void send(QJsonObject obj)
+{
+	obj["seq"] = seq++;
+	QByteArray bytes = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+	fprintf(stdout, "Content-Length: %d\r\n\r\n", bytes.size());
+	fwrite(bytes.constData(), 1, bytes.size(), stdout);
+	fflush(stdout);
+}
+
+static void sendResponse(const QJsonObject &req, const QJsonObject &body, bool success = true)
+{
+	send({
+		{ "type", "response" },
+		{ "request_seq", req["seq"] },
+		{ "command", req["command"] },
+		{ "success", success },
+		{ "body", body }
+	});
+}
+
+static void sendEvent(const QString &event, const QJsonObject &body = QJsonObject())
+{
+	send({
+		{ "type", "event" },
+		{ "event", event },
+		{ "body", body }
+	});
+}
+
+// deterministic test pattern so that the client side can be checked by eye
+static void fillPattern(uint8_t *pixels, int w, int h, int stride, int seed)
+{
+	for (int y = 0; y < h; y++) {
+		uint8_t *row = pixels + y * stride;
+		for (int x = 0; x < w; x++) {
+			row[x*4+0] = (x + seed) & 0xff;
+			row[x*4+1] = (y + seed) & 0xff;
+			row[x*4+2] = ((x ^ y) + seed) & 0xff;
+			row[x*4+3] = 0xff;
+		}
+	}
+}
+
+#ifdef XSYS4DBG_SHM_TEXTURES
+static bool makeSharedTexture(QJsonObject &texture, int w, int h, int seed)
+{
+	static int nr_textures = 0;
+	QByteArray name = QString("/xsys4dbg-mock-%1-%2").arg(getpid()).arg(nr_textures++).toUtf8();
+	int stride = w * 4;
+	size_t size = (size_t)stride * h;
+
+	int fd = shm_open(name.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		shm_unlink(name.constData());
+		return false;
+	}
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		shm_unlink(name.constData());
+		return false;
+	}
+	fillPattern((uint8_t*)addr, w, h, stride, seed);
+	munmap(addr, size);
+
+	// the client unlinks the object after mapping it
+	texture["stride"] = stride;
+	texture["shm"] = QJsonObject {
+		{ "name", QString::fromUtf8(name) },
+		{ "offset", 0 },
+		{ "size", (double)size }
+	};
+	return true;
+}
+#endif
+
+static QJsonObject makeTexture(const QJsonObject &args, int seed)
+{
+	int w = opts.textureWidth;
+	int h = opts.textureHeight;
+	QJsonObject texture { { "width", w }, { "height", h } };
+
+#ifdef XSYS4DBG_SHM_TEXTURES
+	if (opts.shm && args["textureTransport"].toString() == "shm"
+			&& makeSharedTexture(texture, w, h, seed))
+		return texture;
+#endif
+
+	QByteArray pixels(w * h * 4, '\0');
+	fillPattern((uint8_t*)pixels.data(), w, h, w * 4, seed);
+	texture["pixels"] = QString::fromLatin1(pixels.toBase64());
+	return texture;
+}
+
+/*
+ * variablesReference encoding: (frame + 1) * 16 + scope + 1 for scopes, and
+ * STRUCT_REF/ARRAY_REF + scopeReference * 256 + variable for structured
+ * variables, so that scopes and variables can be generated without keeping
+ * any state.
+ */
+#define STRUCT_REF (1 << 20)
+#define ARRAY_REF (2 << 20)
+#define STRUCT_MEMBERS 4
+
+static int scopeReference(int frame, int scope)
+{
+	return (frame + 1) * 16 + scope + 1;
+}
+
+static QJsonObject makeStackTrace()
+{
+	QJsonArray frames;
+	for (int i = 0; i < opts.frames; i++) {
+		frames.append(QJsonObject {
+			{ "id", i },
+			{ "name", QString("func_%1").arg(i) },
+			{ "instructionPointerReference", QString::number(0x1000 + i * 0x100, 16) }
+		});
+	}
+	return { { "stackFrames", frames }, { "totalFrames", opts.frames } };
+}
+
+static QJsonObject makeScopes(int frame)
+{
+	QJsonArray scopes {
+		QJsonObject {
+			{ "name", "Locals" },
+			{ "presentationHint", "locals" },
+			{ "variablesReference", scopeReference(frame, 0) }
+		},
+		QJsonObject {
+			{ "name", "Members" },
+			{ "variablesReference", scopeReference(frame, 1) }
+		}
+	};
+	return { { "scopes", scopes } };
+}
+
+static QJsonObject makeInt(const QString &name, int value)
+{
+	return {
+		{ "name", name },
+		{ "value", QString::number(value) },
+		{ "type", "int" },
+		{ "variablesReference", 0 }
+	};
+}
+
+static QJsonObject makeVariables(int ref, const QJsonObject &args)
+{
+	static int counter = 0;
+	QJsonArray vars;
+	if (ref >= ARRAY_REF) {
+		// honour start/count paging of indexed children
+		int start = qBound(0, args["start"].toInt(), opts.arrayLength);
+		int count = args["count"].toInt(opts.arrayLength - start);
+		int end = qMin(opts.arrayLength, start + count);
+		for (int i = start; i < end; i++) {
+			vars.append(makeInt(QString("[%1]").arg(i), (ref + i) % 1000));
+		}
+		return { { "variables", vars } };
+	}
+	if (ref >= STRUCT_REF) {
+		for (int i = 0; i < STRUCT_MEMBERS; i++) {
+			vars.append(makeInt(QString("member_%1").arg(i), (ref + i + counter) % 1000));
+		}
+		return { { "variables", vars } };
+	}
+	for (int i = 0; i < opts.variables; i++) {
+		// values change on every request, like they would while stepping
+		QJsonObject var = makeInt(QString("var_%1").arg(i), (ref * 31 + i + counter) % 1000);
+		if (i % 8 == 6) {
+			var["type"] = "struct";
+			var["value"] = "{...}";
+			var["variablesReference"] = STRUCT_REF + ref * 256 + i;
+			var["namedVariables"] = STRUCT_MEMBERS;
+		} else if (i % 8 == 7) {
+			var["type"] = "array<int>";
+			var["value"] = QString("[%1]").arg(opts.arrayLength);
+			var["variablesReference"] = ARRAY_REF + ref * 256 + i;
+			var["indexedVariables"] = opts.arrayLength;
+		}
+		vars.append(var);
+	}
+	counter++;
+	return { { "variables", vars } };
+}
+
+static QJsonObject makeStackSnapshot(int variableFrames)
+{
+	QJsonArray frames = makeStackTrace()["stackFrames"].toArray();
+	if (variableFrames < 0 || variableFrames > frames.size())
+		variableFrames = frames.size();
+	for (int i = 0; i < variableFrames; i++) {
+		QJsonObject frame = frames[i].toObject();
+		QJsonArray scopes = makeScopes(i)["scopes"].toArray();
+		for (int j = 0; j < scopes.size(); j++) {
+			QJsonObject scope = scopes[j].toObject();
+			scope["variables"] = makeVariables(scope["variablesReference"].toInt(),
+					QJsonObject())["variables"];
+			scopes[j] = scope;
+		}
+		frame["scopes"] = scopes;
+		frames[i] = frame;
+	}
+	return { { "stackFrames", frames } };
+}
+
+static QJsonObject makePartsState(int no)
+{
+	return {
+		{ "type", "cg" },
+		{ "no", no },
+		{ "size", QJsonObject { { "w", 64 }, { "h", 32 } } },
+		{ "origin_offset", QJsonObject { { "x", 0 }, { "y", 0 } } },
+		{ "hitbox", QJsonObject { { "x", 0 }, { "y", 0 }, { "w", 64 }, { "h", 32 } } },
+		{ "surface_area", QJsonObject { { "x", 0 }, { "y", 0 }, { "w", 64 }, { "h", 32 } } }
+	};
+}
+
+static QJsonObject makePartsParams(int z)
+{
+	return {
+		{ "z", z },
+		{ "pos", QJsonObject { { "x", z * 2 }, { "y", z * 3 } } },
+		{ "show", true },
+		{ "alpha", 255 },
+		{ "scale", QJsonObject { { "x", 1 }, { "y", 1 } } },
+		{ "rotation", QJsonObject { { "x", 0 }, { "y", 0 }, { "z", 0 } } },
+		{ "add_color", QJsonObject { { "r", 0 }, { "g", 0 }, { "b", 0 }, { "a", 0 } } },
+		{ "mul_color", QJsonObject { { "r", 255 }, { "g", 255 }, { "b", 255 }, { "a", 255 } } }
+	};
+}
+
+static QJsonObject makeParts(int no, int depth)
+{
+	QJsonArray children;
+	if (depth > 0) {
+		for (int i = 0; i < opts.partsChildren; i++) {
+			children.append(makeParts(no * 100 + i, depth - 1));
+		}
+	}
+	return {
+		{ "no", no },
+		{ "state", "default" },
+		{ "default", makePartsState(no) },
+		{ "hovered", makePartsState(no) },
+		{ "clicked", makePartsState(no) },
+		{ "local", makePartsParams(no) },
+		{ "global", makePartsParams(no) },
+		{ "clickable", false },
+		{ "motions", QJsonArray() },
+		{ "children", children }
+	};
+}
+
+static QJsonObject makeScene()
+{
+	QJsonArray entities;
+	for (int i = 0; i < opts.entities; i++) {
+		QJsonObject e { { "id", i }, { "z", i }, { "z2", 0 } };
+		if (i % 2) {
+			e["parts"] = makeParts(i, 2);
+		} else {
+			e["sprite"] = QJsonObject {
+				{ "no", i },
+				{ "color", QJsonObject { { "r", 0 }, { "g", 0 }, { "b", 0 }, { "a", 255 } } },
+				{ "multiply_color", QJsonObject { { "r", 255 }, { "g", 255 }, { "b", 255 }, { "a", 255 } } },
+				{ "add_color", QJsonObject { { "r", 0 }, { "g", 0 }, { "b", 0 }, { "a", 0 } } },
+				{ "blend_rate", 255 },
+				{ "draw_method", "normal" },
+				{ "rect", QJsonObject { { "x", 0 }, { "y", 0 }, { "w", 800 }, { "h", 600 } } },
+				{ "cg_no", i }
+			};
+		}
+		entities.append(e);
+	}
+	return { { "entities", entities } };
+}
+
+static void stop(const QString &reason)
+{
+	for (int i = 0; i < opts.outputBurst; i++) {
+		sendEvent("output", {
+			{ "category", "stdout" },
+			{ "output", QString("mock output line %1\n").arg(i) }
+		});
+	}
+	sendEvent("stopped", {
+		{ "reason", reason },
+		{ "description", QString("Paused on %1").arg(reason) },
+		{ "threadId", 0 }
+	});
+}
+
+static bool handleRequest(const QJsonObject &req)
+{
+	QString cmd = req["command"].toString();
+	QJsonObject args = req["arguments"].toObject();
+
+	if (cmd == "initialize") {
+		clientWantsShm = args["xsystem4.supportsSharedMemoryTextures"].toBool();
+#ifdef XSYS4DBG_SHM_TEXTURES
+		bool shm = opts.shm && clientWantsShm;
+#else
+		bool shm = false;
+#endif
+		sendResponse(req, {
+			{ "supportsConfigurationDoneRequest", true },
+			{ "supportsInstructionBreakpoints", true },
+			{ "supportsCancelRequest", true },
+			{ "xsystem4.supportsSharedMemoryTextures", shm },
+			{ "xsystem4.supportsStackSnapshot", opts.snapshot }
+		});
+		sendEvent("initialized");
+	} else if (cmd == "pause") {
+		sendResponse(req, QJsonObject());
+		stop("pause");
+	} else if (cmd == "next" || cmd == "stepIn" || cmd == "stepOut") {
+		sendResponse(req, QJsonObject());
+		stop("step");
+	} else if (cmd == "continue") {
+		sendResponse(req, QJsonObject());
+		// pretend we ran straight into a breakpoint
+		stop("breakpoint");
+	} else if (cmd == "stackTrace") {
+		sendResponse(req, makeStackTrace());
+	} else if (cmd == "xsystem4.stackSnapshot") {
+		sendResponse(req, makeStackSnapshot(args["variableFrames"].toInt(-1)));
+	} else if (cmd == "scopes") {
+		sendResponse(req, makeScopes(args["frameId"].toInt()));
+	} else if (cmd == "variables") {
+		sendResponse(req, makeVariables(args["variablesReference"].toInt(), args));
+	} else if (cmd == "setInstructionBreakpoints") {
+		QJsonArray bps;
+		for (const QJsonValue &bp : args["breakpoints"].toArray()) {
+			bps.append(QJsonObject {
+				{ "verified", true },
+				{ "instructionReference", bp.toObject()["instructionReference"] }
+			});
+		}
+		sendResponse(req, { { "breakpoints", bps } });
+	} else if (cmd == "xsystem4.scene") {
+		sendResponse(req, makeScene());
+	} else if (cmd == "disconnect") {
+		sendResponse(req, QJsonObject());
+		sendEvent("terminated");
+		return false;
+	} else if (cmd == "xsystem4.renderEntity") {
+		int id = args["entityId"].toInt();
+		sendResponse(req, {
+			{ "entityId", id },
+			{ "texture", makeTexture(args, id) }
+		});
+	} else if (cmd == "xsystem4.renderParts") {
+		int id = args["partsId"].toInt();
+		sendResponse(req, {
+			{ "partsId", id },
+			{ "texture", makeTexture(args, id) }
+		});
+	} else {
+		// configurationDone, launch, cancel, etc. (requests are answered
+		// synchronously, so there is never anything left to cancel)
+		sendResponse(req, QJsonObject());
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("xsys4dbg-mockadapter");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Mock xsystem4 debug adapter");
+	parser.addHelpOption();
+	QCommandLineOption noShmOpt("no-shm", "Don't offer shared memory textures.");
+	QCommandLineOption textureOpt("texture-size", "Size of rendered textures.", "WxH");
+	QCommandLineOption framesOpt("frames", "Number of stack frames.", "N");
+	QCommandLineOption varsOpt("variables", "Number of variables per scope.", "N");
+	QCommandLineOption arrayOpt("array-length", "Number of elements in array variables.", "N");
+	QCommandLineOption entitiesOpt("entities", "Number of scene entities.", "N");
+	QCommandLineOption childrenOpt("parts-children", "Number of children per parts.", "N");
+	QCommandLineOption burstOpt("output-burst", "Output events sent before each stop.", "N");
+	QCommandLineOption noSnapshotOpt("no-snapshot", "Don't offer xsystem4.stackSnapshot.");
+	// accepted for compatibility with the xsystem4 command line
+	QCommandLineOption debugApiOpt("debug-api", "Ignored.");
+	parser.addOption(noShmOpt);
+	parser.addOption(textureOpt);
+	parser.addOption(framesOpt);
+	parser.addOption(varsOpt);
+	parser.addOption(arrayOpt);
+	parser.addOption(entitiesOpt);
+	parser.addOption(childrenOpt);
+	parser.addOption(burstOpt);
+	parser.addOption(noSnapshotOpt);
+	parser.addOption(debugApiOpt);
+
+	QStringList args = app.arguments();
+	QString envOpts = qEnvironmentVariable("XSYS4DBG_MOCK_OPTIONS");
+	if (!envOpts.isEmpty())
+		args += envOpts.split(' ', Qt::SkipEmptyParts);
+	parser.process(args);
+
+	opts.shm = !parser.isSet(noShmOpt);
+	opts.snapshot = !parser.isSet(noSnapshotOpt);
+	if (parser.isSet(framesOpt))
+		opts.frames = parser.value(framesOpt).toInt();
+	if (parser.isSet(varsOpt))
+		opts.variables = parser.value(varsOpt).toInt();
+	if (parser.isSet(arrayOpt))
+		opts.arrayLength = parser.value(arrayOpt).toInt();
+	if (parser.isSet(entitiesOpt))
+		opts.entities = parser.value(entitiesOpt).toInt();
+	if (parser.isSet(childrenOpt))
+		opts.partsChildren = parser.value(childrenOpt).toInt();
+	if (parser.isSet(burstOpt))
+		opts.outputBurst = parser.value(burstOpt).toInt();
+	if (parser.isSet(textureOpt)) {
+		QStringList dims = parser.value(textureOpt).split('x');
+		if (dims.size() == 2) {
+			opts.textureWidth = dims[0].toInt();
+			opts.textureHeight = dims[1].toInt();
+		}
+	}
+
+	QJsonObject msg;
+	while (readMessage(msg)) {
+		if (msg["type"].toString() != "request")
+			continue;
+		if (!handleRequest(msg))
+			break;
+	}
+	return 0;
+}
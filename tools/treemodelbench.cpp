@@ -0,0 +1,186 @@
+/* Copyright (C) 2023 Nunuhara Cabbage <nunuhara@haniwa.technology>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://gnu.org/licenses/>.
+ */
+
+
+/*
+ * Tree model benchmark. Builds a 50k-node tree with TreeModel and with the
+ * pointer-per-node layout it replaced (where parent() has to search the
+ * grandparent's child list with indexOf), then walks every index the way a
+ * view does: index() for each row, and parent() for each index.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <stdio.h>
+
+#include "treemodel.hpp"
+
+struct BenchNode {
+	int value;
+};
+
+class ArenaModel : public TreeModel<BenchNode>
+{
+public:
+	ArenaModel(int nrNodes, int fanout)
+	{
+		reserveNodes(nrNodes + 1);
+		// breadth-first, so that each node gets `fanout` children
+		// (fanout <= 0: every node is a child of the root)
+		for (int i = 1; i <= nrNodes; i++) {
+			int parent = fanout > 0 ? (i - 1) / fanout : ROOT;
+			addNode(parent, BenchNode { i });
+		}
+	}
+
+	int columnCount(const QModelIndex &parent = QModelIndex()) const override
+	{
+		return 1;
+	}
+
+	QVariant data(const QModelIndex &index, int role) const override
+	{
+		return node(nodeId(index)).value;
+	}
+};
+
+struct PointerNode {
+	PointerNode(int v, PointerNode *p) : value(v), parent(p) {}
+	~PointerNode() { qDeleteAll(children); }
+	int row() const
+	{
+		if (parent)
+			return parent->children.indexOf(const_cast<PointerNode*>(this));
+		return 0;
+	}
+	int value;
+	PointerNode *parent;
+	QVector<PointerNode*> children;
+};
+
+class PointerModel : public QAbstractItemModel
+{
+public:
+	PointerModel(int nrNodes, int fanout)
+	{
+		QVector<PointerNode*> nodes { &root };
+		nodes.reserve(nrNodes + 1);
+		for (int i = 1; i <= nrNodes; i++) {
+			PointerNode *parent = nodes[fanout > 0 ? (i - 1) / fanout : 0];
+			PointerNode *node = new PointerNode(i, parent);
+			parent->children.append(node);
+			nodes.append(node);
+		}
+	}
+
+	QModelIndex index(int row, int column, const QModelIndex &parent) const override
+	{
+		if (!hasIndex(row, column, parent))
+			return QModelIndex();
+		PointerNode *p = parent.isValid()
+			? static_cast<PointerNode*>(parent.internalPointer())
+			: const_cast<PointerNode*>(&root);
+		return createIndex(row, column, p->children[row]);
+	}
+
+	QModelIndex parent(const QModelIndex &index) const override
+	{
+		if (!index.isValid())
+			return QModelIndex();
+		PointerNode *p = static_cast<PointerNode*>(index.internalPointer())->parent;
+		if (p == &root)
+			return QModelIndex();
+		return createIndex(p->row(), 0, p);
+	}
+
+	int rowCount(const QModelIndex &parent) const override
+	{
+		if (!parent.isValid())
+			return root.children.size();
+		return static_cast<PointerNode*>(parent.internalPointer())->children.size();
+	}
+
+	int columnCount(const QModelIndex &parent) const override
+	{
+		return 1;
+	}
+
+	QVariant data(const QModelIndex &index, int role) const override
+	{
+		return static_cast<PointerNode*>(index.internalPointer())->value;
+	}
+
+private:
+	PointerNode root { 0, nullptr };
+};
+
+// Visit every index under `parent`, calling parent() on each (as views do
+// when mapping indices back to rows). Returns the number of indices visited.
+static int walk(const QAbstractItemModel &model, const QModelIndex &parent)
+{
+	int n = 0;
+	int rows = model.rowCount(parent);
+	for (int i = 0; i < rows; i++) {
+		QModelIndex child = model.index(i, 0, parent);
+		if (model.parent(child) != parent)
+			fprintf(stderr, "parent() mismatch\n");
+		n += 1 + walk(model, child);
+	}
+	return n;
+}
+
+template<typename Model>
+static void bench(const char *name, int nrNodes, int fanout)
+{
+	QElapsedTimer timer;
+	timer.start();
+	Model *model = new Model(nrNodes, fanout);
+	qint64 build = timer.nsecsElapsed();
+
+	timer.restart();
+	int visited = walk(*model, QModelIndex());
+	qint64 traverse = timer.nsecsElapsed();
+
+	timer.restart();
+	delete model;
+	qint64 destroy = timer.nsecsElapsed();
+
+	printf("%-8s fanout %-6d nodes %-6d build %8.2f ms  walk %8.2f ms  destroy %8.2f ms\n",
+			name, fanout, visited, build / 1e6, traverse / 1e6, destroy / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("xsys4dbg-treemodel-bench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("xsys4dbg tree model benchmark");
+	parser.addHelpOption();
+	QCommandLineOption nodesOpt("nodes", "Number of nodes.", "N", "50000");
+	parser.addOption(nodesOpt);
+	parser.process(app);
+
+	int nrNodes = parser.value(nodesOpt).toInt();
+	// 0: a single wide node (e.g. a scene with thousands of parts)
+	const int fanouts[] = { 0, 1000, 8 };
+	for (int fanout : fanouts) {
+		bench<ArenaModel>("arena", nrNodes, fanout);
+		bench<PointerModel>("pointer", nrNodes, fanout);
+	}
+	return 0;
+}